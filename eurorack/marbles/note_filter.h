@@ -32,6 +32,8 @@
 #include "stmlib/dsp/dsp.h"
 #include "stmlib/dsp/delay_line.h"
 
+#include <algorithm>
+
 namespace marbles {
 
 // Note: this is a "slow" filter, since it takes about 10 samples to catch
@@ -48,20 +50,18 @@ class NoteFilter {
     lp_1_ = 0.0f;
     lp_2_ = 0.0f;
     std::fill(&previous_values_[0], &previous_values_[N], 0.0f);
+    write_ptr_ = 0;
   }
 
   inline float Process(float value) {
-    float sorted_values[N];
-
-    std::rotate(
-        &previous_values_[0],
-        &previous_values_[1],
-        &previous_values_[N]);
-    previous_values_[N - 1] = value;
+    // The median does not depend on the order of the values, so the history
+    // is a ring buffer and nothing has to be moved.
+    previous_values_[write_ptr_] = value;
+    write_ptr_ = write_ptr_ == N - 1 ? 0 : write_ptr_ + 1;
     
-    std::copy(&previous_values_[0], &previous_values_[N], &sorted_values[0]);
-    std::sort(&sorted_values[0], &sorted_values[N]);
-    value = sorted_values[(N - 1) / 2];
+    float v[N];
+    std::copy(&previous_values_[0], &previous_values_[N], &v[0]);
+    value = Median(v);
     
     const float kLPCoefficient = 0.65f;
     ONE_POLE(lp_1_, value, kLPCoefficient);
@@ -69,14 +69,98 @@ class NoteFilter {
     return lp_2_;
   }
 
+  // Median of 7 values with a 13 comparators selection network (N. Devillard,
+  // "Fast median search: an ANSI C implementation"). Each comparator is a
+  // min/max pair, without any branch.
+  static inline float Median(float* v) {
+    Sort(&v[0], &v[5]); Sort(&v[0], &v[3]); Sort(&v[1], &v[6]);
+    Sort(&v[2], &v[4]); Sort(&v[0], &v[1]); Sort(&v[3], &v[5]);
+    Sort(&v[2], &v[6]); Sort(&v[2], &v[3]); Sort(&v[3], &v[6]);
+    Sort(&v[4], &v[5]); Sort(&v[1], &v[4]); Sort(&v[1], &v[3]);
+    Sort(&v[3], &v[4]);
+    return v[3];
+  }
+
  private:
+  static inline void Sort(float* a, float* b) {
+    float min = std::min(*a, *b);
+    float max = std::max(*a, *b);
+    *a = min;
+    *b = max;
+  }
+
   float previous_values_[N];
+  int write_ptr_;
   float lp_1_;
   float lp_2_;
   
   DISALLOW_COPY_AND_ASSIGN(NoteFilter);
 };
 
+// The same filter for num_channels CV inputs, processed together. The state
+// is stored channel-last so that the median network and the low-pass filters
+// run over contiguous arrays, which the compiler vectorizes.
+template<size_t num_channels>
+class NoteFilterBank {
+ public:
+  NoteFilterBank() { }
+  ~NoteFilterBank() { }
+
+  void Init() {
+    std::fill(&lp_1_[0], &lp_1_[num_channels], 0.0f);
+    std::fill(&lp_2_[0], &lp_2_[num_channels], 0.0f);
+    for (size_t i = 0; i < NoteFilter::N; ++i) {
+      std::fill(
+          &previous_values_[i][0],
+          &previous_values_[i][num_channels],
+          0.0f);
+    }
+    write_ptr_ = 0;
+  }
+
+  inline void Process(const float* in, float* out) {
+    std::copy(&in[0], &in[num_channels], &previous_values_[write_ptr_][0]);
+    write_ptr_ = write_ptr_ == NoteFilter::N - 1 ? 0 : write_ptr_ + 1;
+    
+    float v[NoteFilter::N][num_channels];
+    for (size_t i = 0; i < NoteFilter::N; ++i) {
+      std::copy(
+          &previous_values_[i][0],
+          &previous_values_[i][num_channels],
+          &v[i][0]);
+    }
+    Sort(v[0], v[5]); Sort(v[0], v[3]); Sort(v[1], v[6]);
+    Sort(v[2], v[4]); Sort(v[0], v[1]); Sort(v[3], v[5]);
+    Sort(v[2], v[6]); Sort(v[2], v[3]); Sort(v[3], v[6]);
+    Sort(v[4], v[5]); Sort(v[1], v[4]); Sort(v[1], v[3]);
+    Sort(v[3], v[4]);
+    
+    const float kLPCoefficient = 0.65f;
+    for (size_t c = 0; c < num_channels; ++c) {
+      ONE_POLE(lp_1_[c], v[3][c], kLPCoefficient);
+      ONE_POLE(lp_2_[c], lp_1_[c], kLPCoefficient);
+      out[c] = lp_2_[c];
+    }
+  }
+
+ private:
+  static inline void Sort(float* a, float* b) {
+    for (size_t c = 0; c < num_channels; ++c) {
+      float min = std::min(a[c], b[c]);
+      float max = std::max(a[c], b[c]);
+      a[c] = min;
+      b[c] = max;
+    }
+  }
+
+  float previous_values_[NoteFilter::N][num_channels];
+  int write_ptr_;
+  float lp_1_[num_channels];
+  float lp_2_[num_channels];
+  
+  DISALLOW_COPY_AND_ASSIGN(NoteFilterBank);
+};
+
 }  // namespace marbles
 
 #endif  // MARBLES_NOTE_FILTER_H_
@@ -50,6 +50,14 @@ struct Ratio {
   }
 };
 
+struct RampDividerState {
+  float phase;
+  float train_phase;
+  float max_train_phase;
+  float f_ratio;
+  int32_t reset_counter;
+};
+
 class RampDivider {
  public:
   RampDivider() { }
@@ -91,6 +99,21 @@ class RampDivider {
     }
   }
 
+  void SaveState(RampDividerState* state) const {
+    state->phase = phase_;
+    state->train_phase = train_phase_;
+    state->max_train_phase = max_train_phase_;
+    state->f_ratio = f_ratio_;
+    state->reset_counter = reset_counter_;
+  }
+  
+  void RestoreState(const RampDividerState& state) {
+    phase_ = state.phase;
+    train_phase_ = state.train_phase;
+    max_train_phase_ = state.max_train_phase;
+    f_ratio_ = state.f_ratio;
+    reset_counter_ = std::max(state.reset_counter, 1);
+  }
   
  private:
   float phase_;
@@ -102,6 +125,131 @@ class RampDivider {
   DISALLOW_COPY_AND_ASSIGN(RampDivider);
 };
 
+// num_lanes RampDividers following the same input ramp, each with its own
+// ratio. The wrap of the input is detected once for all the lanes, and
+// between two wraps the lanes are updated without any branch. Same results
+// as RampDivider.
+template<size_t num_lanes>
+class RampDividerBank {
+ public:
+  RampDividerBank() { }
+  ~RampDividerBank() { }
+  
+  void Init() {
+    phase_ = 0.0f;
+    std::fill(&train_phase_[0], &train_phase_[num_lanes], 0.0f);
+    std::fill(&max_train_phase_[0], &max_train_phase_[num_lanes], 1.0f);
+    std::fill(&f_ratio_[0], &f_ratio_[num_lanes], 0.99999f);
+    std::fill(&reset_counter_[0], &reset_counter_[num_lanes], 1.0f);
+  }
+  
+  // The ramp of lane i is written at out + i * lane_stride.
+  void Process(
+      const Ratio* ratio,
+      const float* in,
+      float* out,
+      size_t lane_stride,
+      size_t size) {
+    float next_f_ratio[num_lanes];
+    float q[num_lanes];
+    for (size_t i = 0; i < num_lanes; ++i) {
+      Ratio r = ratio[i];
+      next_f_ratio[i] = r.to_float() * kMaxRampValue;
+      q[i] = static_cast<float>(r.q);
+    }
+    
+    // Local copies of the state cannot alias the output.
+    float train_phase[num_lanes];
+    float max_train_phase[num_lanes];
+    float f_ratio[num_lanes];
+    float reset_counter[num_lanes];
+    std::copy(&train_phase_[0], &train_phase_[num_lanes], &train_phase[0]);
+    std::copy(
+        &max_train_phase_[0],
+        &max_train_phase_[num_lanes],
+        &max_train_phase[0]);
+    std::copy(&f_ratio_[0], &f_ratio_[num_lanes], &f_ratio[0]);
+    std::copy(
+        &reset_counter_[0],
+        &reset_counter_[num_lanes],
+        &reset_counter[0]);
+    
+    float phase = phase_;
+    for (size_t t = 0; t < size; ++t) {
+      const float new_phase = in[t];
+      float frequency = new_phase - phase;
+      if (frequency < 0.0f) {
+        // The input wraps once per period: the lanes are updated one by one.
+        frequency += 1.0f;
+        for (size_t i = 0; i < num_lanes; ++i) {
+          float f = frequency;
+          --reset_counter[i];
+          if (reset_counter[i] == 0.0f) {
+            train_phase[i] = new_phase;
+            reset_counter[i] = q[i];
+            f_ratio[i] = next_f_ratio[i];
+            f = 0.0f;
+            max_train_phase[i] = q[i];
+          }
+          train_phase[i] = std::min(train_phase[i] + f, max_train_phase[i]);
+          const float p = train_phase[i] * f_ratio[i];
+          out[i * lane_stride + t] = p - static_cast<float>(
+              static_cast<int>(p));
+        }
+      } else {
+        for (size_t i = 0; i < num_lanes; ++i) {
+          train_phase[i] = std::min(
+              train_phase[i] + frequency,
+              max_train_phase[i]);
+          const float p = train_phase[i] * f_ratio[i];
+          out[i * lane_stride + t] = p - static_cast<float>(
+              static_cast<int>(p));
+        }
+      }
+      phase = new_phase;
+    }
+    phase_ = phase;
+    
+    std::copy(&train_phase[0], &train_phase[num_lanes], &train_phase_[0]);
+    std::copy(
+        &max_train_phase[0],
+        &max_train_phase[num_lanes],
+        &max_train_phase_[0]);
+    std::copy(&f_ratio[0], &f_ratio[num_lanes], &f_ratio_[0]);
+    std::copy(
+        &reset_counter[0],
+        &reset_counter[num_lanes],
+        &reset_counter_[0]);
+  }
+  
+  // The lanes share the phase of the input.
+  void SaveState(size_t lane, RampDividerState* state) const {
+    state->phase = phase_;
+    state->train_phase = train_phase_[lane];
+    state->max_train_phase = max_train_phase_[lane];
+    state->f_ratio = f_ratio_[lane];
+    state->reset_counter = static_cast<int32_t>(reset_counter_[lane]);
+  }
+  
+  void RestoreState(size_t lane, const RampDividerState& state) {
+    phase_ = state.phase;
+    train_phase_[lane] = state.train_phase;
+    max_train_phase_[lane] = state.max_train_phase;
+    f_ratio_[lane] = state.f_ratio;
+    reset_counter_[lane] = static_cast<float>(
+        std::max(std::min(state.reset_counter, 1 << 16), 1));
+  }
+  
+ private:
+  float phase_;
+  float train_phase_[num_lanes];
+  float max_train_phase_[num_lanes];
+  float f_ratio_[num_lanes];
+  float reset_counter_[num_lanes];
+  
+  DISALLOW_COPY_AND_ASSIGN(RampDividerBank);
+};
+
 }  // namespace marbles
 
 #endif  // MARBLES_RAMP_RAMP_DIVIDER_H_
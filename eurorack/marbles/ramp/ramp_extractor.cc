@@ -47,6 +47,7 @@ using namespace stmlib;
 
 const float kLogOneFourth = 1.189207115f;
 const float kPulseWidthTolerance = 0.05f;
+const float kAudioRatePhaseLockGain = 0.25f;
 
 inline bool IsWithinTolerance(float x, float y, float error) {
   return x >= y * (1.0f - error) && x <= y * (1.0f + error);
@@ -75,7 +76,10 @@ void RampExtractor::Reset() {
   p.on_duration = 2000;
   p.total_duration = 4000;
   p.pulse_width = 0.5f;
+  p.period = 4000.0f;
   fill(&history_[0], &history_[kHistorySize], p);
+  rising_edge_offset_ = falling_edge_offset_ = 1.0f;
+  ScanPulseWidths();
 
   current_pulse_ = 0;
   next_bucket_ = 48.0f;
@@ -89,76 +93,88 @@ void RampExtractor::Reset() {
       0.0f);
 }
 
-float RampExtractor::ComputeAveragePulseWidth(float tolerance) const {
-  float sum = 0.0f;
+void RampExtractor::ScanPulseWidths() {
+  pulse_width_sum_ = 0.0;
+  min_pulse_width_ = max_pulse_width_ = history_[0].pulse_width;
   for (size_t i = 0; i < kHistorySize; ++i) {
-    if (!IsWithinTolerance(history_[i].pulse_width,
-                           history_[current_pulse_].pulse_width,
-                           tolerance)) {
-      return 0.0f;
-    }
-    sum += history_[i].pulse_width;
+    float pw = history_[i].pulse_width;
+    pulse_width_sum_ += pw;
+    min_pulse_width_ = min(min_pulse_width_, pw);
+    max_pulse_width_ = max(max_pulse_width_, pw);
+  }
+}
+
+void RampExtractor::RecordPulseWidth(float pulse_width) {
+  float& pw = history_[current_pulse_].pulse_width;
+  const float evicted = pw;
+  pw = pulse_width;
+  pulse_width_sum_ += static_cast<double>(pulse_width) - evicted;
+  if ((evicted == min_pulse_width_ && pulse_width > evicted) ||
+      (evicted == max_pulse_width_ && pulse_width < evicted)) {
+    // The extremum may have left the window.
+    ScanPulseWidths();
+  } else {
+    min_pulse_width_ = min(min_pulse_width_, pulse_width);
+    max_pulse_width_ = max(max_pulse_width_, pulse_width);
+  }
+}
+
+float RampExtractor::ComputeAveragePulseWidth(float tolerance) const {
+  // All the pulse widths are within tolerance of the last one iff the
+  // extrema are.
+  const float pw = history_[current_pulse_].pulse_width;
+  if (!IsWithinTolerance(min_pulse_width_, pw, tolerance) ||
+      !IsWithinTolerance(max_pulse_width_, pw, tolerance)) {
+    return 0.0f;
   }
-  return sum / static_cast<float>(kHistorySize);
+  return static_cast<float>(pulse_width_sum_) / \
+      static_cast<float>(kHistorySize);
 }
 
 RampExtractor::Prediction RampExtractor::PredictNextPeriod() {
-  float last_period = static_cast<float>(history_[current_pulse_].total_duration);
+  float last_period = history_[current_pulse_].period;
   
+  // Score the predictions made for the period that just ended. The slow
+  // moving average is never used.
   Predictor best_predictor = PREDICTOR_FAST_MOVING_AVERAGE;
-
   for (int i = PREDICTOR_FAST_MOVING_AVERAGE; i < PREDICTOR_LAST; ++i) {
     float error = (predicted_period_[i] - last_period) / (last_period + 0.01f);
     // Scoring function: 10% error is half as good as 0% error.
     float accuracy = 1.0f / (1.0f + 100.0f * error * error);
     // Slowly trust good predictors, quickly demote predictors who make errors.
     SLOPE(prediction_accuracy_[i], accuracy, 0.1f, 0.5f);
-
-    // (Ugly code but I don't want virtuals for these.)
-    switch (i) {
-      case PREDICTOR_SLOW_MOVING_AVERAGE:
-        ONE_POLE(predicted_period_[i], last_period, 0.1f);
-        break;
-
-      case PREDICTOR_FAST_MOVING_AVERAGE:
-        ONE_POLE(predicted_period_[i], last_period, 0.5f);
-        break;
-
-      case PREDICTOR_HASH:
-        {
-          size_t t_2 = (current_pulse_ - 2 + kHistorySize) % kHistorySize;
-          size_t t_1 = (current_pulse_ - 1 + kHistorySize) % kHistorySize;
-          size_t t_0 = current_pulse_;
-          
-          size_t hash = history_[t_1].bucket + 17 * history_[t_2].bucket;
-          ONE_POLE(
-              prediction_hash_table_[hash % kHashTableSize],
-              last_period,
-              0.5f);
-              
-          hash = history_[t_0].bucket + 17 * history_[t_1].bucket;
-          predicted_period_[i] = prediction_hash_table_[hash % kHashTableSize];
-          if (predicted_period_[i] == 0.0f) {
-            predicted_period_[i] = last_period;
-          }
-        }
-        break;
-        
-      default:
-        {
-          // Periodicity detector.
-          size_t candidate_period = i - PREDICTOR_PERIOD_1 + 1;
-          size_t t = current_pulse_ + 1 + kHistorySize - candidate_period;
-          predicted_period_[i] = history_[t % kHistorySize].total_duration;
-        }
-        break;
-    }
-    
+  }
+  for (int i = PREDICTOR_FAST_MOVING_AVERAGE; i < PREDICTOR_LAST; ++i) {
     if (prediction_accuracy_[i] >= prediction_accuracy_[best_predictor]) {
       best_predictor = Predictor(i);
     }
   }
   
+  // Update the predictions. Each of them is an accumulator updated once per
+  // pulse, or a lookup in the history.
+  ONE_POLE(
+      predicted_period_[PREDICTOR_FAST_MOVING_AVERAGE],
+      last_period,
+      0.5f);
+  
+  size_t t_2 = (current_pulse_ - 2 + kHistorySize) % kHistorySize;
+  size_t t_1 = (current_pulse_ - 1 + kHistorySize) % kHistorySize;
+  size_t t_0 = current_pulse_;
+  size_t hash = history_[t_1].bucket + 17 * history_[t_2].bucket;
+  ONE_POLE(prediction_hash_table_[hash % kHashTableSize], last_period, 0.5f);
+  hash = history_[t_0].bucket + 17 * history_[t_1].bucket;
+  float hash_prediction = prediction_hash_table_[hash % kHashTableSize];
+  predicted_period_[PREDICTOR_HASH] = hash_prediction == 0.0f
+      ? last_period
+      : hash_prediction;
+  
+  // Periodicity detectors.
+  for (int i = PREDICTOR_PERIOD_1; i < PREDICTOR_LAST; ++i) {
+    size_t candidate_period = i - PREDICTOR_PERIOD_1 + 1;
+    size_t t = current_pulse_ + 1 + kHistorySize - candidate_period;
+    predicted_period_[i] = history_[t % kHistorySize].period;
+  }
+  
   Prediction p;
   p.period = predicted_period_[best_predictor];
   p.accuracy = prediction_accuracy_[best_predictor];
@@ -171,14 +187,20 @@ void RampExtractor::Process(
     bool always_ramp_to_maximum,
     const GateFlags* gate_flags,
     float* ramp, 
-    size_t size) {
+    size_t size,
+    const float* edge_offsets) {
   while (size--) {
     GateFlags flags = *gate_flags++;
+    const float edge_offset = edge_offsets ? *edge_offsets++ : 1.0f;
     // We are done with the previous pulse.
     if (flags & GATE_FLAG_RISING) {
       Pulse& p = history_[current_pulse_];
       const bool record_pulse = p.total_duration < reset_interval_;
       
+      // The samples counted in the pulse start and end after the edges.
+      const float start_offset = rising_edge_offset_;
+      rising_edge_offset_ = edge_offset;
+      
       if (!record_pulse) {
         // Quite a long pause - the clock has probably been stopped
         // and restarted.
@@ -187,7 +209,8 @@ void RampExtractor::Process(
         reset_counter_ = ratio.q;
         reset_interval_ = 4 * p.total_duration;
       } else {
-        float period = float(p.total_duration);
+        float period = float(p.total_duration) + start_offset - edge_offset;
+        p.period = period;
         if (period <= audio_rate_period_hysteresis_) {
           audio_rate_ = true;
           audio_rate_period_hysteresis_ = audio_rate_period_ * 1.1f;
@@ -204,13 +227,28 @@ void RampExtractor::Process(
           no_glide |= target_frequency_ > up_tolerance ||
               target_frequency_ < down_tolerance;
           lp_coefficient_ = no_glide ? 1.0f : period * 0.00001f;
+          
+          if (edge_offsets) {
+            // The edge timing is known precisely enough to also lock the
+            // phase: it should have wrapped edge_offset samples ago.
+            float error = (edge_offset - 1.0f) * frequency_ - train_phase_;
+            error -= static_cast<float>(static_cast<int>(error + 1.5f)) - 1.0f;
+            train_phase_ += error * kAudioRatePhaseLockGain;
+            if (train_phase_ < 0.0f) {
+              train_phase_ += 1.0f;
+            } else if (train_phase_ >= 1.0f) {
+              train_phase_ -= 1.0f;
+            }
+          }
         } else {
           audio_rate_ = false;
           audio_rate_period_hysteresis_ = audio_rate_period_;
 
           // Compute the pulse width of the previous pulse, and check if the
           // PW has been consistent over the past pulses.
-          p.pulse_width = static_cast<float>(p.on_duration) / period;
+          float on_duration = float(p.on_duration) + start_offset - \
+              falling_edge_offset_;
+          RecordPulseWidth(on_duration / period);
           average_pulse_width_ = ComputeAveragePulseWidth(kPulseWidthTolerance);
         
           if (p.on_duration < 32) {
@@ -232,8 +270,9 @@ void RampExtractor::Process(
               reset_frequency_ = \
                   (0.01f + max_train_phase_ - train_phase_) * 0.0625f;
             } else {
+              // Start from the phase reached since the actual edge.
               reset_frequency_ = 0.0f;
-              train_phase_ = 0.0f;
+              train_phase_ = (edge_offset - 1.0f) * frequency_;
               f_ratio_ = next_f_ratio_;
               max_train_phase_ = next_max_train_phase_;
             }
@@ -267,12 +306,20 @@ void RampExtractor::Process(
     // If the pulse width is constant, and if a clock falling edge is
     // detected, estimate the period using the on time and the pulse width,
     // and correct the phase increment accordingly.
+    if (flags & GATE_FLAG_FALLING) {
+      falling_edge_offset_ = edge_offset;
+    }
     if ((flags & GATE_FLAG_FALLING) &&
         average_pulse_width_ > 0.0f) {
-      float t_on = static_cast<float>(history_[current_pulse_].on_duration);
+      float t_on = static_cast<float>(history_[current_pulse_].on_duration) + \
+          rising_edge_offset_ - falling_edge_offset_;
       float next = max_train_phase_ - static_cast<float>(reset_counter_) + 1.0f;
       float pw = average_pulse_width_;
-      frequency_ = max((next - train_phase_), 0.0f) * pw / ((1.0f - pw) * t_on);
+      // The off time left is shorter by the time elapsed since the edge,
+      // beyond the sample that the phase increment of this sample accounts
+      // for.
+      float t_off = (1.0f - pw) * t_on + (1.0f - falling_edge_offset_) * pw;
+      frequency_ = max((next - train_phase_), 0.0f) * pw / t_off;
     }
     
     if (audio_rate_) {
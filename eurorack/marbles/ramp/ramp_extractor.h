@@ -51,12 +51,19 @@ class RampExtractor {
   ~RampExtractor() { }
   
   void Init(float max_frequency);
+  
+  // edge_offsets, when given, holds for each sample flagged as a rising or
+  // falling edge the time elapsed since the actual edge, in samples, within
+  // (0, 1]. The period and the phase are then measured with sub-sample
+  // accuracy. Without it, edges are assumed to occur one sample before they
+  // are flagged.
   void Process(
       Ratio r,
       bool always_ramp_to_maximum,
       const stmlib::GateFlags* gate_flags,
       float* ramp,
-      size_t size);
+      size_t size,
+      const float* edge_offsets = NULL);
   void Reset();
   
  private:
@@ -65,6 +72,7 @@ class RampExtractor {
     uint32_t total_duration;
     uint32_t bucket;  // 4xlog2(total_duration).
     float pulse_width;
+    float period;  // total_duration, corrected by the edge offsets.
   };
   
   struct Prediction {
@@ -93,13 +101,24 @@ class RampExtractor {
   static const size_t kHashTableSize = 256;
   
   float ComputeAveragePulseWidth(float tolerance) const;
+  void RecordPulseWidth(float pulse_width);
+  void ScanPulseWidths();
   
   Prediction PredictNextPeriod();
 
   size_t current_pulse_;
   Pulse history_[kHistorySize];
+  float rising_edge_offset_;
+  float falling_edge_offset_;
   float next_bucket_;
   
+  // Running statistics of history_[].pulse_width, updated when a pulse is
+  // recorded rather than recomputed from the whole history. The sum of 16
+  // floats is exact in double precision, so it does not drift.
+  double pulse_width_sum_;
+  float min_pulse_width_;
+  float max_pulse_width_;
+  
   float prediction_hash_table_[kHashTableSize];
   float predicted_period_[PREDICTOR_LAST];
   float prediction_accuracy_[PREDICTOR_LAST];
@@ -42,6 +42,8 @@ void LagProcessor::Init() {
  ramp_value_ = 0.0f;
  lp_state_ = 0.0f;
  previous_phase_ = 0.0f;
+ cached_smoothness_ = -1.0f;
+ cached_ratio_ = 1.0f;
 }
 
 float LagProcessor::Process(float value, float smoothness, float phase) {
@@ -59,7 +61,7 @@ float LagProcessor::Process(float value, float smoothness, float phase) {
   // When smoothness approaches 0, the response curve is tweaked to give
   // immediate voltage changes, without any lag.
   frequency *= 0.25f;
-  frequency *= SemitonesToRatio(84.0f * (1.0f - smoothness));
+  frequency *= FrequencyRatio(smoothness);
   if (frequency >= 1.0f) {
     frequency = 1.0f;
   }
@@ -76,7 +78,7 @@ float LagProcessor::Process(float value, float smoothness, float phase) {
   
   float interp_linearity = (1.0f - smoothness) * 5.0f;
   CONSTRAIN(interp_linearity, 0.0f, 1.0f);
-  float warped_phase = Interpolate(lut_raised_cosine, phase, 256.0f);
+  float warped_phase = WarpPhase(phase);
   
   float interp_phase = Crossfade(warped_phase, phase, interp_linearity);
   float interp = Crossfade(ramp_start_, value, interp_phase);
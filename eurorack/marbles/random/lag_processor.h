@@ -31,7 +31,14 @@
 
 #include "stmlib/stmlib.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
+
+#include "stmlib/dsp/dsp.h"
+#include "stmlib/dsp/units.h"
+
+#include "marbles/resources.h"
 
 namespace marbles {
 
@@ -47,15 +54,174 @@ class LagProcessor {
   
   float Process(float value, float smoothness, float phase);
 
+  // Frequency multiplier of the glide filter. It depends only on smoothness,
+  // which is constant most of the time, so it is recomputed only when
+  // smoothness changes.
+  inline float FrequencyRatio(float smoothness) {
+    if (smoothness != cached_smoothness_) {
+      cached_smoothness_ = smoothness;
+      cached_ratio_ = stmlib::SemitonesToRatio(84.0f * (1.0f - smoothness));
+    }
+    return cached_ratio_;
+  }
+  
+  static inline float WarpPhase(float phase) {
+    return stmlib::Interpolate(lut_raised_cosine, phase, 256.0f);
+  }
+
  private:
   float ramp_start_;
   float ramp_value_;
   float lp_state_;
   float previous_phase_;
+  float cached_smoothness_;
+  float cached_ratio_;
   
   DISALLOW_COPY_AND_ASSIGN(LagProcessor);
 };
 
+enum LagFlags {
+  // A new voltage has been generated: the interpolation restarts from the
+  // current output.
+  LAG_FLAG_RESET = 1,
+  // The output is smoothed on this sample. Otherwise, the lag processor is
+  // left untouched.
+  LAG_FLAG_ACTIVE = 2
+};
+
+// Inputs of a lag processor for each sample of a block, with the table
+// lookups already done. OutputChannel fills them, with the same stride as its
+// output, when the smoothing is left to a LagProcessorBank.
+struct LagRequest {
+  float* value;
+  float* smoothness;
+  float* phase;
+  float* warped_phase;
+  float* frequency_ratio;
+  uint32_t* flags;
+};
+
+// num_lanes LagProcessors, with their state stored as arrays, processing
+// interleaved blocks. Inactive lanes are computed too and their results
+// discarded, so that the loop over lanes has no branch and is vectorized.
+// Same results as LagProcessor.
+template<size_t num_lanes>
+class LagProcessorBank {
+ public:
+  LagProcessorBank() { }
+  ~LagProcessorBank() { }
+  
+  void Init() {
+    for (size_t i = 0; i < num_lanes; ++i) {
+      Reset(i);
+    }
+  }
+  
+  // Returns a lane to the state set by Init(), for example when the channel
+  // it smoothes starts being used again.
+  void Reset(size_t lane) {
+    ramp_start_[lane] = 0.0f;
+    ramp_value_[lane] = 0.0f;
+    lp_state_[lane] = 0.0f;
+    previous_phase_[lane] = 0.0f;
+  }
+  
+  // Inputs and output have a stride of num_lanes. The output is written only
+  // on the active samples.
+  void Process(const LagRequest& request, float* out, size_t size) {
+    // Local copies of the state cannot alias the inputs.
+    float ramp_start[num_lanes];
+    float ramp_value[num_lanes];
+    float lp_state[num_lanes];
+    float previous_phase[num_lanes];
+    std::copy(&ramp_start_[0], &ramp_start_[num_lanes], &ramp_start[0]);
+    std::copy(&ramp_value_[0], &ramp_value_[num_lanes], &ramp_value[0]);
+    std::copy(&lp_state_[0], &lp_state_[num_lanes], &lp_state[0]);
+    std::copy(
+        &previous_phase_[0],
+        &previous_phase_[num_lanes],
+        &previous_phase[0]);
+    
+    const float* value = request.value;
+    const float* smoothness = request.smoothness;
+    const float* phase = request.phase;
+    const float* warped_phase = request.warped_phase;
+    const float* frequency_ratio = request.frequency_ratio;
+    const uint32_t* flags = request.flags;
+    
+    while (size--) {
+      for (size_t i = 0; i < num_lanes; ++i) {
+        const uint32_t active = flags[i] & LAG_FLAG_ACTIVE ? ~0u : 0u;
+        const uint32_t reset = flags[i] & LAG_FLAG_RESET ? ~0u : 0u;
+        const float s = smoothness[i];
+        ramp_start[i] = Select(ramp_start[i], ramp_value[i], reset);
+        
+        // Same computations as LagProcessor::Process, with the conditions
+        // written as min/max and masks.
+        float frequency = phase[i] - previous_phase[i];
+        frequency += frequency < 0.0f ? 1.0f : 0.0f;
+        frequency *= 0.25f;
+        frequency *= frequency_ratio[i];
+        frequency = std::min(frequency, 1.0f);
+        frequency += 20.f * std::max(0.05f - s, 0.0f) * (1.0f - frequency);
+        
+        const float lp = lp_state[i] + frequency * (value[i] - lp_state[i]);
+        
+        const float interp_amount = std::max(
+            std::min((s - 0.6f) * 5.0f, 1.0f), 0.0f);
+        const float interp_linearity = std::max(
+            std::min((1.0f - s) * 5.0f, 1.0f), 0.0f);
+        const float interp_phase = stmlib::Crossfade(
+            warped_phase[i], phase[i], interp_linearity);
+        const float interp = stmlib::Crossfade(
+            ramp_start[i], value[i], interp_phase);
+        const float result = stmlib::Crossfade(lp, interp, interp_amount);
+        
+        previous_phase[i] = Select(previous_phase[i], phase[i], active);
+        lp_state[i] = Select(lp_state[i], lp, active);
+        ramp_value[i] = Select(ramp_value[i], interp, active);
+        out[i] = Select(out[i], result, active);
+      }
+      value += num_lanes;
+      smoothness += num_lanes;
+      phase += num_lanes;
+      warped_phase += num_lanes;
+      frequency_ratio += num_lanes;
+      flags += num_lanes;
+      out += num_lanes;
+    }
+    
+    std::copy(&ramp_start[0], &ramp_start[num_lanes], &ramp_start_[0]);
+    std::copy(&ramp_value[0], &ramp_value[num_lanes], &ramp_value_[0]);
+    std::copy(&lp_state[0], &lp_state[num_lanes], &lp_state_[0]);
+    std::copy(
+        &previous_phase[0],
+        &previous_phase[num_lanes],
+        &previous_phase_[0]);
+  }
+  
+ private:
+  // a if mask is 0, b if all its bits are set. A bitwise blend, so that the
+  // value which is not selected cannot leak a NaN or an infinity into the
+  // result.
+  static inline float Select(float a, float b, uint32_t mask) {
+    uint32_t a_bits, b_bits;
+    memcpy(&a_bits, &a, sizeof(float));
+    memcpy(&b_bits, &b, sizeof(float));
+    const uint32_t bits = (a_bits & ~mask) | (b_bits & mask);
+    float result;
+    memcpy(&result, &bits, sizeof(float));
+    return result;
+  }
+  
+  float ramp_start_[num_lanes];
+  float ramp_value_[num_lanes];
+  float lp_state_[num_lanes];
+  float previous_phase_[num_lanes];
+  
+  DISALLOW_COPY_AND_ASSIGN(LagProcessorBank);
+};
+
 }  // namespace marbles
 
 #endif  // MARBLES_RANDOM_LAG_PROCESSOR_H_
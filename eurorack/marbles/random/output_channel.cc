@@ -65,7 +65,7 @@ void OutputChannel::Init() {
   
   Scale scale;
   scale.Init();
-  for (int i = 0; i < 6; ++i) {
+  for (int i = 0; i < kNumScaleSlots; ++i) {
     quantizer_[i].Init(scale);
   }
 }
@@ -96,7 +96,8 @@ void OutputChannel::Process(
     const float* phase,
     float* output,
     size_t size,
-    size_t stride) {
+    size_t stride,
+    const LagRequest* lag_request) {
   
   ParameterInterpolator steps_modulation(
       &previous_steps_, steps_, size);
@@ -119,12 +120,15 @@ void OutputChannel::Process(
     quantized_voltage_ = Quantize(voltage_, 2.0f * steps_ - 1.0f);
   }
   
+  size_t lag_index = 0;
   while (size--) {
     const float steps = steps_modulation.Next();
+    uint32_t lag_flags = 0;
     if (*phase < previous_phase_) {
       previous_voltage_ = voltage_;
       voltage_ = GenerateNewVoltage(random_sequence);
       lag_processor_.ResetRamp();
+      lag_flags |= LAG_FLAG_RESET;
       quantized_voltage_ = Quantize(voltage_, 2.0f * steps - 1.0f);
       if (register_mode_) {
         reacquisition_counter_ = kNumReacquisitions;
@@ -133,9 +137,27 @@ void OutputChannel::Process(
     
     if (steps >= 0.5f) {
       *output = quantized_voltage_;
-    } else {
+    } else if (!lag_request) {
       const float smoothness = 1.0f - 2.0f * steps;
       *output = lag_processor_.Process(voltage_, smoothness, *phase);
+    } else {
+      lag_flags |= LAG_FLAG_ACTIVE;
+    }
+    
+    if (lag_request) {
+      const float smoothness = 1.0f - 2.0f * steps;
+      const bool active = lag_flags & LAG_FLAG_ACTIVE;
+      lag_request->value[lag_index] = voltage_;
+      lag_request->smoothness[lag_index] = smoothness;
+      lag_request->phase[lag_index] = *phase;
+      lag_request->warped_phase[lag_index] = active
+          ? LagProcessor::WarpPhase(*phase)
+          : *phase;
+      lag_request->frequency_ratio[lag_index] = active
+          ? lag_processor_.FrequencyRatio(smoothness)
+          : 1.0f;
+      lag_request->flags[lag_index] = lag_flags;
+      lag_index += stride;
     }
     output += stride;
     previous_phase_ = *phase++;
@@ -38,6 +38,16 @@ namespace marbles {
 
 class RandomSequence;
 
+// The 6 factory scales, plus one slot for a user-loaded scale.
+const int kNumScaleSlots = 7;
+
+// Values held by an OutputChannel between two clock ticks.
+struct OutputChannelState {
+  float previous_voltage;
+  float voltage;
+  float quantized_voltage;
+};
+
 struct ScaleOffset {
   ScaleOffset(float s, float o) {
     scale = s;
@@ -62,13 +72,34 @@ class OutputChannel {
     quantizer_[i].Init(scale);
   }
   
+  void LoadScale(int i, const QuantizerTable* table) {
+    quantizer_[i].Init(table);
+  }
+  
+  // When lag_request is not NULL, the smoothed samples are not computed:
+  // their output is left untouched, and the inputs of the lag processor are
+  // written to lag_request instead.
   void Process(
       RandomSequence* random_sequence,
       const float* phase,
       float* output,
       size_t size,
-      size_t stride);
+      size_t stride,
+      const LagRequest* lag_request = NULL);
 
+  void SaveState(OutputChannelState* state) const {
+    state->previous_voltage = previous_voltage_;
+    state->voltage = voltage_;
+    state->quantized_voltage = quantized_voltage_;
+  }
+  
+  void RestoreState(const OutputChannelState& state) {
+    previous_voltage_ = state.previous_voltage;
+    voltage_ = state.voltage;
+    quantized_voltage_ = state.quantized_voltage;
+    reacquisition_counter_ = 0;
+  }
+  
   inline void set_spread(float spread) {
     spread_ = spread;
   }
@@ -129,7 +160,7 @@ class OutputChannel {
   
   LagProcessor lag_processor_;
   
-  Quantizer quantizer_[6];
+  Quantizer quantizer_[kNumScaleSlots];
   
   DISALLOW_COPY_AND_ASSIGN(OutputChannel);
 };
@@ -37,21 +37,21 @@ namespace marbles {
 
 using namespace std;
 
-void Quantizer::Init(const Scale& scale) {
+bool QuantizerTable::Init(const Scale& scale) {
   int n = scale.num_degrees;
 
   // We don't want garbage scale data here...
   if (!n || n > kMaxDegrees || scale.base_interval == 0.0f) {
-    return;
+    return false;
   }
 
-  num_degrees_ = n;
-  base_interval_ = scale.base_interval;
-  base_interval_reciprocal_ = 1.0f / scale.base_interval;
+  num_degrees = n;
+  base_interval = scale.base_interval;
+  base_interval_reciprocal = 1.0f / scale.base_interval;
   
   uint8_t second_largest_threshold = 0;
   for (int i = 0; i < n; ++i) {
-    voltage_[i] = scale.degree[i].voltage;
+    voltage[i] = scale.degree[i].voltage;
     if (scale.degree[i].weight != 255 && \
         scale.degree[i].weight >= second_largest_threshold) {
       second_largest_threshold = scale.degree[i].weight;
@@ -79,11 +79,27 @@ void Quantizer::Init(const Scale& scale) {
         last = i;
       }
     }
-    level_[t].bitmask = bitmask;
-    level_[t].first = first;
-    level_[t].last = last;
+    level[t].bitmask = bitmask;
+    level[t].first = first;
+    level[t].last = last;
   }
-  
+  return true;
+}
+
+void Quantizer::Init(const Scale& scale) {
+  if (!table_.Init(scale)) {
+    return;
+  }
+  active_table_ = &table_;
+  Reset();
+}
+
+void Quantizer::Init(const QuantizerTable* table) {
+  active_table_ = table;
+  Reset();
+}
+
+void Quantizer::Reset() {
   level_quantizer_.Init();
   fill(&feedback_[0], &feedback_[kNumThresholds], 0.0f);
 }
@@ -99,25 +115,26 @@ float Quantizer::Process(float value, float amount, bool hysteresis) {
       value += feedback_[level];
     }
 
-    const float note = value * base_interval_reciprocal_;
+    const QuantizerTable& t = *active_table_;
+    const float note = value * t.base_interval_reciprocal;
     MAKE_INTEGRAL_FRACTIONAL(note);
     if (value < 0.0f) {
       note_integral -= 1;
       note_fractional += 1.0f;
     }
-    note_fractional *= base_interval_;
+    note_fractional *= t.base_interval;
     
     // Search for the tightest upper/lower bound in the set of available
     // voltages. stl::upper_bound / stl::lower_bound wouldn't work here
     // because some entries are masked.
-    Level l = level_[level];
-    float a = voltage_[l.last] - base_interval_;
-    float b = voltage_[l.first] + base_interval_;
+    QuantizerTable::Level l = t.level[level];
+    float a = t.voltage[l.last] - t.base_interval;
+    float b = t.voltage[l.first] + t.base_interval;
 
     uint16_t bitmask = l.bitmask;
-    for (int i = 0; i < num_degrees_; ++i) {
+    for (int i = 0; i < t.num_degrees; ++i) {
       if (bitmask & 1) {
-        float v = voltage_[i];
+        float v = t.voltage[i];
         if (note_fractional > v) {
           a = v;
         } else {
@@ -129,7 +146,7 @@ float Quantizer::Process(float value, float amount, bool hysteresis) {
     }
     
     quantized_voltage = note_fractional < (a + b) * 0.5f ? a : b;
-    quantized_voltage += static_cast<float>(note_integral) * base_interval_;
+    quantized_voltage += static_cast<float>(note_integral) * t.base_interval;
     feedback_[level] = (quantized_voltage - raw_value) * 0.25f;
   }
   return quantized_voltage;
@@ -89,29 +89,47 @@ struct Scale {
   }
 };
 
+// Compiled form of a Scale: degree voltages and the masks of active degrees
+// for each threshold level. It holds no state, so a single table can be shared
+// by all the quantizers using the same scale.
+struct QuantizerTable {
+  struct Level {
+    uint16_t bitmask;  // bitmask of active degrees.
+    uint8_t first;  // index of the first active degree.
+    uint8_t last;   // index of the last active degree.
+  };
+  
+  // Returns false (and leaves the table untouched) for garbage scale data.
+  bool Init(const Scale& scale);
+  
+  float voltage[kMaxDegrees];
+  Level level[kNumThresholds];
+  
+  float base_interval;
+  float base_interval_reciprocal;
+  int num_degrees;
+};
+
 class Quantizer {
  public:
   Quantizer() { }
   ~Quantizer() { }
 
+  // Compiles the scale into a table owned by this quantizer.
   void Init(const Scale& scale);
+  
+  // Uses a table compiled elsewhere. The table must outlive the quantizer.
+  void Init(const QuantizerTable* table);
 
   float Process(float value, float amount, bool hysteresis);
   
  private:
-  struct Level {
-    uint16_t bitmask;  // bitmask of active degrees.
-    uint8_t first;  // index of the first active degree.
-    uint8_t last;   // index of the last active degree.
-  };
-  float voltage_[kMaxDegrees];
+  void Reset();
+  
+  QuantizerTable table_;
+  const QuantizerTable* active_table_;
 
-  Level level_[kNumThresholds];
   float feedback_[kNumThresholds];
-  
-  float base_interval_;
-  float base_interval_reciprocal_;
-  int num_degrees_;
   stmlib::HysteresisQuantizer level_quantizer_;
   
   DISALLOW_COPY_AND_ASSIGN(Quantizer);
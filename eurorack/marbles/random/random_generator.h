@@ -46,7 +46,11 @@ class RandomGenerator {
   }
   
   inline void Mix(uint32_t word) {
-    // state_ ^= word;
+    state_ ^= word;
+  }
+  
+  inline uint32_t state() const {
+    return state_;
   }
   
   inline uint32_t GetWord() {
@@ -42,6 +42,25 @@ const int kHistoryBufferSize = 16;
 
 const float kMaxUint32 = 4294967296.0f;
 
+// Plain copy of the state of a RandomSequence, for saving and recalling
+// loops. The redo pointers are stored as indices, -1 standing for NULL.
+struct RandomSequenceState {
+  float loop[kDejaVuBufferSize];
+  float history[kHistoryBufferSize];
+  int32_t loop_write_head;
+  int32_t length;
+  int32_t step;
+  int32_t record_head;
+  int32_t replay_head;
+  int32_t replay_start;
+  uint32_t replay_hash;
+  uint32_t replay_shift;
+  int8_t redo_read_index;
+  int8_t redo_write_index;
+  int8_t redo_write_history_index;
+  int8_t padding;
+};
+
 class RandomSequence {
  public:
   RandomSequence() { }
@@ -190,6 +209,56 @@ class RandomSequence {
     step_ = step_ % length;
   }
   
+  void SaveState(RandomSequenceState* state) const {
+    std::copy(&loop_[0], &loop_[kDejaVuBufferSize], &state->loop[0]);
+    std::copy(&history_[0], &history_[kHistoryBufferSize], &state->history[0]);
+    state->loop_write_head = loop_write_head_;
+    state->length = length_;
+    state->step = step_;
+    state->record_head = record_head_;
+    state->replay_head = replay_head_;
+    state->replay_start = replay_start_;
+    state->replay_hash = replay_hash_;
+    state->replay_shift = replay_shift_;
+    state->redo_read_index = redo_read_ptr_ - &loop_[0];
+    state->redo_write_index = redo_write_ptr_
+        ? redo_write_ptr_ - &loop_[0]
+        : -1;
+    state->redo_write_history_index = redo_write_history_ptr_
+        ? redo_write_history_ptr_ - &history_[0]
+        : -1;
+    state->padding = 0;
+  }
+  
+  void RestoreState(const RandomSequenceState& state) {
+    // The state may come from a file: indices are wrapped back into range
+    // rather than trusted.
+    std::copy(&state.loop[0], &state.loop[kDejaVuBufferSize], &loop_[0]);
+    std::copy(
+        &state.history[0],
+        &state.history[kHistoryBufferSize],
+        &history_[0]);
+    loop_write_head_ = Wrap(state.loop_write_head, kDejaVuBufferSize);
+    length_ = state.length >= 1 && state.length <= kDejaVuBufferSize
+        ? state.length
+        : 8;
+    step_ = Wrap(state.step, length_);
+    record_head_ = Wrap(state.record_head, kHistoryBufferSize);
+    replay_head_ = state.replay_head < 0
+        ? -1
+        : Wrap(state.replay_head, kHistoryBufferSize);
+    replay_start_ = Wrap(state.replay_start, kHistoryBufferSize);
+    replay_hash_ = state.replay_hash;
+    replay_shift_ = state.replay_shift % kHistoryBufferSize;
+    redo_read_ptr_ = &loop_[Wrap(state.redo_read_index, kDejaVuBufferSize)];
+    redo_write_ptr_ = state.redo_write_index < 0
+        ? NULL
+        : &loop_[Wrap(state.redo_write_index, kDejaVuBufferSize)];
+    redo_write_history_ptr_ = state.redo_write_history_index < 0
+        ? NULL
+        : &history_[Wrap(state.redo_write_history_index, kHistoryBufferSize)];
+  }
+  
   inline float deja_vu() const {
     return deja_vu_;
   }
@@ -199,6 +268,10 @@ class RandomSequence {
   }
 
  private:
+  static inline int32_t Wrap(int32_t i, int32_t n) {
+    return ((i % n) + n) % n;
+  }
+  
   RandomStream* random_stream_;
   float loop_[kDejaVuBufferSize];
   float history_[kHistoryBufferSize];
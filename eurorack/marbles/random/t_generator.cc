@@ -97,33 +97,33 @@ Ratio TGenerator::input_divider_ratios[kNumInputDividerRatios] = {
 };
 
 /* static */
-uint8_t TGenerator::drum_patterns[kNumDrumPatterns][kDrumPatternSize] = {
-  { 1, 0, 0, 0, 2, 0, 0, 0 },
-  { 0, 0, 1, 0, 2, 0, 0, 0 },
+uint16_t TGenerator::drum_patterns[kNumDrumPatterns] = {
+  0x0201,  // 1, 0, 0, 0, 2, 0, 0, 0
+  0x0210,  // 0, 0, 1, 0, 2, 0, 0, 0
 
-  { 1, 0, 1, 0, 2, 0, 0, 0 },
-  { 0, 0, 1, 0, 2, 0, 0, 2 },
+  0x0211,  // 1, 0, 1, 0, 2, 0, 0, 0
+  0x8210,  // 0, 0, 1, 0, 2, 0, 0, 2
 
-  { 1, 0, 1, 0, 2, 0, 1, 0 },
-  { 0, 2, 1, 0, 2, 0, 0, 2 },
+  0x1211,  // 1, 0, 1, 0, 2, 0, 1, 0
+  0x8218,  // 0, 2, 1, 0, 2, 0, 0, 2
 
-  { 1, 0, 0, 0, 2, 0, 1, 0 },
-  { 0, 2, 1, 0, 2, 0, 1, 2 },
+  0x1201,  // 1, 0, 0, 0, 2, 0, 1, 0
+  0x9218,  // 0, 2, 1, 0, 2, 0, 1, 2
 
-  { 1, 0, 0, 1, 2, 0, 0, 0 },
-  { 0, 2, 1, 1, 2, 0, 1, 2 },
+  0x0241,  // 1, 0, 0, 1, 2, 0, 0, 0
+  0x9258,  // 0, 2, 1, 1, 2, 0, 1, 2
 
-  { 1, 0, 0, 1, 2, 0, 1, 0 },
-  { 0, 2, 1, 1, 2, 2, 1, 2 },
+  0x1241,  // 1, 0, 0, 1, 2, 0, 1, 0
+  0x9a58,  // 0, 2, 1, 1, 2, 2, 1, 2
 
-  { 1, 0, 0, 1, 2, 0, 1, 2 },
-  { 0, 2, 0, 1, 2, 0, 1, 2 },
+  0x9241,  // 1, 0, 0, 1, 2, 0, 1, 2
+  0x9248,  // 0, 2, 0, 1, 2, 0, 1, 2
 
-  { 1, 0, 1, 1, 2, 0, 1, 2 },
-  { 2, 0, 1, 2, 0, 1, 2, 0 },
+  0x9251,  // 1, 0, 1, 1, 2, 0, 1, 2
+  0x2492,  // 2, 0, 1, 2, 0, 1, 2, 0
 
-  { 1, 2, 1, 1, 2, 0, 1, 2 },
-  { 2, 0, 1, 2, 0, 1, 2, 2 }
+  0x9259,  // 1, 2, 1, 1, 2, 0, 1, 2
+  0xa492,  // 2, 0, 1, 2, 0, 1, 2, 2
 };
 
 void TGenerator::Init(RandomStream* random_stream, float sr) {
@@ -144,13 +144,11 @@ void TGenerator::Init(RandomStream* random_stream, float sr) {
 
   divider_pattern_length_ = 0;
   fill(&streak_counter_[0], &streak_counter_[kMarkovHistorySize], 0);
-  fill(&markov_history_[0], &markov_history_[kMarkovHistorySize], 0);
-  markov_history_ptr_ = 0;
+  markov_history_ = 0;
   drum_pattern_step_ = 0;
   drum_pattern_index_ = 0;
 
   sequence_.Init(random_stream);
-  ramp_divider_.Init();
   ramp_extractor_.Init(1000.0f / sr);
   ramp_generator_.Init();
   for (size_t i = 0; i < kNumTChannels; ++i) {
@@ -162,6 +160,47 @@ void TGenerator::Init(RandomStream* random_stream, float sr) {
   use_external_clock_ = false;
 }
 
+void TGenerator::SaveState(TGeneratorState* state) const {
+  sequence_.SaveState(&state->sequence);
+  state->master_phase = master_phase_;
+  state->jitter_multiplier = jitter_multiplier_;
+  state->phase_difference = phase_difference_;
+  state->divider_pattern_length = divider_pattern_length_;
+  copy(&streak_counter_[0], &streak_counter_[kMarkovHistorySize],
+       &state->streak_counter[0]);
+  // Saved as the ring buffer of the original implementation: slot
+  // (ptr + n) holds the tick from n ticks ago.
+  state->markov_history[0] = 0;
+  for (size_t n = 1; n < kMarkovHistorySize; ++n) {
+    state->markov_history[n] = markov_history(n);
+  }
+  state->markov_history_ptr = 0;
+  state->drum_pattern_step = drum_pattern_step_;
+  state->drum_pattern_index = drum_pattern_index_;
+}
+
+void TGenerator::RestoreState(const TGeneratorState& state) {
+  sequence_.RestoreState(state.sequence);
+  master_phase_ = state.master_phase;
+  CONSTRAIN(master_phase_, 0.0f, 1.0f);
+  jitter_multiplier_ = state.jitter_multiplier;
+  phase_difference_ = state.phase_difference;
+  divider_pattern_length_ = state.divider_pattern_length;
+  copy(&state.streak_counter[0], &state.streak_counter[kMarkovHistorySize],
+       &streak_counter_[0]);
+  markov_history_ = 0;
+  const uint32_t ptr = state.markov_history_ptr;
+  for (size_t n = 1; n < kMarkovHistorySize; ++n) {
+    uint32_t bitmask = state.markov_history[(ptr + n) % kMarkovHistorySize];
+    bitmask &= (1 << kNumTChannels) - 1;
+    markov_history_ |= bitmask << (kNumTChannels * (n - 1));
+  }
+  drum_pattern_step_ = static_cast<uint32_t>(state.drum_pattern_step) % \
+      kDrumPatternSize;
+  drum_pattern_index_ = static_cast<uint32_t>(state.drum_pattern_index) % \
+      kNumDrumPatterns;
+}
+
 int TGenerator::GenerateComplementaryBernoulli(const RandomVector& x) {
   int bitmask = 0;
   for (size_t i = 0; i < kNumTChannels; ++i) {
@@ -206,14 +245,13 @@ int TGenerator::GenerateDrums(const RandomVector& x) {
       drum_pattern_index_ -= drum_pattern_index_ % 2;
     }
   }
-  return drum_patterns[drum_pattern_index_][drum_pattern_step_];
+  return (drum_patterns[drum_pattern_index_] >> \
+      (kNumTChannels * drum_pattern_step_)) & ((1 << kNumTChannels) - 1);
 }
 
 int TGenerator::GenerateMarkov(const RandomVector& x) {
   int bitmask = 0;
   float b = 1.5f * bias_ - 0.5f;
-  markov_history_[markov_history_ptr_] = 0;
-  const int32_t p = markov_history_ptr_;
   for (size_t i = 0; i < kNumTChannels; ++i) {
     int32_t mask = 1 << i;
     // 4 rules:
@@ -222,10 +260,10 @@ int TGenerator::GenerateMarkov(const RandomVector& x) {
     // * We favor sparse patterns (no consecutive hits).
     // * We favor patterns in which one channel "echoes" what the other
     //   channel played 4 ticks before.
-    bool periodic = markov_history_[(p + 8) % kMarkovHistorySize] & mask;
-    bool simultaneous = markov_history_[(p + 8) % kMarkovHistorySize] & ~mask;
-    bool dense = markov_history_[(p + 1) % kMarkovHistorySize] & mask;
-    bool alternate = markov_history_[(p + 4) % kMarkovHistorySize] & ~mask;
+    bool periodic = markov_history(8) & mask;
+    bool simultaneous = markov_history(8) & ~mask;
+    bool dense = markov_history(1) & mask;
+    bool alternate = markov_history(4) & ~mask;
 
     float logit = -1.5f;
     logit += streak_counter_[i] > 24 ? 10.0f : 0.0f;
@@ -238,7 +276,7 @@ int TGenerator::GenerateMarkov(const RandomVector& x) {
     bool state = x.variables.u[i] < probability;
     
     if (sequence_.deja_vu() >= x.variables.p) {
-      state = markov_history_[(p + sequence_.length()) % kMarkovHistorySize] & mask;
+      state = markov_history(sequence_.length()) & mask;
     }
     if (state) {
       bitmask |= mask;
@@ -247,8 +285,8 @@ int TGenerator::GenerateMarkov(const RandomVector& x) {
       ++streak_counter_[i];
     }
   }
-  markov_history_[p] |= bitmask;
-  markov_history_ptr_ = (p + kMarkovHistorySize - 1) % kMarkovHistorySize;
+  markov_history_ = ((markov_history_ << kNumTChannels) | bitmask) & \
+      kMarkovHistoryMask;
   return bitmask;
 }
 
@@ -327,7 +365,8 @@ void TGenerator::Process(
     const GateFlags* external_clock,
     Ramps ramps,
     bool* gate,
-    size_t size) {
+    size_t size,
+    const float* external_clock_edge_offsets) {
   
   float internal_frequency;
   if (use_external_clock) {
@@ -345,7 +384,13 @@ void TGenerator::Process(
       ratio.p *= 4;
     }
     ratio.Simplify<2>();
-    ramp_extractor_.Process(ratio, true, external_clock, ramps.external, size);
+    ramp_extractor_.Process(
+        ratio,
+        true,
+        external_clock,
+        ramps.external,
+        size,
+        external_clock_edge_offsets);
     internal_frequency = 0.0f;
   } else {
     float rate = 2.0f;
@@ -61,6 +61,10 @@ enum TGeneratorRange {
 
 const size_t kNumTChannels = 2;
 const size_t kMarkovHistorySize = 16;
+// The Markov history is a shift register holding the bitmasks of the last
+// kMarkovHistorySize - 1 ticks, kNumTChannels bits per tick.
+const uint32_t kMarkovHistoryMask = (1 << \
+    (kNumTChannels * (kMarkovHistorySize - 1))) - 1;
 const size_t kNumDrumPatterns = 18;
 const size_t kDrumPatternSize = 8;
 
@@ -75,6 +79,22 @@ struct Ramps {
   float* slave[kNumTChannels];
 };
 
+// The random memory of a TGenerator. The clock trackers (ramp extractor,
+// dividers and slave ramps) are not part of it: they lock again to the
+// current clock within a few periods.
+struct TGeneratorState {
+  RandomSequenceState sequence;
+  float master_phase;
+  float jitter_multiplier;
+  float phase_difference;
+  int32_t divider_pattern_length;
+  int32_t streak_counter[kMarkovHistorySize];
+  int32_t markov_history[kMarkovHistorySize];
+  int32_t markov_history_ptr;
+  int32_t drum_pattern_step;
+  int32_t drum_pattern_index;
+};
+
 const size_t kNumDividerPatterns = 17;
 const size_t kNumInputDividerRatios = 9;
 
@@ -89,7 +109,11 @@ class TGenerator {
       const stmlib::GateFlags* external_clock,
       Ramps ramps,
       bool* gate,
-      size_t size);
+      size_t size,
+      const float* external_clock_edge_offsets = NULL);
+  
+  void SaveState(TGeneratorState* state) const;
+  void RestoreState(const TGeneratorState& state);
   
   inline void set_model(TGeneratorModel model) {
     model_ = model;
@@ -176,15 +200,19 @@ class TGenerator {
   
   bool use_external_clock_;
 
+  // Bitmask of the outputs active n ticks ago.
+  inline int32_t markov_history(size_t n) const {
+    return (markov_history_ >> (kNumTChannels * (n - 1))) & \
+        ((1 << kNumTChannels) - 1);
+  }
+  
   int32_t divider_pattern_length_;
   int32_t streak_counter_[kMarkovHistorySize];
-  int32_t markov_history_[kMarkovHistorySize];
-  int32_t markov_history_ptr_;
+  uint32_t markov_history_;
   size_t drum_pattern_step_;
   size_t drum_pattern_index_;
 
   RandomSequence sequence_;
-  RampDivider ramp_divider_;
   RampExtractor ramp_extractor_;
   RampGenerator ramp_generator_;
 
@@ -196,7 +224,8 @@ class TGenerator {
   static DividerPattern divider_patterns[kNumDividerPatterns];
   static DividerPattern fixed_divider_patterns[kNumDividerPatterns];
   static Ratio input_divider_ratios[kNumInputDividerRatios];
-  static uint8_t drum_patterns[kNumDrumPatterns][kDrumPatternSize];
+  // kNumTChannels bits per step, first step in the LSBs.
+  static uint16_t drum_patterns[kNumDrumPatterns];
   
   DISALLOW_COPY_AND_ASSIGN(TGenerator);
 };
@@ -42,13 +42,60 @@ void XYGenerator::Init(RandomStream* random_stream, float sr) {
     random_sequence_[i].Init(random_stream);
     output_channel_[i].Init();
   }
+  num_poly_x_channels_ = 0;
+  for (size_t i = 0; i < kMaxNumPolyXChannels; ++i) {
+    poly_x_channel_[i].Init();
+  }
+  num_y_groups_ = 1;
+  for (size_t i = 0; i < kMaxNumYGroups; ++i) {
+    GroupSettings& settings = y_group_settings_[i];
+    settings.control_mode = CONTROL_MODE_IDENTICAL;
+    settings.voltage_range = VOLTAGE_RANGE_FULL;
+    settings.register_mode = false;
+    settings.register_value = 0.0f;
+    settings.spread = 0.5f;
+    settings.bias = 0.5f;
+    settings.steps = 0.5f;
+    settings.deja_vu = 0.0f;
+    settings.scale_index = 0;
+    settings.length = 1;
+    settings.ratio.p = 1;
+    settings.ratio.q = 4;
+  }
+  for (size_t i = 0; i < kMaxNumYGroups - 1; ++i) {
+    y_group_sequence_[i].Init(random_stream);
+    y_group_channel_[i].Init();
+  }
+  y_ramp_divider_bank_.Init();
   ramp_extractor_.Init(8000.0f / sr);
-  ramp_divider_.Init();
+  lag_processor_bank_.Init();
+  poly_x_lag_processor_bank_.Init();
+  y_group_lag_processor_bank_.Init();
+  // The lanes of the lag processor banks which are not active on a sample
+  // still read these buffers.
+  fill(&lag_value_[0], &lag_value_[kMaxBlockSize * kMaxNumPolyXChannels], 0.0f);
+  fill(
+      &lag_smoothness_[0],
+      &lag_smoothness_[kMaxBlockSize * kMaxNumPolyXChannels],
+      0.0f);
+  fill(&lag_phase_[0], &lag_phase_[kMaxBlockSize * kMaxNumPolyXChannels], 0.0f);
+  fill(
+      &lag_warped_phase_[0],
+      &lag_warped_phase_[kMaxBlockSize * kMaxNumPolyXChannels],
+      0.0f);
+  fill(
+      &lag_frequency_ratio_[0],
+      &lag_frequency_ratio_[kMaxBlockSize * kMaxNumPolyXChannels],
+      0.0f);
+  fill(&lag_flags_[0], &lag_flags_[kMaxBlockSize * kMaxNumPolyXChannels], 0);
   external_clock_stabilization_counter_ = 16;
 }
 
-const uint32_t hashes[kNumXChannels] = {
-  0, 0xbeca55e5, 0xf0cacc1a
+const uint32_t hashes[kMaxNumPolyXChannels] = {
+  0, 0xbeca55e5, 0xf0cacc1a, 0x5eedf00d,
+  0xd15ea5e1, 0x0ddba11f, 0xa11ce5ed, 0xc0ffee11,
+  0x7e1e7a9e, 0xdeadbea7, 0x51de5a1e, 0xacce55ed,
+  0xfacade57, 0x0b5e55ed, 0x1337c0de, 0xbadcafe5
 };
 
 void XYGenerator::Process(
@@ -58,6 +105,54 @@ void XYGenerator::Process(
     const GateFlags* external_clock,
     const Ramps& ramps,
     float* output,
+    size_t size,
+    float* poly_x_output,
+    const float* external_clock_edge_offsets,
+    float* y_group_output) {
+  Ramps r = ramps;
+  while (size) {
+    size_t block_size = min(size, kMaxBlockSize);
+    ProcessBlock(
+        clock_source,
+        x_settings,
+        y_settings,
+        external_clock,
+        external_clock_edge_offsets,
+        r,
+        output,
+        poly_x_output,
+        y_group_output,
+        block_size);
+    external_clock += block_size;
+    if (external_clock_edge_offsets) {
+      external_clock_edge_offsets += block_size;
+    }
+    r.external += block_size;
+    r.master += block_size;
+    for (size_t i = 0; i < kNumTChannels; ++i) {
+      r.slave[i] += block_size;
+    }
+    output += block_size * kNumChannels;
+    if (poly_x_output) {
+      poly_x_output += block_size * kMaxNumPolyXChannels;
+    }
+    if (y_group_output) {
+      y_group_output += block_size * kMaxNumYGroups;
+    }
+    size -= block_size;
+  }
+}
+
+void XYGenerator::ProcessBlock(
+    ClockSource clock_source,
+    const GroupSettings& x_settings,
+    const GroupSettings& y_settings,
+    const GateFlags* external_clock,
+    const float* external_clock_edge_offsets,
+    const Ramps& ramps,
+    float* output,
+    float* poly_x_output,
+    float* y_group_output,
     size_t size) {
   float* channel_ramp[kNumChannels];
   
@@ -78,7 +173,13 @@ void XYGenerator::Process(
     case CLOCK_SOURCE_EXTERNAL:
       {
         Ratio r = { 1, 1 };
-        ramp_extractor_.Process(r, false, external_clock, ramps.slave[0], size);
+        ramp_extractor_.Process(
+            r,
+            false,
+            external_clock,
+            ramps.slave[0],
+            size,
+            external_clock_edge_offsets);
         if (external_clock_stabilization_counter_) {
           fill(&ramps.slave[0][0], &ramps.slave[0][size], 0.0f);
         }
@@ -113,46 +214,30 @@ void XYGenerator::Process(
       break;
   }
   
-  ramp_divider_.Process(y_settings.ratio, channel_ramp[1], ramps.external, size);
-  channel_ramp[kNumChannels - 1] = ramps.external;
+  Ratio y_ratio[kMaxNumYGroups];
+  y_ratio[0] = y_settings.ratio;
+  for (size_t i = 1; i < kMaxNumYGroups; ++i) {
+    y_ratio[i] = y_group_settings_[i].ratio;
+  }
+  y_ramp_divider_bank_.Process(
+      y_ratio,
+      channel_ramp[1],
+      y_ramp_,
+      kMaxBlockSize,
+      size);
+  channel_ramp[kNumChannels - 1] = y_ramp_;
   
   for (size_t i = 0; i < kNumChannels; ++i) {
     OutputChannel& channel = output_channel_[i];
     const GroupSettings& settings = i < kNumXChannels ? x_settings : y_settings;
     
-    switch (settings.voltage_range) {
-      case VOLTAGE_RANGE_NARROW:
-        channel.set_scale_offset(ScaleOffset(2.0f, 0.0f));
-        break;
-      
-      case VOLTAGE_RANGE_POSITIVE:
-        channel.set_scale_offset(ScaleOffset(5.0f, 0.0f));
-        break;
-      
-      case VOLTAGE_RANGE_FULL:
-        channel.set_scale_offset(ScaleOffset(10.0f, -5.0f));
-        break;
-      
-      default:
-        break;
-    }
-    
     float amount = 1.0f;
     if (settings.control_mode == CONTROL_MODE_BUMP) {
       amount = i == kNumXChannels / 2 ? 1.0f : -1.0f;
     } else if (settings.control_mode == CONTROL_MODE_TILT) {
       amount = 2.0f * static_cast<float>(i) / float(kNumXChannels - 1) - 1.0f;
     }
-    
-    channel.set_spread(0.5f + (settings.spread - 0.5f) * amount);
-    channel.set_bias(0.5f + (settings.bias - 0.5f) * amount);
-    channel.set_steps(0.5f + (settings.steps - 0.5f) * \
-        (settings.register_mode ? 1.0f : amount));
-    channel.set_scale_index(settings.scale_index);
-    channel.set_register_mode(settings.register_mode);
-    channel.set_register_value(settings.register_value);
-    channel.set_register_transposition(
-        4.0f * settings.spread * (settings.bias - 0.5f) * amount);
+    ConfigureChannel(&channel, settings, amount);
     
     RandomSequence* sequence = &random_sequence_[i];
     sequence->Record();
@@ -177,8 +262,169 @@ void XYGenerator::Process(
       }
     }
     
-    channel.Process(sequence, channel_ramp[i], &output[i], size, kNumChannels);
+    const LagRequest request = lag_request(i);
+    channel.Process(
+        sequence,
+        channel_ramp[i],
+        &output[i],
+        size,
+        kNumChannels,
+        &request);
+  }
+  lag_processor_bank_.Process(lag_request(0), output, size);
+  
+  if (poly_x_output && num_poly_x_channels_) {
+    ProcessPolyX(x_settings, channel_ramp[0], poly_x_output, size);
+  }
+  
+  if (y_group_output) {
+    ProcessYGroups(
+        &output[kNumChannels - 1],
+        y_group_output,
+        size);
+  }
+}
+
+void XYGenerator::ProcessPolyX(
+    const GroupSettings& x_settings,
+    const float* ramp,
+    float* output,
+    size_t size) {
+  // All the channels follow the clock of X1, and replay the values X1 has
+  // just drawn from its sequence. With 3 channels and a clock shared by
+  // X1/X2/X3, the bank outputs the same voltages as X1, X2 and X3.
+  const size_t num_channels = num_poly_x_channels_;
+  for (size_t i = 0; i < num_channels; ++i) {
+    const float position = num_channels > 1
+        ? 2.0f * static_cast<float>(i) / float(num_channels - 1) - 1.0f
+        : 0.0f;
+    float amount = 1.0f;
+    if (x_settings.control_mode == CONTROL_MODE_BUMP) {
+      amount = 1.0f - 2.0f * fabsf(position);
+    } else if (x_settings.control_mode == CONTROL_MODE_TILT) {
+      amount = position;
+    }
+    
+    OutputChannel& channel = poly_x_channel_[i];
+    ConfigureChannel(&channel, x_settings, amount);
+    
+    RandomSequence* sequence = &random_sequence_[0];
+    if (x_settings.register_mode) {
+      if (x_settings.control_mode == CONTROL_MODE_IDENTICAL) {
+        sequence->ReplayShifted(i);
+      } else if (x_settings.control_mode == CONTROL_MODE_BUMP) {
+        sequence->ReplayShifted(i / 2);
+      } else {
+        sequence->ReplayShifted(0);
+      }
+    } else {
+      sequence->ReplayPseudoRandom(hashes[i]);
+    }
+    
+    const LagRequest request = lag_request(i);
+    channel.Process(
+        sequence,
+        ramp,
+        &output[i],
+        size,
+        kMaxNumPolyXChannels,
+        &request);
+  }
+  
+  // The unused lanes are computed too, but as they are not active, their
+  // state and their output are left untouched.
+  for (size_t i = num_channels; i < kMaxNumPolyXChannels; ++i) {
+    for (size_t j = 0; j < size; ++j) {
+      lag_flags_[j * kMaxNumPolyXChannels + i] = 0;
+    }
+  }
+  poly_x_lag_processor_bank_.Process(lag_request(0), output, size);
+}
+
+void XYGenerator::ProcessYGroups(
+    const float* y_output,
+    float* output,
+    size_t size) {
+  const size_t num_groups = num_y_groups_;
+  for (size_t i = 1; i < num_groups; ++i) {
+    const GroupSettings& settings = y_group_settings_[i];
+    OutputChannel& channel = y_group_channel_[i - 1];
+    ConfigureChannel(&channel, settings, 1.0f);
+    
+    RandomSequence* sequence = &y_group_sequence_[i - 1];
+    sequence->Record();
+    sequence->set_length(settings.length);
+    sequence->set_deja_vu(settings.deja_vu);
+    
+    const LagRequest request = lag_request(i);
+    channel.Process(
+        sequence,
+        &y_ramp_[i * kMaxBlockSize],
+        &output[i],
+        size,
+        kMaxNumYGroups,
+        &request);
+  }
+  
+  // Lane 0 is Y, which has already been smoothed. The unused lanes are
+  // computed too, but as they are not active, their state and their output
+  // are left untouched.
+  for (size_t j = 0; j < size; ++j) {
+    lag_flags_[j * kMaxNumYGroups] = 0;
   }
+  for (size_t i = num_groups; i < kMaxNumYGroups; ++i) {
+    for (size_t j = 0; j < size; ++j) {
+      lag_flags_[j * kMaxNumYGroups + i] = 0;
+    }
+  }
+  y_group_lag_processor_bank_.Process(lag_request(0), output, size);
+  
+  for (size_t j = 0; j < size; ++j) {
+    output[j * kMaxNumYGroups] = y_output[j * kNumChannels];
+  }
+}
+
+void XYGenerator::ConfigureChannel(
+    OutputChannel* channel,
+    const GroupSettings& settings,
+    float amount) {
+  switch (settings.voltage_range) {
+    case VOLTAGE_RANGE_NARROW:
+      channel->set_scale_offset(ScaleOffset(2.0f, 0.0f));
+      break;
+    
+    case VOLTAGE_RANGE_POSITIVE:
+      channel->set_scale_offset(ScaleOffset(5.0f, 0.0f));
+      break;
+    
+    case VOLTAGE_RANGE_FULL:
+      channel->set_scale_offset(ScaleOffset(10.0f, -5.0f));
+      break;
+    
+    default:
+      break;
+  }
+  
+  channel->set_spread(0.5f + (settings.spread - 0.5f) * amount);
+  channel->set_bias(0.5f + (settings.bias - 0.5f) * amount);
+  channel->set_steps(0.5f + (settings.steps - 0.5f) * \
+      (settings.register_mode ? 1.0f : amount));
+  channel->set_scale_index(settings.scale_index);
+  channel->set_register_mode(settings.register_mode);
+  channel->set_register_value(settings.register_value);
+  channel->set_register_transposition(
+      4.0f * settings.spread * (settings.bias - 0.5f) * amount);
+}
+
+LagRequest XYGenerator::lag_request(size_t channel) {
+  LagRequest request;
+  request.value = &lag_value_[channel];
+  request.smoothness = &lag_smoothness_[channel];
+  request.phase = &lag_phase_[channel];
+  request.warped_phase = &lag_warped_phase_[channel];
+  request.frequency_ratio = &lag_frequency_ratio_[channel];
+  request.flags = &lag_flags_[channel];
+  return request;
 }
 
 }  // namespace marbles
\ No newline at end of file
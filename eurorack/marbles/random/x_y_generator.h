@@ -31,6 +31,8 @@
 
 #include "stmlib/stmlib.h"
 
+#include <algorithm>
+
 #include "marbles/ramp/ramp_divider.h"
 #include "marbles/ramp/ramp_extractor.h"
 #include "marbles/random/output_channel.h"
@@ -68,6 +70,15 @@ enum OutputGroup {
 const size_t kNumXChannels = 3;
 const size_t kNumYChannels = 1;
 const size_t kNumChannels = kNumXChannels + kNumYChannels;
+// Longer blocks are processed in several parts.
+const size_t kMaxBlockSize = 32;
+// The polyphonic X bank replays the loop of X1, with a different hash (or
+// shift, in register mode) for each of its channels.
+const size_t kMaxNumPolyXChannels = 16;
+// Y is the first of up to kMaxNumYGroups groups of one channel. The other
+// groups have their own settings, loop and clock divider, and divide the
+// same clock as Y.
+const size_t kMaxNumYGroups = 8;
 
 struct GroupSettings {
   ControlMode control_mode;
@@ -83,6 +94,25 @@ struct GroupSettings {
   Ratio ratio;
 };
 
+// The random memory of a Y group beyond Y.
+struct YGroupState {
+  RandomSequenceState sequence;
+  OutputChannelState output_channel;
+  RampDividerState ramp_divider;
+};
+
+// The random memory of an XYGenerator: the loops of the 4 channels and of the
+// other Y groups, the values they currently hold, and the position of the Y
+// groups in their divided clock (they draw from the same random stream as X,
+// so their ticks must fall at the same time for X to replay identically).
+struct XYGeneratorState {
+  RandomSequenceState sequence[kNumChannels];
+  OutputChannelState output_channel[kNumChannels];
+  RampDividerState ramp_divider;
+  // Y groups 1 to kMaxNumYGroups - 1.
+  YGroupState y_group[kMaxNumYGroups - 1];
+};
+
 class XYGenerator {
  public:
   XYGenerator() { }
@@ -96,7 +126,70 @@ class XYGenerator {
       const stmlib::GateFlags* external_clock,
       const Ramps& ramps,
       float* output,
-      size_t size);
+      size_t size,
+      float* poly_x_output = NULL,
+      const float* external_clock_edge_offsets = NULL,
+      float* y_group_output = NULL);
+  
+  // external_clock_edge_offsets, when given, holds the sub-sample timing of
+  // the edges of external_clock (see RampExtractor::Process).
+  //
+  // When poly_x_output is given to Process, it receives the
+  // num_poly_x_channels outputs of the polyphonic X bank, with a stride of
+  // kMaxNumPolyXChannels.
+  void set_num_poly_x_channels(size_t num_poly_x_channels) {
+    num_poly_x_channels = std::min(num_poly_x_channels, kMaxNumPolyXChannels);
+    // The channels which are enabled again do not glide from the value they
+    // held when they were disabled.
+    for (size_t i = num_poly_x_channels_; i < num_poly_x_channels; ++i) {
+      poly_x_lag_processor_bank_.Reset(i);
+    }
+    num_poly_x_channels_ = num_poly_x_channels;
+  }
+  
+  // When y_group_output is given to Process, it receives the num_y_groups
+  // outputs of the Y groups, with a stride of kMaxNumYGroups. Group 0 is Y,
+  // and is set by the y_settings argument of Process. The settings of the
+  // other groups are kept until they are changed.
+  void set_num_y_groups(size_t num_y_groups) {
+    num_y_groups = std::max(std::min(num_y_groups, kMaxNumYGroups), size_t(1));
+    // As for the polyphonic X bank.
+    for (size_t i = num_y_groups_; i < num_y_groups; ++i) {
+      y_group_lag_processor_bank_.Reset(i);
+    }
+    num_y_groups_ = num_y_groups;
+  }
+  
+  void set_y_group_settings(size_t group, const GroupSettings& settings) {
+    y_group_settings_[group] = settings;
+  }
+  
+  void SaveState(XYGeneratorState* state) const {
+    for (size_t i = 0; i < kNumChannels; ++i) {
+      random_sequence_[i].SaveState(&state->sequence[i]);
+      output_channel_[i].SaveState(&state->output_channel[i]);
+    }
+    y_ramp_divider_bank_.SaveState(0, &state->ramp_divider);
+    for (size_t i = 0; i < kMaxNumYGroups - 1; ++i) {
+      y_group_sequence_[i].SaveState(&state->y_group[i].sequence);
+      y_group_channel_[i].SaveState(&state->y_group[i].output_channel);
+      y_ramp_divider_bank_.SaveState(i + 1, &state->y_group[i].ramp_divider);
+    }
+  }
+  
+  void RestoreState(const XYGeneratorState& state) {
+    for (size_t i = 0; i < kNumChannels; ++i) {
+      random_sequence_[i].RestoreState(state.sequence[i]);
+      output_channel_[i].RestoreState(state.output_channel[i]);
+    }
+    for (size_t i = 0; i < kMaxNumYGroups - 1; ++i) {
+      y_group_sequence_[i].RestoreState(state.y_group[i].sequence);
+      y_group_channel_[i].RestoreState(state.y_group[i].output_channel);
+      y_ramp_divider_bank_.RestoreState(i + 1, state.y_group[i].ramp_divider);
+    }
+    // Last, as the phase of the clock of Y is the one to keep.
+    y_ramp_divider_bank_.RestoreState(0, state.ramp_divider);
+  }
   
   void LoadScale(int channel, int scale_index, const Scale& scale) {
     output_channel_[channel].LoadScale(scale_index, scale);
@@ -105,13 +198,84 @@ class XYGenerator {
     for (size_t i = 0; i < kNumXChannels; ++i) {
       output_channel_[i].LoadScale(scale_index, scale);
     }
+    for (size_t i = 0; i < kMaxNumPolyXChannels; ++i) {
+      poly_x_channel_[i].LoadScale(scale_index, scale);
+    }
+    for (size_t i = 0; i < kMaxNumYGroups - 1; ++i) {
+      y_group_channel_[i].LoadScale(scale_index, scale);
+    }
+  }
+  void LoadScale(int scale_index, const QuantizerTable* table) {
+    for (size_t i = 0; i < kNumXChannels; ++i) {
+      output_channel_[i].LoadScale(scale_index, table);
+    }
+    for (size_t i = 0; i < kMaxNumPolyXChannels; ++i) {
+      poly_x_channel_[i].LoadScale(scale_index, table);
+    }
+    for (size_t i = 0; i < kMaxNumYGroups - 1; ++i) {
+      y_group_channel_[i].LoadScale(scale_index, table);
+    }
   }
   
  private:
+  void ProcessBlock(
+      ClockSource clock_source,
+      const GroupSettings& x_settings,
+      const GroupSettings& y_settings,
+      const stmlib::GateFlags* external_clock,
+      const float* external_clock_edge_offsets,
+      const Ramps& ramps,
+      float* output,
+      float* poly_x_output,
+      float* y_group_output,
+      size_t size);
+  void ProcessPolyX(
+      const GroupSettings& x_settings,
+      const float* ramp,
+      float* output,
+      size_t size);
+  void ProcessYGroups(
+      const float* y_output,
+      float* output,
+      size_t size);
+  void ConfigureChannel(
+      OutputChannel* channel,
+      const GroupSettings& settings,
+      float amount);
+  LagRequest lag_request(size_t channel);
+  
   RandomSequence random_sequence_[kNumChannels];
   OutputChannel output_channel_[kNumChannels];
+  
+  size_t num_poly_x_channels_;
+  OutputChannel poly_x_channel_[kMaxNumPolyXChannels];
+  
+  // Y groups 1 to kMaxNumYGroups - 1. The settings of group 0 are not used.
+  size_t num_y_groups_;
+  GroupSettings y_group_settings_[kMaxNumYGroups];
+  RandomSequence y_group_sequence_[kMaxNumYGroups - 1];
+  OutputChannel y_group_channel_[kMaxNumYGroups - 1];
+  
+  // The ramps of all the Y groups, Y included, are divided together from the
+  // clock of X2, and stored one group after the other.
+  RampDividerBank<kMaxNumYGroups> y_ramp_divider_bank_;
+  float y_ramp_[kMaxBlockSize * kMaxNumYGroups];
+  
+  // The channels write the inputs of their lag processor here, and the
+  // smoothing of all the channels of a group is done together, by a
+  // LagProcessorBank. The buffers are shared by the X/Y channels, the
+  // polyphonic X bank and the Y groups, which are processed one after the
+  // other.
+  LagProcessorBank<kNumChannels> lag_processor_bank_;
+  LagProcessorBank<kMaxNumPolyXChannels> poly_x_lag_processor_bank_;
+  LagProcessorBank<kMaxNumYGroups> y_group_lag_processor_bank_;
+  float lag_value_[kMaxBlockSize * kMaxNumPolyXChannels];
+  float lag_smoothness_[kMaxBlockSize * kMaxNumPolyXChannels];
+  float lag_phase_[kMaxBlockSize * kMaxNumPolyXChannels];
+  float lag_warped_phase_[kMaxBlockSize * kMaxNumPolyXChannels];
+  float lag_frequency_ratio_[kMaxBlockSize * kMaxNumPolyXChannels];
+  uint32_t lag_flags_[kMaxBlockSize * kMaxNumPolyXChannels];
   RampExtractor ramp_extractor_;
-  RampDivider ramp_divider_;
   
   int external_clock_stabilization_counter_;
   
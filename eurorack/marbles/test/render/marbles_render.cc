@@ -0,0 +1,548 @@
+// Copyright 2026 Poly_AudibleInstruments contributors.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// Offline rendering of the T and X/Y generators, as fast as the CPU allows.
+//
+// Usage: marbles_render [options] [name=value ...]
+//
+//   -s seed      seed of the random generator (default 1)
+//   -d seconds   duration (default 60)
+//   -r rate      sample rate (default 48000)
+//   -b size      block size, from 1 to 32 (default 8)
+//   -a file      parameter automation
+//   -t file      external clock of t
+//   -x file      external clock of X and Y
+//   -f format    csv or raw (default csv)
+//   -e n         write one frame every n samples (default 1)
+//   -o file      output file (default: standard output)
+//
+// Parameters are the positions of the controls of the module, and are listed
+// with -h. name=value sets the value of a parameter at the start. Each line
+// of an automation file is "time name value", with the time in seconds, and
+// sets a parameter at the start of the first block at or after this time.
+//
+// Each line of a clock file is the time, in seconds, of a rising edge. The
+// clock stays high for half of the time to the next edge. Edges are passed
+// to the generators with their sub-sample timing.
+//
+// A frame holds the voltages of the outputs: T1, T2, T3, X1, X2, X3 and Y.
+// csv writes one line per frame, starting with the index of the sample. raw
+// writes frames of 7 native endian 32-bit floats. Unlike in the module,
+// outputs are not delayed by one block. The same seed, settings and files
+// always render the same sequence.
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "stmlib/utils/gate_flags.h"
+
+#include "marbles/ramp/ramp_extractor.h"
+#include "marbles/random/random_generator.h"
+#include "marbles/random/random_stream.h"
+#include "marbles/random/t_generator.h"
+#include "marbles/random/x_y_generator.h"
+
+#include "MarblesPresets.hpp"
+
+using namespace marbles;
+using namespace std;
+using namespace stmlib;
+
+const size_t kNumOutputs = 7;
+
+// Positions of the controls. Switches are the index of their setting.
+struct Parameters {
+  float t_mode;
+  float t_range;
+  float t_rate;
+  float t_bias;
+  float t_jitter;
+  float t_deja_vu;
+  float gate_length;
+  float gate_length_std;
+  float deja_vu;
+  float deja_vu_length;
+  float x_mode;
+  float x_range;
+  float x_spread;
+  float x_bias;
+  float x_steps;
+  float x_deja_vu;
+  float x_scale;
+  float x_clock_source;
+  float y_divider;
+};
+
+struct ParameterDefinition {
+  const char* name;
+  size_t offset;
+  float min;
+  float max;
+  float default_value;
+  const char* help;
+};
+
+#define PARAMETER(name, min, max, default_value, help) \
+  { #name, offsetof(Parameters, name), min, max, default_value, help }
+
+const ParameterDefinition kParameterDefinitions[] = {
+  PARAMETER(t_mode, 0.0f, 6.0f, 0.0f, "t model, 0 to 6"),
+  PARAMETER(t_range, 0.0f, 2.0f, 1.0f, "t range: 1/4x, 1x, 4x"),
+  PARAMETER(t_rate, -1.0f, 1.0f, 0.0f, "t rate"),
+  PARAMETER(t_bias, 0.0f, 1.0f, 0.5f, "t bias"),
+  PARAMETER(t_jitter, 0.0f, 1.0f, 0.0f, "t jitter"),
+  PARAMETER(t_deja_vu, 0.0f, 1.0f, 0.0f, "deja vu on t, 0 or 1"),
+  PARAMETER(gate_length, 0.0f, 1.0f, 0.5f, "gate length"),
+  PARAMETER(gate_length_std, 0.0f, 1.0f, 0.0f, "gate length randomization"),
+  PARAMETER(deja_vu, 0.0f, 1.0f, 0.5f, "deja vu probability"),
+  PARAMETER(deja_vu_length, 0.0f, 1.0f, 0.0f, "loop length"),
+  PARAMETER(x_mode, 0.0f, 2.0f, 0.0f, "X control mode"),
+  PARAMETER(x_range, 0.0f, 2.0f, 1.0f, "X range: 0-2V, 0-5V, +/-5V"),
+  PARAMETER(x_spread, 0.0f, 1.0f, 0.5f, "X spread"),
+  PARAMETER(x_bias, 0.0f, 1.0f, 0.5f, "X bias"),
+  PARAMETER(x_steps, 0.0f, 1.0f, 0.5f, "X steps"),
+  PARAMETER(x_deja_vu, 0.0f, 1.0f, 0.0f, "deja vu on X, 0 or 1"),
+  PARAMETER(x_scale, 0.0f, 6.0f, 0.0f, "X scale, 0 to 5, 6 is the user slot"),
+  PARAMETER(x_clock_source, 0.0f, 3.0f, 0.0f, "internal clock of X, 0 to 3"),
+  PARAMETER(y_divider, 0.0f, 11.0f, 8.0f, "Y divider, 0 (1/64) to 11 (1/1)"),
+};
+
+#undef PARAMETER
+
+const size_t kNumParameters = \
+    sizeof(kParameterDefinitions) / sizeof(ParameterDefinition);
+
+const ParameterDefinition* FindParameter(const char* name) {
+  for (size_t i = 0; i < kNumParameters; ++i) {
+    if (!strcmp(kParameterDefinitions[i].name, name)) {
+      return &kParameterDefinitions[i];
+    }
+  }
+  return NULL;
+}
+
+void SetParameter(
+    Parameters* parameters,
+    const ParameterDefinition& definition,
+    float value) {
+  float* p = reinterpret_cast<float*>(
+      reinterpret_cast<char*>(parameters) + definition.offset);
+  *p = max(min(value, definition.max), definition.min);
+}
+
+struct AutomationEvent {
+  size_t sample;
+  const ParameterDefinition* parameter;
+  float value;
+
+  bool operator<(const AutomationEvent& other) const {
+    return sample < other.sample;
+  }
+};
+
+bool LoadAutomation(
+    const char* file_name,
+    float sample_rate,
+    vector<AutomationEvent>* events) {
+  FILE* fp = fopen(file_name, "r");
+  if (!fp) {
+    fprintf(stderr, "Cannot open %s\n", file_name);
+    return false;
+  }
+  char line[256];
+  size_t line_number = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), fp)) {
+    ++line_number;
+    char name[64];
+    double time;
+    float value;
+    char* comment = strchr(line, '#');
+    if (comment) {
+      *comment = '\0';
+    }
+    if (strspn(line, " \t\r\n") == strlen(line)) {
+      continue;
+    }
+    AutomationEvent e;
+    if (sscanf(line, "%lf %63s %f", &time, name, &value) != 3 || time < 0.0) {
+      fprintf(stderr, "%s:%zu: syntax error\n", file_name, line_number);
+      ok = false;
+    } else if (!(e.parameter = FindParameter(name))) {
+      fprintf(stderr, "%s:%zu: unknown parameter %s\n",
+              file_name, line_number, name);
+      ok = false;
+    } else {
+      e.sample = static_cast<size_t>(ceil(time * sample_rate));
+      e.value = value;
+      events->push_back(e);
+    }
+  }
+  fclose(fp);
+  // Events at the same time are applied in the order of the file.
+  stable_sort(events->begin(), events->end());
+  return ok;
+}
+
+// A clock given by the times of its rising edges.
+class Clock {
+ public:
+  Clock() : index_(0), gate_(false), flags_(GATE_FLAG_LOW) { }
+  ~Clock() { }
+
+  bool Load(const char* file_name, float sample_rate) {
+    FILE* fp = fopen(file_name, "r");
+    if (!fp) {
+      fprintf(stderr, "Cannot open %s\n", file_name);
+      return false;
+    }
+    double time;
+    while (fscanf(fp, "%lf", &time) == 1) {
+      double sample = time * sample_rate;
+      if (!rising_edges_.empty() && sample <= rising_edges_.back()) {
+        fprintf(stderr, "%s: edges must be in increasing order\n", file_name);
+        fclose(fp);
+        return false;
+      }
+      rising_edges_.push_back(sample);
+    }
+    fclose(fp);
+    index_ = 0;
+    gate_ = false;
+    flags_ = GATE_FLAG_LOW;
+    return true;
+  }
+
+  // State of the clock at sample n. n increases by one on each call.
+  // edge_offset is the time elapsed since the last transition, when there
+  // is one between samples n - 1 and n. As in the module, it is within
+  // (0, 1]: a transition on sample n itself is one sample old.
+  GateFlags Process(size_t n, float* edge_offset) {
+    const double t = static_cast<double>(n);
+    while (index_ + 1 < rising_edges_.size() && rising_edges_[index_ + 1] <= t) {
+      ++index_;
+    }
+    bool gate = false;
+    double transition = 0.0;
+    if (index_ < rising_edges_.size() && rising_edges_[index_] <= t) {
+      const double rise = rising_edges_[index_];
+      const double fall = rise + 0.5 * period(index_);
+      gate = t < fall;
+      transition = gate ? rise : fall;
+    }
+    const double elapsed = t - transition;
+    *edge_offset = gate != gate_ && elapsed > 0.0
+        ? static_cast<float>(min(elapsed, 1.0))
+        : 1.0f;
+    gate_ = gate;
+    flags_ = ExtractGateFlags(flags_, gate);
+    return flags_;
+  }
+
+ private:
+  // Time to the next edge, or from the previous one for the last edge.
+  double period(size_t i) const {
+    if (i + 1 < rising_edges_.size()) {
+      return rising_edges_[i + 1] - rising_edges_[i];
+    } else if (i > 0) {
+      return rising_edges_[i] - rising_edges_[i - 1];
+    } else {
+      return 2.0;
+    }
+  }
+
+  vector<double> rising_edges_;
+  size_t index_;
+  bool gate_;
+  GateFlags flags_;
+
+  DISALLOW_COPY_AND_ASSIGN(Clock);
+};
+
+// Fixed point with 4 decimals: a lot faster than printf, and as precise as
+// any DAC.
+char* FormatVoltage(float v, char* p) {
+  long n = lrintf(v * 10000.0f);
+  if (n < 0) {
+    *p++ = '-';
+    n = -n;
+  }
+  char digits[16];
+  size_t num_digits = 0;
+  do {
+    digits[num_digits++] = '0' + n % 10;
+    n /= 10;
+  } while (n || num_digits < 5);
+  while (num_digits > 4) {
+    *p++ = digits[--num_digits];
+  }
+  *p++ = '.';
+  while (num_digits) {
+    *p++ = digits[--num_digits];
+  }
+  return p;
+}
+
+void Usage() {
+  fprintf(
+      stderr,
+      "Usage: marbles_render [-s seed] [-d seconds] [-r rate] [-b size]\n"
+      "                      [-a automation] [-t t_clock] [-x x_clock]\n"
+      "                      [-f csv|raw] [-e n] [-o file] [name=value ...]\n"
+      "\nParameters:\n");
+  for (size_t i = 0; i < kNumParameters; ++i) {
+    const ParameterDefinition& p = kParameterDefinitions[i];
+    fprintf(stderr, "  %-18s %-32s default %g\n",
+            p.name, p.help, p.default_value);
+  }
+}
+
+int main(int argc, char** argv) {
+  uint32_t seed = 1;
+  double duration = 60.0;
+  float sample_rate = 48000.0f;
+  size_t block_size = 8;
+  const char* automation_file = NULL;
+  const char* t_clock_file = NULL;
+  const char* x_clock_file = NULL;
+  bool raw = false;
+  size_t decimation = 1;
+  const char* output_file = NULL;
+
+  int option;
+  while ((option = getopt(argc, argv, "s:d:r:b:a:t:x:f:e:o:h")) != -1) {
+    switch (option) {
+      case 's': seed = strtoul(optarg, NULL, 0); break;
+      case 'd': duration = atof(optarg); break;
+      case 'r': sample_rate = atof(optarg); break;
+      case 'b': block_size = atoi(optarg); break;
+      case 'a': automation_file = optarg; break;
+      case 't': t_clock_file = optarg; break;
+      case 'x': x_clock_file = optarg; break;
+      case 'f': raw = !strcmp(optarg, "raw"); break;
+      case 'e': decimation = atoi(optarg); break;
+      case 'o': output_file = optarg; break;
+      default: Usage(); return 1;
+    }
+  }
+  if (block_size < 1 || block_size > kMaxBlockSize || decimation < 1 || \
+      sample_rate <= 0.0f || duration < 0.0) {
+    Usage();
+    return 1;
+  }
+
+  Parameters parameters;
+  for (size_t i = 0; i < kNumParameters; ++i) {
+    SetParameter(
+        &parameters,
+        kParameterDefinitions[i],
+        kParameterDefinitions[i].default_value);
+  }
+  for (int i = optind; i < argc; ++i) {
+    char* separator = strchr(argv[i], '=');
+    if (separator) {
+      *separator = '\0';
+    }
+    const ParameterDefinition* definition = FindParameter(argv[i]);
+    if (!separator || !definition) {
+      fprintf(stderr, "Unknown parameter %s\n", argv[i]);
+      return 1;
+    }
+    SetParameter(&parameters, *definition, atof(separator + 1));
+  }
+
+  vector<AutomationEvent> events;
+  if (automation_file && \
+      !LoadAutomation(automation_file, sample_rate, &events)) {
+    return 1;
+  }
+  Clock t_clock;
+  Clock x_clock;
+  if ((t_clock_file && !t_clock.Load(t_clock_file, sample_rate)) || \
+      (x_clock_file && !x_clock.Load(x_clock_file, sample_rate))) {
+    return 1;
+  }
+
+  FILE* fp = output_file ? fopen(output_file, raw ? "wb" : "w") : stdout;
+  if (!fp) {
+    fprintf(stderr, "Cannot open %s\n", output_file);
+    return 1;
+  }
+  static char buffer[1 << 16];
+  setvbuf(fp, buffer, _IOFBF, sizeof(buffer));
+  if (!raw) {
+    fprintf(fp, "sample,t1,t2,t3,x1,x2,x3,y\n");
+  }
+
+  RandomGenerator random_generator;
+  RandomStream random_stream;
+  random_generator.Init(seed);
+  random_stream.Init(&random_generator);
+
+  TGenerator t_generator;
+  XYGenerator xy_generator;
+  t_generator.Init(&random_stream, sample_rate);
+  xy_generator.Init(&random_stream, sample_rate);
+  for (int i = 0; i < kNumScaleSlots; ++i) {
+    xy_generator.LoadScale(i, preset_scales[i < NUM_PRESET_SCALES ? i : 0]);
+  }
+
+  float external[kMaxBlockSize];
+  float master[kMaxBlockSize];
+  float slave[kNumTChannels][kMaxBlockSize];
+  Ramps ramps;
+  ramps.external = external;
+  ramps.master = master;
+  ramps.slave[0] = slave[0];
+  ramps.slave[1] = slave[1];
+
+  GateFlags t_clock_flags[kMaxBlockSize];
+  GateFlags x_clock_flags[kMaxBlockSize];
+  float t_clock_edge_offsets[kMaxBlockSize];
+  float x_clock_edge_offsets[kMaxBlockSize];
+  bool gate[kMaxBlockSize * kNumTChannels];
+  float voltages[kMaxBlockSize * kNumChannels];
+
+  const size_t num_samples = static_cast<size_t>(duration * sample_rate);
+  size_t next_event = 0;
+
+  clock_t start = clock();
+  for (size_t n = 0; n < num_samples; n += block_size) {
+    const size_t size = min(block_size, num_samples - n);
+
+    while (next_event < events.size() && events[next_event].sample <= n) {
+      const AutomationEvent& e = events[next_event++];
+      SetParameter(&parameters, *e.parameter, e.value);
+    }
+
+    for (size_t i = 0; i < size; ++i) {
+      t_clock_flags[i] = t_clock.Process(n + i, &t_clock_edge_offsets[i]);
+      x_clock_flags[i] = x_clock.Process(n + i, &x_clock_edge_offsets[i]);
+    }
+
+    // Same mapping of the controls as in the module.
+    static const int loop_length[] = {
+      1, 1, 1, 2, 2,
+      2, 2, 2, 3, 3,
+      3, 3, 4, 4, 4,
+      4, 4, 5, 5, 6,
+      6, 6, 7, 7, 8,
+      8, 8, 10, 10, 12,
+      12, 12, 14, 14, 16,
+      16
+    };
+    const size_t num_lengths = sizeof(loop_length) / sizeof(int);
+    const int length = loop_length[static_cast<int>(
+        roundf(parameters.deja_vu_length * (num_lengths - 1)))];
+    const float deja_vu = parameters.deja_vu;
+
+    t_generator.set_model(TGeneratorModel(int(parameters.t_mode)));
+    t_generator.set_range(TGeneratorRange(int(parameters.t_range)));
+    t_generator.set_rate(60.0f * parameters.t_rate);
+    t_generator.set_bias(parameters.t_bias);
+    t_generator.set_jitter(parameters.t_jitter);
+    t_generator.set_deja_vu(parameters.t_deja_vu >= 0.5f ? deja_vu : 0.0f);
+    t_generator.set_length(length);
+    t_generator.set_pulse_width_mean(parameters.gate_length);
+    t_generator.set_pulse_width_std(parameters.gate_length_std);
+    t_generator.Process(
+        t_clock_file != NULL,
+        t_clock_flags,
+        ramps,
+        gate,
+        size,
+        t_clock_edge_offsets);
+
+    GroupSettings x;
+    x.control_mode = ControlMode(int(parameters.x_mode));
+    x.voltage_range = VoltageRange(int(parameters.x_range));
+    x.register_mode = false;
+    x.register_value = 0.0f;
+    x.spread = parameters.x_spread;
+    x.bias = parameters.x_bias;
+    x.steps = parameters.x_steps;
+    x.deja_vu = parameters.x_deja_vu >= 0.5f ? deja_vu : 0.0f;
+    x.length = length;
+    x.ratio.p = 1;
+    x.ratio.q = 1;
+    x.scale_index = int(parameters.x_scale);
+
+    GroupSettings y = x;
+    y.control_mode = CONTROL_MODE_IDENTICAL;
+    y.deja_vu = 0.0f;
+    y.length = 1;
+    y.ratio = y_divider_ratios[int(parameters.y_divider)];
+
+    xy_generator.Process(
+        x_clock_file
+            ? CLOCK_SOURCE_EXTERNAL
+            : ClockSource(int(parameters.x_clock_source)),
+        x,
+        y,
+        x_clock_flags,
+        ramps,
+        voltages,
+        size,
+        NULL,
+        x_clock_edge_offsets);
+
+    for (size_t i = 0; i < size; ++i) {
+      if ((n + i) % decimation) {
+        continue;
+      }
+      float frame[kNumOutputs];
+      frame[0] = gate[i * kNumTChannels] ? 10.0f : 0.0f;
+      frame[1] = master[i] < 0.5f ? 10.0f : 0.0f;
+      frame[2] = gate[i * kNumTChannels + 1] ? 10.0f : 0.0f;
+      copy(&voltages[i * kNumChannels], &voltages[(i + 1) * kNumChannels],
+           &frame[3]);
+      if (raw) {
+        fwrite(frame, sizeof(float), kNumOutputs, fp);
+      } else {
+        char line[256];
+        char* p = line + sprintf(line, "%zu", n + i);
+        for (size_t j = 0; j < kNumOutputs; ++j) {
+          *p++ = ',';
+          p = FormatVoltage(frame[j], p);
+        }
+        *p++ = '\n';
+        fwrite(line, 1, p - line, fp);
+      }
+    }
+  }
+  double seconds = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+
+  if (fp != stdout) {
+    fclose(fp);
+  } else {
+    fflush(fp);
+  }
+  fprintf(
+      stderr,
+      "%zu samples in %.2f s (%.0fx realtime)\n",
+      num_samples,
+      seconds,
+      num_samples / sample_rate / max(seconds, 1e-6));
+  return 0;
+}
@@ -0,0 +1,1182 @@
+// Copyright 2026 Poly_AudibleInstruments contributors.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// Statistical validation and throughput of the T and X/Y generators, and
+// checks of their state restore and polyphonic X bank.
+//
+// Unlike marbles_test, which writes histograms and wav files for inspection,
+// this checks the statistics of long renders against targets and returns a
+// non-zero exit code on failure. Usage: marbles_validation [num_blocks].
+// Run it from the eurorack directory, where it finds its Scala files.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "marbles/note_filter.h"
+#include "marbles/ramp/ramp_extractor.h"
+#include "marbles/random/distributions.h"
+#include "marbles/random/random_generator.h"
+#include "marbles/random/random_stream.h"
+#include "marbles/random/t_generator.h"
+#include "marbles/random/x_y_generator.h"
+#include "stmlib/dsp/hysteresis_quantizer.h"
+
+#include "MarblesSnapshot.hpp"
+#include "ScalaScale.hpp"
+
+using namespace marbles;
+using namespace std;
+using namespace stmlib;
+
+const float kSampleRate = 48000.0f;
+const size_t kBlockSize = 8;
+
+// Deviations from the target larger than this many standard errors fail.
+const double kNumStandardErrors = 5.0;
+
+const float kBiases[] = { 0.1f, 0.3f, 0.5f, 0.7f, 0.9f };
+// The extreme spreads are in the crossfades to a constant voltage and to a
+// Bernoulli distribution.
+const float kSpreads[] = { 0.02f, 0.1f, 0.3f, 0.5f, 0.7f, 0.9f, 0.98f };
+const size_t kNumBiases = sizeof(kBiases) / sizeof(float);
+const size_t kNumSpreads = sizeof(kSpreads) / sizeof(float);
+
+size_t num_blocks = 1000000;
+int num_failures = 0;
+
+void Check(
+    const char* name,
+    double measured,
+    double target,
+    double standard_error) {
+  double tolerance = kNumStandardErrors * standard_error + 1e-6;
+  bool pass = fabs(measured - target) <= tolerance;
+  if (!pass) {
+    ++num_failures;
+  }
+  printf(
+      "  %-28s %9.5f target %9.5f +/- %.5f %s\n",
+      name,
+      measured,
+      target,
+      tolerance,
+      pass ? "ok" : "FAIL");
+}
+
+void CheckBound(
+    const char* name,
+    double measured,
+    double bound,
+    bool upper) {
+  bool pass = upper ? measured <= bound : measured >= bound;
+  if (!pass) {
+    ++num_failures;
+  }
+  printf(
+      "  %-28s %9.5f %s %9.5f %s\n",
+      name,
+      measured,
+      upper ? "at most " : "at least",
+      bound,
+      pass ? "ok" : "FAIL");
+}
+
+void CheckAtMost(const char* name, double measured, double bound) {
+  CheckBound(name, measured, bound, true);
+}
+
+void CheckAtLeast(const char* name, double measured, double bound) {
+  CheckBound(name, measured, bound, false);
+}
+
+void ReportThroughput(const char* name, clock_t start, size_t num_samples) {
+  double seconds = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+  printf(
+      "  %-28s %.2f Msamples/s (%.1fx realtime)\n",
+      name,
+      num_samples / seconds * 1e-6,
+      num_samples / seconds / kSampleRate);
+}
+
+// Probabilities of a pulse on T1, on T3 and on both, for the models drawing
+// independent pulses at each tick. Negative for the models without a simple
+// target (drums, clusters, divider and Markov patterns).
+struct GateTargets {
+  double t1;
+  double t3;
+  double both;
+};
+
+GateTargets ComputeGateTargets(TGeneratorModel model, float bias) {
+  GateTargets targets = { -1.0, -1.0, -1.0 };
+  switch (model) {
+    case T_GENERATOR_MODEL_COMPLEMENTARY_BERNOULLI:
+      targets.t1 = 1.0 - bias;
+      targets.t3 = bias;
+      targets.both = 0.0;
+      break;
+
+    case T_GENERATOR_MODEL_INDEPENDENT_BERNOULLI:
+      targets.t1 = 1.0 - bias;
+      targets.t3 = bias;
+      targets.both = (1.0 - bias) * bias;
+      break;
+
+    case T_GENERATOR_MODEL_THREE_STATES:
+      {
+        double p_none = 0.75 - fabs(bias - 0.5);
+        double threshold = p_none + (1.0 - p_none) * (0.25 + bias * 0.5);
+        targets.t1 = 1.0 - threshold;
+        targets.t3 = threshold - p_none;
+        targets.both = 0.0;
+      }
+      break;
+
+    default:
+      break;
+  }
+  return targets;
+}
+
+// The patterns of the clusters and divider models, and of the drums model
+// (kNumTChannels bits per step, first step in the LSBs), as in t_generator.cc.
+const DividerPattern kClusterPatterns[kNumDividerPatterns] = {
+  { { { 1, 1 }, { 1, 1 } }, 1 },
+  { { { 1, 1 }, { 2, 1 } }, 1 },
+  { { { 1, 2 }, { 1, 1 } }, 2 },
+  { { { 1, 1 }, { 4, 1 } }, 1 },
+  { { { 1, 2 }, { 2, 1 } }, 2 },
+  { { { 1, 1 }, { 3, 2 } }, 2 },
+  { { { 1, 4 }, { 4, 1 } }, 4 },
+  { { { 1, 4 }, { 2, 1 } }, 4 },
+  { { { 1, 2 }, { 3, 2 } }, 2 },
+  { { { 1, 1 }, { 8, 1 } }, 1 },
+  { { { 1, 1 }, { 3, 1 } }, 1 },
+  { { { 1, 3 }, { 1, 1 } }, 3 },
+  { { { 1, 1 }, { 5, 4 } }, 4 },
+  { { { 1, 2 }, { 5, 4 } }, 4 },
+  { { { 1, 1 }, { 6, 1 } }, 1 },
+  { { { 1, 3 }, { 2, 1 } }, 3 },
+  { { { 1, 1 }, { 16, 1 } }, 1 },
+};
+
+const DividerPattern kDividerPatterns[kNumDividerPatterns] = {
+  { { { 8, 1 }, { 1, 8 } }, 8 },
+  { { { 6, 1 }, { 1, 6 } }, 6 },
+  { { { 4, 1 }, { 1, 4 } }, 4 },
+  { { { 3, 1 }, { 1, 3 } }, 3 },
+  { { { 2, 1 }, { 1, 2 } }, 2 },
+  { { { 3, 2 }, { 2, 3 } }, 6 },
+  { { { 4, 3 }, { 3, 4 } }, 12 },
+  { { { 5, 4 }, { 4, 5 } }, 20 },
+  { { { 1, 1 }, { 1, 1 } }, 1 },
+  { { { 4, 5 }, { 5, 4 } }, 20 },
+  { { { 3, 4 }, { 4, 3 } }, 12 },
+  { { { 2, 2 }, { 3, 2 } }, 6 },
+  { { { 1, 2 }, { 2, 1 } }, 2 },
+  { { { 1, 3 }, { 3, 1 } }, 3 },
+  { { { 1, 4 }, { 4, 1 } }, 4 },
+  { { { 1, 6 }, { 6, 1 } }, 6 },
+  { { { 1, 8 }, { 8, 1 } }, 8 },
+};
+
+const uint16_t kDrumPatterns[kNumDrumPatterns] = {
+  0x0201, 0x0210, 0x0211, 0x8210, 0x1211, 0x8218, 0x1201, 0x9218, 0x0241,
+  0x9258, 0x1241, 0x9a58, 0x9241, 0x9248, 0x9251, 0x2492, 0x9259, 0xa492,
+};
+
+// Pulses per tick on T1 and T3, for the models playing patterns. A pattern
+// lasts a few ticks and is picked at random when the previous one ends, so
+// the rate is the mean number of pulses of a pattern over its mean length.
+// Its standard error counts the patterns, with the variance of the number of
+// pulses of a pattern around the rate times its length, plus the pulses of
+// the first and last patterns, which may be incomplete.
+struct PatternTargets {
+  double rate[kNumTChannels];
+  double standard_error[kNumTChannels];
+};
+
+PatternTargets ComputePatternTargets(
+    const double* probability,
+    const double* length,
+    const double (*num_pulses)[kNumTChannels],
+    size_t num_patterns,
+    double num_ticks) {
+  PatternTargets targets;
+  double mean_length = 0.0;
+  double max_num_pulses = 0.0;
+  for (size_t i = 0; i < num_patterns; ++i) {
+    mean_length += probability[i] * length[i];
+    for (size_t k = 0; k < kNumTChannels; ++k) {
+      if (probability[i] > 0.0) {
+        max_num_pulses = max(max_num_pulses, num_pulses[i][k]);
+      }
+    }
+  }
+  for (size_t k = 0; k < kNumTChannels; ++k) {
+    double mean_num_pulses = 0.0;
+    for (size_t i = 0; i < num_patterns; ++i) {
+      mean_num_pulses += probability[i] * num_pulses[i][k];
+    }
+    const double rate = mean_num_pulses / mean_length;
+    double variance = 0.0;
+    for (size_t i = 0; i < num_patterns; ++i) {
+      double d = num_pulses[i][k] - rate * length[i];
+      variance += probability[i] * d * d;
+    }
+    targets.rate[k] = rate;
+    targets.standard_error[k] = sqrt(
+        variance / (num_ticks / mean_length)) / mean_length + \
+        max_num_pulses / num_ticks;
+  }
+  return targets;
+}
+
+// The clusters model picks the pattern from a skewed uniform value: the
+// further the bias is from 0.5, the more likely the denser patterns are.
+// Below 0.5, T1 and T3 are swapped.
+PatternTargets ComputeClusterTargets(float bias, double num_ticks) {
+  const size_t kNumPoints = 1 << 16;
+  double probability[kNumDividerPatterns] = { 0.0 };
+  double length[kNumDividerPatterns];
+  double num_pulses[kNumDividerPatterns][kNumTChannels];
+  const float strength = fabs(bias - 0.5f) * 2.0f;
+  for (size_t i = 0; i < kNumPoints; ++i) {
+    float u = (static_cast<float>(i) + 0.5f) / kNumPoints;
+    u *= (u + strength * strength * (1.0f - u));
+    u *= strength;
+    probability[static_cast<size_t>(u * kNumDividerPatterns)] += \
+        1.0 / kNumPoints;
+  }
+  for (size_t i = 0; i < kNumDividerPatterns; ++i) {
+    const DividerPattern& pattern = kClusterPatterns[i];
+    length[i] = pattern.length;
+    for (size_t k = 0; k < kNumTChannels; ++k) {
+      Ratio ratio = pattern.ratios[bias < 0.5f ? 1 - k : k];
+      num_pulses[i][k] = pattern.length * ratio.to_float();
+    }
+  }
+  return ComputePatternTargets(
+      probability, length, num_pulses, kNumDividerPatterns, num_ticks);
+}
+
+// The drums model picks one of the first patterns every kDrumPatternSize
+// ticks, more of them as the bias moves away from 0.5, and only the even ones
+// below 0.5.
+PatternTargets ComputeDrumTargets(float bias, double num_ticks) {
+  const size_t kNumPoints = 1 << 16;
+  double probability[kNumDrumPatterns] = { 0.0 };
+  double length[kNumDrumPatterns];
+  double num_pulses[kNumDrumPatterns][kNumTChannels];
+  for (size_t i = 0; i < kNumPoints; ++i) {
+    float u = (static_cast<float>(i) + 0.5f) / kNumPoints;
+    u *= 2.0f * fabs(bias - 0.5f);
+    size_t index = static_cast<size_t>(kNumDrumPatterns * u);
+    if (bias <= 0.5f) {
+      index -= index % 2;
+    }
+    probability[index] += 1.0 / kNumPoints;
+  }
+  for (size_t i = 0; i < kNumDrumPatterns; ++i) {
+    length[i] = kDrumPatternSize;
+    for (size_t k = 0; k < kNumTChannels; ++k) {
+      num_pulses[i][k] = 0.0;
+      for (size_t step = 0; step < kDrumPatternSize; ++step) {
+        if (kDrumPatterns[i] & (1 << (step * kNumTChannels + k))) {
+          num_pulses[i][k] += 1.0;
+        }
+      }
+    }
+  }
+  return ComputePatternTargets(
+      probability, length, num_pulses, kNumDrumPatterns, num_ticks);
+}
+
+// The divider model plays the pattern the bias selects, without randomness.
+PatternTargets ComputeDividerTargets(float bias, double num_ticks) {
+  HysteresisQuantizer quantizer;
+  quantizer.Init();
+  DividerPattern pattern = quantizer.Lookup(
+      kDividerPatterns, bias, kNumDividerPatterns);
+  double probability = 1.0;
+  double length = pattern.length;
+  double num_pulses[1][kNumTChannels];
+  for (size_t k = 0; k < kNumTChannels; ++k) {
+    num_pulses[0][k] = pattern.length * pattern.ratios[k].to_float();
+  }
+  return ComputePatternTargets(
+      &probability, &length, num_pulses, 1, num_ticks);
+}
+
+// The Markov model has no simple target, but its rules leave their mark on
+// the patterns. A channel silent for more than 24 ticks is very likely to
+// pulse: even with its other rules against it, the odds of staying silent are
+// at most 0.27 per tick, which makes silences longer than 40 ticks all but
+// impossible. And away from a bias of 1/3, the rule favoring (or disfavoring)
+// the repetition of what was played 8 ticks before makes the channels agree
+// more (or less) often with 8 ticks before than with 7 ticks before.
+void ValidateMarkovPatterns(float bias, const vector<uint8_t>& bitmasks) {
+  const float b = 1.5f * bias - 0.5f;
+  size_t longest_silence = 0;
+  size_t silence[kNumTChannels] = { 0, 0 };
+  size_t num_agreements[2] = { 0, 0 };
+  size_t num_comparisons = 0;
+  for (size_t i = 0; i < bitmasks.size(); ++i) {
+    for (size_t k = 0; k < kNumTChannels; ++k) {
+      silence[k] = bitmasks[i] & (1 << k) ? 0 : silence[k] + 1;
+      longest_silence = max(longest_silence, silence[k]);
+    }
+    if (i >= 8) {
+      for (size_t k = 0; k < kNumTChannels; ++k) {
+        const int bit = bitmasks[i] & (1 << k);
+        num_agreements[0] += bit == (bitmasks[i - 7] & (1 << k)) ? 1 : 0;
+        num_agreements[1] += bit == (bitmasks[i - 8] & (1 << k)) ? 1 : 0;
+        ++num_comparisons;
+      }
+    }
+  }
+  CheckAtMost("longest silence (ticks)", longest_silence, 40.0);
+  if (fabs(b) < 0.25f) {
+    return;
+  }
+  const double n = static_cast<double>(num_comparisons);
+  const double difference = (static_cast<double>(num_agreements[1]) - \
+      static_cast<double>(num_agreements[0])) / n;
+  // Each of the agreement rates has a standard error of at most 0.5 / sqrt(n).
+  const double standard_error = sqrt(2.0) * 0.5 / sqrt(n);
+  if (b > 0.0f) {
+    CheckAtLeast("P(8 ago) - P(7 ago)", difference,
+                 kNumStandardErrors * standard_error);
+  } else {
+    CheckAtMost("P(8 ago) - P(7 ago)", difference,
+                -kNumStandardErrors * standard_error);
+  }
+}
+
+void ValidateTGenerator() {
+  const char* model_names[] = {
+    "complementary bernoulli",
+    "clusters",
+    "drums",
+    "independent bernoulli",
+    "divider",
+    "three states",
+    "markov"
+  };
+
+  for (int model = 0; model <= T_GENERATOR_MODEL_MARKOV; ++model) {
+    for (size_t b = 0; b < kNumBiases; ++b) {
+      const float bias = kBiases[b];
+      printf("T generator, %s, bias %.1f\n", model_names[model], bias);
+
+      RandomGenerator random_generator;
+      RandomStream random_stream;
+      random_generator.Init(model * 100 + b + 1);
+      random_stream.Init(&random_generator);
+
+      TGenerator t_generator;
+      t_generator.Init(&random_stream, kSampleRate);
+      t_generator.set_model(TGeneratorModel(model));
+      t_generator.set_range(T_GENERATOR_RANGE_4X);
+      t_generator.set_rate(60.0f);
+      t_generator.set_bias(bias);
+      t_generator.set_jitter(0.0f);
+      t_generator.set_deja_vu(0.0f);
+      t_generator.set_length(8);
+      t_generator.set_pulse_width_mean(0.5f);
+      t_generator.set_pulse_width_std(0.0f);
+
+      float external[kBlockSize];
+      float master[kBlockSize];
+      float slave[kNumTChannels][kBlockSize];
+      GateFlags clock_flags[kBlockSize];
+      bool gate[kBlockSize * kNumTChannels];
+      fill(&clock_flags[0], &clock_flags[kBlockSize], GATE_FLAG_LOW);
+      Ramps ramps;
+      ramps.external = external;
+      ramps.master = master;
+      ramps.slave[0] = slave[0];
+      ramps.slave[1] = slave[1];
+
+      // A tick is a wrap of the master ramp. The pulses it schedules start
+      // right after it, so they are counted in the tick in which they rise.
+      // Counting starts on the first wrap.
+      size_t num_ticks = 0;
+      size_t num_pulses[kNumTChannels] = { 0, 0 };
+      size_t num_both = 0;
+      bool tick_pulse[kNumTChannels] = { false, false };
+      bool previous_gate[kNumTChannels] = { false, false };
+      float previous_master = 0.0f;
+      // The channels which pulsed in each tick, kNumTChannels bits per tick.
+      vector<uint8_t> tick_bitmasks;
+
+      clock_t start = clock();
+      for (size_t i = 0; i < num_blocks; ++i) {
+        t_generator.Process(false, clock_flags, ramps, gate, kBlockSize);
+        for (size_t j = 0; j < kBlockSize; ++j) {
+          if (master[j] < previous_master) {
+            if (num_ticks) {
+              num_both += tick_pulse[0] && tick_pulse[1] ? 1 : 0;
+              tick_bitmasks.push_back(
+                  (tick_pulse[0] ? 1 : 0) | (tick_pulse[1] ? 2 : 0));
+            }
+            tick_pulse[0] = tick_pulse[1] = false;
+            ++num_ticks;
+          }
+          previous_master = master[j];
+          for (size_t k = 0; k < kNumTChannels; ++k) {
+            bool g = gate[j * kNumTChannels + k];
+            if (g && !previous_gate[k] && num_ticks) {
+              ++num_pulses[k];
+              tick_pulse[k] = true;
+            }
+            previous_gate[k] = g;
+          }
+        }
+      }
+      ReportThroughput("throughput", start, num_blocks * kBlockSize);
+
+      // Ignore the pulses of the last, incomplete tick.
+      const double n = static_cast<double>(num_ticks - 1);
+      const double p1 = (num_pulses[0] - (tick_pulse[0] ? 1 : 0)) / n;
+      const double p3 = (num_pulses[1] - (tick_pulse[1] ? 1 : 0)) / n;
+      const double p_both = num_both / n;
+
+      GateTargets targets = ComputeGateTargets(TGeneratorModel(model), bias);
+      if (targets.t1 < 0.0) {
+        Check("ticks per second", n / (num_blocks * kBlockSize) * kSampleRate,
+              256.0, 1.0);
+        if (model == T_GENERATOR_MODEL_MARKOV) {
+          ValidateMarkovPatterns(bias, tick_bitmasks);
+          continue;
+        }
+        PatternTargets pattern_targets;
+        if (model == T_GENERATOR_MODEL_CLUSTERS) {
+          pattern_targets = ComputeClusterTargets(bias, n);
+        } else if (model == T_GENERATOR_MODEL_DRUMS) {
+          pattern_targets = ComputeDrumTargets(bias, n);
+          // A step of a drum pattern never plays both channels.
+          Check("P(T1 and T3)", p_both, 0.0, 0.0);
+        } else {
+          pattern_targets = ComputeDividerTargets(bias, n);
+        }
+        Check("T1 pulses per tick", p1, pattern_targets.rate[0],
+              pattern_targets.standard_error[0]);
+        Check("T3 pulses per tick", p3, pattern_targets.rate[1],
+              pattern_targets.standard_error[1]);
+        continue;
+      }
+      Check("P(T1)", p1, targets.t1, sqrt(targets.t1 * (1.0 - targets.t1) / n));
+      Check("P(T3)", p3, targets.t3, sqrt(targets.t3 * (1.0 - targets.t3) / n));
+      Check("P(T1 and T3)", p_both, targets.both,
+            sqrt(targets.both * (1.0 - targets.both) / n));
+    }
+  }
+}
+
+// The value a channel draws from a uniform value u, before scaling, as in
+// OutputChannel::GenerateNewVoltage.
+float SampleChannelValue(float u, float spread, float bias) {
+  float degenerate_amount = 1.25f - spread * 25.0f;
+  float bernoulli_amount = spread * 25.0f - 23.75f;
+  CONSTRAIN(degenerate_amount, 0.0f, 1.0f);
+  CONSTRAIN(bernoulli_amount, 0.0f, 1.0f);
+  
+  float value = BetaDistributionSample(u, spread, bias);
+  float bernoulli_value = u >= (1.0f - bias) ? 0.999999f : 0.0f;
+  value += degenerate_amount * (bias - value);
+  value += bernoulli_amount * (bernoulli_value - value);
+  return value;
+}
+
+// Mean and variance of the voltages of a channel in the full range, from the
+// inverse CDF the channel samples, integrated with the midpoint rule.
+void ComputeVoltageMoments(
+    float spread,
+    float bias,
+    double* mean,
+    double* variance) {
+  const size_t kNumPoints = 1 << 16;
+  double sum = 0.0;
+  double sum_of_squares = 0.0;
+  for (size_t i = 0; i < kNumPoints; ++i) {
+    float u = (static_cast<float>(i) + 0.5f) / kNumPoints;
+    double v = 10.0 * SampleChannelValue(u, spread, bias) - 5.0;
+    sum += v;
+    sum_of_squares += v * v;
+  }
+  *mean = sum / kNumPoints;
+  *variance = sum_of_squares / kNumPoints - *mean * *mean;
+}
+
+void ValidateXYGenerator() {
+  // Y gets the spread and bias of the opposite corner of the grid, so that
+  // its settings are not those of X.
+  for (size_t s = 0; s < kNumSpreads; ++s) {
+    for (size_t b = 0; b < kNumBiases; ++b) {
+      const float spread[OUTPUT_GROUP_LAST] = {
+        kSpreads[s], kSpreads[kNumSpreads - 1 - s]
+      };
+      const float bias[OUTPUT_GROUP_LAST] = {
+        kBiases[b], kBiases[kNumBiases - 1 - b]
+      };
+      printf(
+          "X/Y generator, spread %.2f, bias %.1f, Y spread %.2f, bias %.1f\n",
+          spread[OUTPUT_GROUP_X], bias[OUTPUT_GROUP_X],
+          spread[OUTPUT_GROUP_Y], bias[OUTPUT_GROUP_Y]);
+
+      RandomGenerator random_generator;
+      RandomStream random_stream;
+      random_generator.Init(s * 100 + b + 1);
+      random_stream.Init(&random_generator);
+
+      XYGenerator xy_generator;
+      xy_generator.Init(&random_stream, kSampleRate);
+
+      GroupSettings x;
+      x.control_mode = CONTROL_MODE_IDENTICAL;
+      x.voltage_range = VOLTAGE_RANGE_FULL;
+      x.register_mode = false;
+      x.register_value = 0.0f;
+      x.spread = spread[OUTPUT_GROUP_X];
+      x.bias = bias[OUTPUT_GROUP_X];
+      // Just below the quantized range, with the fastest lag: the output has
+      // settled on the new voltage long before the next tick.
+      x.steps = 0.49f;
+      x.deja_vu = 0.0f;
+      x.length = 8;
+      x.ratio.p = 1;
+      x.ratio.q = 1;
+      x.scale_index = 0;
+      GroupSettings y = x;
+      y.spread = spread[OUTPUT_GROUP_Y];
+      y.bias = bias[OUTPUT_GROUP_Y];
+
+      float external[kBlockSize];
+      float master[kBlockSize];
+      float slave[kNumTChannels][kBlockSize];
+      GateFlags clock_flags[kBlockSize];
+      float output[kBlockSize * kNumChannels];
+      fill(&clock_flags[0], &clock_flags[kBlockSize], GATE_FLAG_LOW);
+      Ramps ramps;
+      ramps.external = external;
+      ramps.master = master;
+      ramps.slave[0] = slave[0];
+      ramps.slave[1] = slave[1];
+
+      // The channels are clocked every 64 samples. Their output is sampled
+      // just before each tick.
+      const float frequency = 1.0f / 64.0f;
+      float phase = 0.0f;
+      double sum[OUTPUT_GROUP_LAST] = { 0.0, 0.0 };
+      double sum_of_squares[OUTPUT_GROUP_LAST] = { 0.0, 0.0 };
+      size_t num_values[OUTPUT_GROUP_LAST] = { 0, 0 };
+      size_t num_samples = 0;
+      double elapsed = 0.0;
+      float last_output[kNumChannels] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+      for (size_t i = 0; i < num_blocks; ++i) {
+        bool tick[kBlockSize];
+        for (size_t j = 0; j < kBlockSize; ++j) {
+          phase += frequency;
+          tick[j] = phase >= 1.0f;
+          if (tick[j]) {
+            phase -= 1.0f;
+          }
+          master[j] = slave[0][j] = slave[1][j] = phase;
+        }
+        clock_t start = clock();
+        xy_generator.Process(
+            CLOCK_SOURCE_INTERNAL_T1_T2_T3,
+            x,
+            y,
+            clock_flags,
+            ramps,
+            output,
+            kBlockSize);
+        elapsed += clock() - start;
+        num_samples += kBlockSize;
+        for (size_t j = 0; j < kBlockSize; ++j) {
+          if (tick[j] && num_samples > 64) {
+            for (size_t k = 0; k < kNumChannels; ++k) {
+              const int group = k < kNumXChannels
+                  ? OUTPUT_GROUP_X
+                  : OUTPUT_GROUP_Y;
+              double v = last_output[k];
+              sum[group] += v;
+              sum_of_squares[group] += v * v;
+              ++num_values[group];
+            }
+          }
+          for (size_t k = 0; k < kNumChannels; ++k) {
+            last_output[k] = output[j * kNumChannels + k];
+          }
+        }
+      }
+      double seconds = elapsed / CLOCKS_PER_SEC;
+      printf(
+          "  %-28s %.2f Msamples/s (%.1fx realtime)\n",
+          "throughput",
+          num_samples / seconds * 1e-6,
+          num_samples / seconds / kSampleRate);
+
+      const char* mean_names[] = { "X mean (V)", "Y mean (V)" };
+      const char* variance_names[] = { "X variance (V^2)", "Y variance (V^2)" };
+      for (int group = 0; group < OUTPUT_GROUP_LAST; ++group) {
+        double target_mean;
+        double target_variance;
+        ComputeVoltageMoments(
+            spread[group],
+            bias[group],
+            &target_mean,
+            &target_variance);
+
+        const double n = static_cast<double>(num_values[group]);
+        const double mean = sum[group] / n;
+        const double variance = sum_of_squares[group] / n - mean * mean;
+        Check(mean_names[group], mean, target_mean, sqrt(target_variance / n));
+        // Standard error of the variance, bounded using the fact that voltages
+        // lie within +/-5V, which bounds the fourth central moment by 100
+        // times the variance.
+        Check(variance_names[group], variance, target_variance,
+              sqrt((100.0 * target_variance) / n));
+      }
+    }
+  }
+}
+
+void ValidateRampExtractor() {
+  // Jittered clocks from 0.1 Hz to audio rate. The extractor is locked when
+  // the ramp it outputs spans one cycle per clock period, with a phase error
+  // within the tolerance. The lock time is the time after which it stays
+  // locked. Audio rate clocks are tracked with a slow glide, so their lock
+  // time is bounded in seconds rather than in periods.
+  const float kFrequencies[] = { 0.1f, 1.0f, 10.0f, 100.0f, 1000.0f, 4000.0f };
+  const float kJitters[] = { 0.0f, 0.02f };
+  const size_t kMinNumPeriods = 64;
+  const float kMinDuration = 1.0f;
+  const float kMaxLockPeriods = 8.0f;
+  const float kMaxLockTime = 0.25f;
+  const size_t kChunkSize = 64 * kBlockSize;
+  
+  for (size_t f = 0; f < sizeof(kFrequencies) / sizeof(float); ++f) {
+    for (size_t j = 0; j < sizeof(kJitters) / sizeof(float); ++j) {
+      const float mean_period = kSampleRate / kFrequencies[f];
+      const float jitter = kJitters[j];
+      printf("Ramp extractor, %g Hz, %.0f%% jitter\n",
+          kFrequencies[f], jitter * 100.0f);
+      
+      RampExtractor ramp_extractor;
+      ramp_extractor.Init(8000.0f / kSampleRate);
+      Ratio ratio = { 1, 1 };
+      
+      // Audio rate clocks are tracked by frequency, without phase reset: only
+      // the phase advance over a clock period is checked, against the one a
+      // ramp at the mean frequency of the clock would have.
+      const bool audio_rate = mean_period <= 320.0f;
+      const float tolerance = 0.05f + 2.0f * jitter;
+      const size_t num_periods = max(
+          kMinNumPeriods,
+          static_cast<size_t>(kMinDuration * kFrequencies[f]));
+      
+      uint32_t rng_state = f * 10 + j + 1;
+      float period = mean_period;
+      float clock_phase = 0.0f;
+      GateFlags previous_flags = GATE_FLAG_LOW;
+      float previous_ramp = 0.0f;
+      float advance = 0.0f;
+      size_t period_samples = 0;
+      float mid_value = 0.5f;
+      size_t num_pulses = 0;
+      size_t num_samples = 0;
+      size_t unlocked_samples = 0;
+      double elapsed = 0.0;
+      
+      while (num_pulses < num_periods) {
+        GateFlags flags[kChunkSize];
+        float ramp[kChunkSize];
+        bool edge[kChunkSize];
+        bool mid[kChunkSize];
+        for (size_t i = 0; i < kChunkSize; ++i) {
+          clock_phase += 1.0f;
+          edge[i] = clock_phase >= period;
+          if (edge[i]) {
+            clock_phase -= period;
+            rng_state = rng_state * 1664525L + 1013904223L;
+            float u = static_cast<float>(rng_state) / kMaxUint32;
+            period = mean_period * (1.0f + jitter * (2.0f * u - 1.0f));
+          }
+          const float half_period = period * 0.5f;
+          mid[i] = clock_phase < half_period && clock_phase + 1.0f >= half_period;
+          previous_flags = ExtractGateFlags(
+              previous_flags,
+              clock_phase < half_period);
+          flags[i] = previous_flags;
+        }
+        
+        clock_t start = clock();
+        for (size_t i = 0; i < kChunkSize; i += kBlockSize) {
+          ramp_extractor.Process(
+              ratio, false, &flags[i], &ramp[i], kBlockSize);
+        }
+        elapsed += clock() - start;
+        
+        for (size_t i = 0; i < kChunkSize; ++i) {
+          ++num_samples;
+          float d = ramp[i] - previous_ramp;
+          if (d < 0.0f) {
+            d += 1.0f;
+          }
+          if (edge[i]) {
+            float error = audio_rate
+                ? fabs(advance - period_samples / mean_period)
+                : max(1.0f - previous_ramp, 2.0f * fabs(mid_value - 0.5f));
+            ++num_pulses;
+            if (error > tolerance) {
+              unlocked_samples = num_samples;
+            }
+            advance = 0.0f;
+            period_samples = 0;
+          }
+          if (mid[i]) {
+            mid_value = ramp[i];
+          }
+          advance += d;
+          ++period_samples;
+          previous_ramp = ramp[i];
+        }
+      }
+      
+      double seconds = elapsed / CLOCKS_PER_SEC;
+      printf(
+          "  %-28s %.1f ns/sample\n",
+          "cpu",
+          seconds / num_samples * 1e9);
+      const float lock_time = unlocked_samples / kSampleRate;
+      const float max_lock_time = audio_rate
+          ? kMaxLockTime
+          : kMaxLockPeriods * mean_period / kSampleRate;
+      printf(
+          "  %-28s %.1f periods\n",
+          "lock time",
+          lock_time * kFrequencies[f]);
+      CheckAtMost("lock time (s)", lock_time, max_lock_time);
+    }
+  }
+}
+
+// Settings of the X channels for the checks below, which do not measure
+// distributions.
+GroupSettings MakeGroupSettings() {
+  GroupSettings x;
+  x.control_mode = CONTROL_MODE_TILT;
+  x.voltage_range = VOLTAGE_RANGE_FULL;
+  x.register_mode = false;
+  x.register_value = 0.0f;
+  x.spread = 0.6f;
+  x.bias = 0.5f;
+  x.steps = 0.7f;
+  x.deja_vu = 0.3f;
+  x.length = 5;
+  x.ratio.p = 1;
+  x.ratio.q = 1;
+  x.scale_index = 0;
+  return x;
+}
+
+void ValidateStateRestore() {
+  // Save the random memory of the generators in the format of the patches,
+  // render, restore it and render again: the X/Y outputs must be identical,
+  // including the polyphonic X bank and the Y groups. The T generator draws
+  // from the same random stream, but its gates are not compared: their width
+  // follows the slave ramps, which are not saved and lock again to the clock.
+  // The X/Y channels get their own clock for the same reason. The lags are not
+  // saved either: after a restore, each output ends the glide it was doing
+  // before, and the renders are only compared once all the outputs have
+  // ticked.
+  printf("State restore\n");
+  const size_t num_state_blocks = kSampleRate * 10 / kBlockSize;
+  const size_t kNumPolyXChannels = 8;
+  const size_t kNumYGroups = 4;
+  const size_t kClockPeriod = kSampleRate / 2;
+  // The slowest Y group divides the clock by 4, and ticks for the first time
+  // 4.5 periods into a pass.
+  const size_t kNumSettlingSamples = kClockPeriod * 5;
+  
+  RandomGenerator random_generator;
+  RandomStream random_stream;
+  random_generator.Init(7);
+  random_stream.Init(&random_generator);
+  
+  TGenerator t_generator;
+  t_generator.Init(&random_stream, kSampleRate);
+  t_generator.set_model(T_GENERATOR_MODEL_MARKOV);
+  t_generator.set_range(T_GENERATOR_RANGE_4X);
+  t_generator.set_rate(12.0f);
+  t_generator.set_bias(0.4f);
+  t_generator.set_jitter(0.3f);
+  t_generator.set_deja_vu(0.4f);
+  t_generator.set_length(5);
+  t_generator.set_pulse_width_mean(0.5f);
+  t_generator.set_pulse_width_std(0.2f);
+  
+  XYGenerator xy_generator;
+  xy_generator.Init(&random_stream, kSampleRate);
+  xy_generator.set_num_poly_x_channels(kNumPolyXChannels);
+  xy_generator.set_num_y_groups(kNumYGroups);
+  
+  GroupSettings x = MakeGroupSettings();
+  GroupSettings y = x;
+  y.control_mode = CONTROL_MODE_IDENTICAL;
+  y.deja_vu = 0.0f;
+  y.ratio.q = 4;
+  for (size_t i = 1; i < kNumYGroups; ++i) {
+    GroupSettings group = y;
+    group.deja_vu = 0.2f * i;
+    group.ratio.q = 1 + i;
+    xy_generator.set_y_group_settings(i, group);
+  }
+  
+  float external[kBlockSize];
+  float master[kBlockSize];
+  float slave[kNumTChannels][kBlockSize];
+  float t_master[kBlockSize];
+  float t_slave[kNumTChannels][kBlockSize];
+  GateFlags clock_flags[kBlockSize];
+  fill(&clock_flags[0], &clock_flags[kBlockSize], GATE_FLAG_LOW);
+  Ramps ramps;
+  ramps.external = external;
+  ramps.master = master;
+  ramps.slave[0] = slave[0];
+  ramps.slave[1] = slave[1];
+  Ramps t_ramps = ramps;
+  t_ramps.master = t_master;
+  t_ramps.slave[0] = t_slave[0];
+  t_ramps.slave[1] = t_slave[1];
+  
+  vector<float> renders[2];
+  string encoded_state;
+  string restored_state;
+  bool decoded = false;
+  for (int pass = 0; pass < 3; ++pass) {
+    if (pass == 1) {
+      MarblesSnapshot snapshot;
+      snapshot.random_state = random_generator.state();
+      t_generator.SaveState(&snapshot.t);
+      xy_generator.SaveState(&snapshot.xy);
+      encoded_state = encodeMarblesSnapshot(snapshot);
+    } else if (pass == 2) {
+      MarblesSnapshot snapshot;
+      decoded = decodeMarblesSnapshot(encoded_state, &snapshot);
+      random_generator.Init(snapshot.random_state);
+      t_generator.RestoreState(snapshot.t);
+      xy_generator.RestoreState(snapshot.xy);
+      
+      // Nothing is lost by a restore.
+      snapshot.random_state = random_generator.state();
+      t_generator.SaveState(&snapshot.t);
+      xy_generator.SaveState(&snapshot.xy);
+      restored_state = encodeMarblesSnapshot(snapshot);
+    }
+    // A 2 Hz clock, computed from the sample index so that all the passes
+    // see the same ramp: the generators hold its previous value, which is not
+    // saved. The state is saved half a period after a tick, not while the
+    // random values are drawn.
+    for (size_t i = 0; i < num_state_blocks; ++i) {
+      for (size_t j = 0; j < kBlockSize; ++j) {
+        size_t t = (i * kBlockSize + j + kClockPeriod / 2) % kClockPeriod;
+        master[j] = slave[0][j] = slave[1][j] =
+            static_cast<float>(t) / kClockPeriod;
+      }
+      bool gate[kBlockSize * kNumTChannels];
+      float output[kBlockSize * kNumChannels];
+      float poly_x_output[kBlockSize * kMaxNumPolyXChannels];
+      float y_group_output[kBlockSize * kMaxNumYGroups];
+      t_generator.Process(false, clock_flags, t_ramps, gate, kBlockSize);
+      xy_generator.Process(
+          CLOCK_SOURCE_INTERNAL_T1_T2_T3,
+          x,
+          y,
+          clock_flags,
+          ramps,
+          output,
+          kBlockSize,
+          poly_x_output,
+          NULL,
+          y_group_output);
+      if (!pass) {
+        continue;
+      }
+      vector<float>* render = &renders[pass - 1];
+      for (size_t j = 0; j < kBlockSize; ++j) {
+        for (size_t k = 0; k < kNumChannels; ++k) {
+          render->push_back(output[j * kNumChannels + k]);
+        }
+        for (size_t k = 0; k < kNumPolyXChannels; ++k) {
+          render->push_back(poly_x_output[j * kMaxNumPolyXChannels + k]);
+        }
+        for (size_t k = 0; k < kNumYGroups; ++k) {
+          render->push_back(y_group_output[j * kMaxNumYGroups + k]);
+        }
+      }
+    }
+  }
+  
+  size_t num_differences = 0;
+  const size_t stride = kNumChannels + kNumPolyXChannels + kNumYGroups;
+  for (size_t i = kNumSettlingSamples * stride; i < renders[0].size(); ++i) {
+    num_differences += renders[0][i] != renders[1][i] ? 1 : 0;
+  }
+  Check("state decoded", decoded ? 1.0 : 0.0, 1.0, 0.0);
+  Check("state saved again", restored_state == encoded_state ? 1.0 : 0.0,
+        1.0, 0.0);
+  Check("samples differing", num_differences, 0.0, 0.0);
+}
+
+void ValidatePolyXBank() {
+  // With 3 channels and the X outputs sharing a clock, the polyphonic X bank
+  // must output the same voltages as X1, X2 and X3, in all control modes, with
+  // and without the external register.
+  const size_t num_bank_blocks = kSampleRate * 10 / kBlockSize;
+  const char* mode_names[] = { "identical", "bump", "tilt" };
+  
+  for (int mode = 0; mode < 6; ++mode) {
+    printf("Poly X bank, %s%s\n",
+        mode_names[mode % 3],
+        mode >= 3 ? ", external register" : "");
+    
+    RandomGenerator random_generator;
+    RandomStream random_stream;
+    random_generator.Init(7);
+    random_stream.Init(&random_generator);
+    
+    XYGenerator xy_generator;
+    xy_generator.Init(&random_stream, kSampleRate);
+    xy_generator.set_num_poly_x_channels(kNumXChannels);
+    
+    GroupSettings x = MakeGroupSettings();
+    x.control_mode = ControlMode(mode % 3);
+    x.register_mode = mode >= 3;
+    x.bias = 0.7f;
+    x.steps = 0.3f;
+    GroupSettings y = x;
+    y.control_mode = CONTROL_MODE_IDENTICAL;
+    y.register_mode = false;
+    y.deja_vu = 0.0f;
+    y.ratio.q = 4;
+    
+    float external[kBlockSize];
+    float master[kBlockSize];
+    float slave[kNumTChannels][kBlockSize];
+    GateFlags clock_flags[kBlockSize];
+    fill(&clock_flags[0], &clock_flags[kBlockSize], GATE_FLAG_LOW);
+    Ramps ramps;
+    ramps.external = external;
+    ramps.master = master;
+    ramps.slave[0] = slave[0];
+    ramps.slave[1] = slave[1];
+    
+    size_t num_differences = 0;
+    float phase = 0.0f;
+    for (size_t i = 0; i < num_bank_blocks; ++i) {
+      for (size_t j = 0; j < kBlockSize; ++j) {
+        phase += 2.0f / kSampleRate;
+        if (phase >= 1.0f) {
+          phase -= 1.0f;
+        }
+        master[j] = slave[0][j] = slave[1][j] = phase;
+      }
+      x.register_value = static_cast<float>(i % 1000) / 1000.0f;
+      float output[kBlockSize * kNumChannels];
+      float poly_x_output[kBlockSize * kMaxNumPolyXChannels];
+      xy_generator.Process(
+          CLOCK_SOURCE_INTERNAL_T2,
+          x,
+          y,
+          clock_flags,
+          ramps,
+          output,
+          kBlockSize,
+          poly_x_output);
+      for (size_t j = 0; j < kBlockSize; ++j) {
+        for (size_t k = 0; k < kNumXChannels; ++k) {
+          float a = output[j * kNumChannels + k];
+          float b = poly_x_output[j * kMaxNumPolyXChannels + k];
+          num_differences += fabs(a - b) > 1e-5f ? 1 : 0;
+        }
+      }
+    }
+    Check("samples differing from X", num_differences, 0.0, 0.0);
+  }
+}
+
+void ReportBlockSizeThroughput() {
+  // CPU cost vs. latency of the Rack module's block processing: clocks and
+  // parameters are only read every block_size samples, and the outputs lag
+  // the clock input by block_size samples.
+  const size_t kMaxBlockSize = 32;
+  const size_t block_sizes[] = { 1, 2, 4, 5, 8, 16, 32 };
+  const size_t num_samples = num_blocks * kBlockSize;
+  
+  printf("Block size throughput\n");
+  printf("  %-10s %-14s %-12s %s\n",
+      "block size", "latency (ms)", "ns/sample", "cpu (% of 1 core)");
+  for (size_t b = 0; b < sizeof(block_sizes) / sizeof(size_t); ++b) {
+    const size_t block_size = block_sizes[b];
+    
+    RandomGenerator random_generator;
+    RandomStream random_stream;
+    random_generator.Init(1);
+    random_stream.Init(&random_generator);
+    
+    TGenerator t_generator;
+    XYGenerator xy_generator;
+    NoteFilter note_filter;
+    t_generator.Init(&random_stream, kSampleRate);
+    xy_generator.Init(&random_stream, kSampleRate);
+    note_filter.Init();
+    
+    // A 4 Hz square wave on the clock inputs.
+    GateFlags clock_state = GATE_FLAG_LOW;
+    
+    GroupSettings x = MakeGroupSettings();
+    x.spread = 0.7f;
+    x.steps = 0.3f;
+    x.deja_vu = 0.4f;
+    x.length = 8;
+    GroupSettings y = x;
+    y.control_mode = CONTROL_MODE_IDENTICAL;
+    y.deja_vu = 0.0f;
+    y.ratio.q = 4;
+    
+    GateFlags clock_flags[kMaxBlockSize];
+    float external[kMaxBlockSize];
+    float master[kMaxBlockSize];
+    float slave[kNumTChannels][kMaxBlockSize];
+    bool gate[kMaxBlockSize * kNumTChannels];
+    float output[kMaxBlockSize * kNumChannels];
+    Ramps ramps;
+    ramps.external = external;
+    ramps.master = master;
+    ramps.slave[0] = slave[0];
+    ramps.slave[1] = slave[1];
+    
+    clock_t start = clock();
+    for (size_t i = 0; i < num_samples; i += block_size) {
+      for (size_t j = 0; j < block_size; ++j) {
+        clock_state = ExtractGateFlags(clock_state, (i + j) % 12000 < 6000);
+        clock_flags[j] = clock_state;
+      }
+      
+      // The module sets the parameters on every block.
+      t_generator.set_model(T_GENERATOR_MODEL_COMPLEMENTARY_BERNOULLI);
+      t_generator.set_range(T_GENERATOR_RANGE_1X);
+      t_generator.set_rate(12.0f);
+      t_generator.set_bias(0.5f);
+      t_generator.set_jitter(0.2f);
+      t_generator.set_deja_vu(0.4f);
+      t_generator.set_length(8);
+      t_generator.set_pulse_width_mean(0.5f);
+      t_generator.set_pulse_width_std(0.1f);
+      t_generator.Process(false, clock_flags, ramps, gate, block_size);
+      
+      x.register_value = note_filter.Process(0.5f);
+      xy_generator.Process(
+          CLOCK_SOURCE_INTERNAL_T1_T2_T3,
+          x,
+          y,
+          clock_flags,
+          ramps,
+          output,
+          block_size);
+    }
+    double seconds = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+    printf("  %-10zu %-14.3f %-12.1f %.3f\n",
+        block_size,
+        1000.0 * block_size / kSampleRate,
+        1e9 * seconds / num_samples,
+        100.0 * seconds * kSampleRate / num_samples);
+  }
+}
+
+void ValidateScalaImport() {
+  printf("Scala import\n");
+  
+  string text;
+  string error;
+  Check("missing file rejected",
+        readScalaFile("marbles/test/validation/missing.scl", &text, &error)
+            ? 0.0 : 1.0,
+        1.0, 0.0);
+  
+  // 12-TET, with a step 0.0005 cents under the octave. It folds onto the 1/1,
+  // and must not add a second degree at 0V.
+  ScalaTuning tuning;
+  Scale scale;
+  bool compiled = readScalaFile(
+      "marbles/test/validation/step_under_octave.scl", &text, &error) &&
+      parseScalaTuning(text, &tuning, &error) &&
+      compileScalaScale(tuning, NULL, &scale, &error);
+  if (!compiled) {
+    printf("  %s\n", error.c_str());
+  }
+  Check("compiled", compiled ? 1.0 : 0.0, 1.0, 0.0);
+  if (!compiled) {
+    return;
+  }
+  Check("number of degrees", scale.num_degrees, 12.0, 0.0);
+  Check("base interval (V)", scale.base_interval, 1.0, 0.0);
+  
+  size_t num_unsorted = 0;
+  for (int i = 1; i < scale.num_degrees; ++i) {
+    if (scale.degree[i].voltage <= scale.degree[i - 1].voltage) {
+      ++num_unsorted;
+    }
+  }
+  Check("degrees not ascending", num_unsorted, 0.0, 0.0);
+  Check("degree 0 voltage (V)", scale.degree[0].voltage, 0.0, 0.0);
+  // The merged degree keeps the heaviest of the two weights.
+  Check("degree 0 weight", scale.degree[0].weight, 255.0, 0.0);
+  Check("degree 7 weight", scale.degree[7].weight, 192.0, 0.0);
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    num_blocks = strtoul(argv[1], NULL, 10);
+    if (num_blocks == 0) {
+      fprintf(stderr, "Usage: %s [num_blocks]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  ValidateTGenerator();
+  ValidateXYGenerator();
+  ValidateStateRestore();
+  ValidatePolyXBank();
+  ValidateRampExtractor();
+  ValidateScalaImport();
+  ReportBlockSizeThroughput();
+
+  if (num_failures) {
+    printf("%d check(s) failed\n", num_failures);
+    return 1;
+  }
+  printf("All checks passed\n");
+  return 0;
+}
@@ -64,21 +64,31 @@ void AdditiveEngine::UpdateAmplitudes(
   const float margin = (1.0f / slope - 1.0f) / (1.0f + bumps);
   const float center = centroid * (n + margin) - 0.5f * margin;
 
-  float sum = 0.001f;
-
+  // The gains are computed in separate passes over all the harmonics, so
+  // that everything but the sine table lookup is vectorized.
+  float gain[kNumHarmonics];
+  float bump[kNumHarmonics];
   for (size_t i = 0; i < num_harmonics; ++i) {
     float order = fabsf(static_cast<float>(i) - center) * slope;
-    float gain = 1.0f - order;
-    gain += fabsf(gain);
-    gain *= gain;
+    float g = 1.0f - order;
+    g += fabsf(g);
+    gain[i] = g * g;
+    bump[i] = 0.25f + order * bumps;
+  }
+  
+  for (size_t i = 0; i < num_harmonics; ++i) {
+    bump[i] = InterpolateWrap(lut_sine, bump[i], 1024.0f);
+  }
+  
+  for (size_t i = 0; i < num_harmonics; ++i) {
+    float g = gain[i] * (1.0f + bump[i]);
+    g *= g;
+    gain[i] = g * g;
+  }
 
-    float b = 0.25f + order * bumps;
-    float bump_factor = 1.0f + InterpolateWrap(lut_sine, b, 1024.0f);
+  float sum = 0.001f;
 
-    gain *= bump_factor;
-    gain *= gain;
-    gain *= gain;
-    
+  for (size_t i = 0; i < num_harmonics; ++i) {
     int j = harmonic_indices[i];
     
     // Warning about the following line: this is not a proper LP filter because
@@ -89,7 +99,7 @@ void AdditiveEngine::UpdateAmplitudes(
     // normalized spectrum, and both of them cause more annoyances than this
     // "incorrect" solution.
     
-    ONE_POLE(amplitudes[j], gain, 0.001f);
+    ONE_POLE(amplitudes[j], gain[i], 0.001f);
     sum += amplitudes[j];
   }
 
@@ -37,39 +37,31 @@ namespace plaits {
 using namespace std;
 using namespace stmlib;
 
-const float chords[kChordNumChords][kChordNumNotes] = {
-  { 0.00f, 0.01f, 11.99f, 12.00f },  // OCT
-  { 0.00f, 7.01f,  7.00f, 12.00f },  // 5
-  { 0.00f, 5.00f,  7.00f, 12.00f },  // sus4
-  { 0.00f, 3.00f,  7.00f, 12.00f },  // m
-  { 0.00f, 3.00f,  7.00f, 10.00f },  // m7
-  { 0.00f, 3.00f, 10.00f, 14.00f },  // m9
-  { 0.00f, 3.00f, 10.00f, 17.00f },  // m11
-  { 0.00f, 2.00f,  9.00f, 16.00f },  // 69
-  { 0.00f, 4.00f, 11.00f, 14.00f },  // M9
-  { 0.00f, 4.00f,  7.00f, 11.00f },  // M7
-  { 0.00f, 4.00f,  7.00f, 12.00f },  // M
+// Frequency ratios of the notes of each chord, computed with
+// SemitonesToRatio from the intervals (in semitones) given in comments.
+const float chord_ratios[kChordNumChords][kChordNumNotes] = {
+  { 1.0f, 1.00045133f, 1.99864674f, 2.0f },  // OCT (0, 0.01, 11.99, 12)
+  { 1.0f, 1.49898338f, 1.49830711f, 2.0f },  // 5 (0, 7.01, 7, 12)
+  { 1.0f, 1.33483982f, 1.49830711f, 2.0f },  // sus4 (0, 5, 7, 12)
+  { 1.0f, 1.18920708f, 1.49830711f, 2.0f },  // m (0, 3, 7, 12)
+  { 1.0f, 1.18920708f, 1.49830711f, 1.78179741f },  // m7 (0, 3, 7, 10)
+  { 1.0f, 1.18920708f, 1.78179741f, 2.24492407f },  // m9 (0, 3, 10, 14)
+  { 1.0f, 1.18920708f, 1.78179741f, 2.66967964f },  // m11 (0, 3, 10, 17)
+  { 1.0f, 1.12246203f, 1.68179286f, 2.51984215f },  // 69 (0, 2, 9, 16)
+  { 1.0f, 1.25992107f, 1.8877486f, 2.24492407f },  // M9 (0, 4, 11, 14)
+  { 1.0f, 1.25992107f, 1.49830711f, 1.8877486f },  // M7 (0, 4, 7, 11)
+  { 1.0f, 1.25992107f, 1.49830711f, 2.0f },  // M (0, 4, 7, 12)
 };
 
 void ChordEngine::Init(BufferAllocator* allocator) {
-  for (int i = 0; i < kChordNumVoices; ++i) {
-    divide_down_voice_[i].Init();
-    wavetable_voice_[i].Init();
-  }
+  divide_down_voices_.Init();
+  wavetable_voices_.Init();
   chord_index_quantizer_.Init();
   morph_lp_ = 0.0f;
   timbre_lp_ = 0.0f;
-  
-  ratios_ = allocator->Allocate<float>(kChordNumChords * kChordNumVoices);
 }
 
-void ChordEngine::Reset() {
-  for (int i = 0; i < kChordNumChords; ++i) {
-    for (int j = 0; j < kChordNumVoices; ++j) {
-      ratios_[i * kChordNumVoices + j] = SemitonesToRatio(chords[i][j]);
-    }
-  }
-}
+void ChordEngine::Reset() { }
 
 const float fade_point[kChordNumVoices] = {
   0.55f, 0.47f, 0.49f, 0.51f, 0.53f
@@ -105,7 +97,7 @@ int ChordEngine::ComputeChordInversion(
     float inversion,
     float* ratios,
     float* amplitudes) {
-  const float* base_ratio = &ratios_[chord_index * kChordNumVoices];
+  const float* base_ratio = chord_ratios[chord_index];
   inversion = inversion * float(kChordNumNotes * 5);
 
   MAKE_INTEGRAL_FRACTIONAL(inversion);
@@ -200,40 +192,71 @@ void ChordEngine::Render(
   const float f0 = NoteToFrequency(parameters.note) * 0.998f;
   const float waveform = max((morph_lp_ - 0.535f) * 2.15f, 0.0f);
   
-  for (int note = 0; note < kChordNumVoices; ++note) {
+  // Per-voice frequencies and gains. As when each voice was an oscillator of
+  // its own, only the audible voices are rendered: the others are frozen. The
+  // unused lanes are never rendered.
+  float divide_down_f0[kChordNumLanes];
+  float divide_down_gain[kChordNumLanes];
+  float wavetable_f0[kChordNumLanes];
+  float wavetable_gain[kChordNumLanes];
+  int divide_down_mask = 0;
+  int wavetable_mask = 0;
+  
+  for (int note = 0; note < kChordNumLanes; ++note) {
+    if (note >= kChordNumVoices) {
+      divide_down_f0[note] = wavetable_f0[note] = f0;
+      divide_down_gain[note] = wavetable_gain[note] = 0.0f;
+      continue;
+    }
     float wavetable_amount = 50.0f * (morph_lp_ - fade_point[note]);
     CONSTRAIN(wavetable_amount, 0.0f, 1.0f);
 
     float divide_down_amount = 1.0f - wavetable_amount;
-    float* destination = (1 << note) & aux_note_mask ? aux : out;
     
     const float note_f0 = f0 * ratios[note];
-    float divide_down_gain = 4.0f - note_f0 * 32.0f;
-    CONSTRAIN(divide_down_gain, 0.0f, 1.0f);
-    divide_down_amount *= divide_down_gain;
-    
-    if (wavetable_amount) {
-      wavetable_voice_[note].Render(
-          note_f0 * 1.004f,
-          note_amplitudes[note] * wavetable_amount,
-          waveform,
-          wavetable,
-          destination,
-          size);
-    }
+    float gain = 4.0f - note_f0 * 32.0f;
+    CONSTRAIN(gain, 0.0f, 1.0f);
+    divide_down_amount *= gain;
     
+    divide_down_f0[note] = note_f0;
+    divide_down_gain[note] = note_amplitudes[note] * divide_down_amount;
+    wavetable_f0[note] = note_f0 * 1.004f;
+    wavetable_gain[note] = note_amplitudes[note] * wavetable_amount;
     if (divide_down_amount) {
-      divide_down_voice_[note].Render(
-          note_f0,
-          harmonics,
-          note_amplitudes[note] * divide_down_amount,
-          destination,
-          size);
+      divide_down_mask |= 1 << note;
+    }
+    if (wavetable_amount) {
+      wavetable_mask |= 1 << note;
     }
   }
   
+  // Both banks mix all the voices into out, and the aux voices into aux.
+  if (wavetable_mask) {
+    wavetable_voices_.Render(
+        wavetable_f0,
+        wavetable_gain,
+        waveform,
+        wavetable,
+        wavetable_mask,
+        aux_note_mask,
+        out,
+        aux,
+        size);
+  }
+  
+  if (divide_down_mask) {
+    divide_down_voices_.Render(
+        divide_down_f0,
+        harmonics,
+        divide_down_gain,
+        divide_down_mask,
+        aux_note_mask,
+        out,
+        aux,
+        size);
+  }
+  
   for (size_t i = 0; i < size; ++i) {
-    out[i] += aux[i];
     aux[i] *= 3.0f;
   }
 }
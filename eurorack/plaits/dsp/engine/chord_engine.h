@@ -42,6 +42,9 @@ const int kChordNumVoices = 5;
 const int kChordNumChords = 11;
 const int kChordNumHarmonics = 3;
 
+// The voices are rendered side by side, in a whole number of SSE vectors.
+const int kChordNumLanes = 8;
+
 class ChordEngine : public Engine {
  public:
   ChordEngine() { }
@@ -63,16 +66,14 @@ class ChordEngine : public Engine {
       float* ratios,
       float* amplitudes);
   
-  StringSynthOscillator divide_down_voice_[kChordNumVoices];
-  WavetableOscillator<256, 15> wavetable_voice_[kChordNumVoices];
+  StringSynthOscillatorBank<kChordNumLanes> divide_down_voices_;
+  WavetableOscillatorBank<256, 15, kChordNumLanes> wavetable_voices_;
   stmlib::HysteresisQuantizer chord_index_quantizer_;
   
   float morph_lp_;
   float timbre_lp_;
   float previous_root_normalization_;
   
-  float* ratios_;
-  
   DISALLOW_COPY_AND_ASSIGN(ChordEngine);
 };
 
@@ -28,6 +28,10 @@
 
 #include "plaits/dsp/engine/fm_engine.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif  // __SSE2__
+
 #include "stmlib/dsp/parameter_interpolator.h"
 
 #include "plaits/resources.h"
@@ -46,6 +50,8 @@ void FMEngine::Init(BufferAllocator* allocator) {
   previous_amount_ = 0.0f;
   previous_feedback_ = 0.0f;
   previous_sample_ = 0.0f;
+  sub_fir_ = 0.0f;
+  carrier_fir_ = 0.0f;
 }
 
 void FMEngine::Reset() {
@@ -97,6 +103,46 @@ class Downsampler {
   DISALLOW_COPY_AND_ASSIGN(Downsampler);
 };
 
+#ifdef __SSE2__
+
+// The phases of the kOversampling subsamples of a sample.
+static inline __m128i PhaseRamp(uint32_t phase, uint32_t increment) {
+  return _mm_add_epi32(
+      _mm_set1_epi32(phase),
+      _mm_setr_epi32(increment, 2 * increment, 3 * increment, 4 * increment));
+}
+
+// FMEngine::SinePM, on 4 phases at once.
+static inline __m128 SinePM4(__m128i phase, __m128 fm) {
+  // (fm + 4) * 2^29 does not fit in an int32. It is offset by 2^31, which
+  // is lost anyway in the shift by 3.
+  const __m128i pm = _mm_cvttps_epi32(_mm_sub_ps(
+      _mm_mul_ps(_mm_add_ps(fm, _mm_set1_ps(4.0f)), _mm_set1_ps(536870912.0f)),
+      _mm_set1_ps(2147483648.0f)));
+  phase = _mm_add_epi32(phase, _mm_slli_epi32(pm, 3));
+  
+  uint32_t integral[4];
+  _mm_storeu_si128((__m128i*) integral, _mm_srli_epi32(phase, 22));
+  // The low bit of phase << 10 is always 0, so that phase << 9 is converted
+  // exactly.
+  const __m128 fractional = _mm_mul_ps(
+      _mm_cvtepi32_ps(_mm_srli_epi32(_mm_slli_epi32(phase, 10), 1)),
+      _mm_set1_ps(1.0f / 2147483648.0f));
+  
+  // Each lane reads 2 consecutive values of the table.
+  __m128 ab_01 = _mm_setzero_ps();
+  __m128 ab_23 = _mm_setzero_ps();
+  ab_01 = _mm_loadl_pi(ab_01, (const __m64*) &lut_sine[integral[0]]);
+  ab_01 = _mm_loadh_pi(ab_01, (const __m64*) &lut_sine[integral[1]]);
+  ab_23 = _mm_loadl_pi(ab_23, (const __m64*) &lut_sine[integral[2]]);
+  ab_23 = _mm_loadh_pi(ab_23, (const __m64*) &lut_sine[integral[3]]);
+  const __m128 a = _mm_shuffle_ps(ab_01, ab_23, _MM_SHUFFLE(2, 0, 2, 0));
+  const __m128 b = _mm_shuffle_ps(ab_01, ab_23, _MM_SHUFFLE(3, 1, 3, 1));
+  return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), fractional));
+}
+
+#endif  // __SSE2__
+
 void FMEngine::Render(
     const EngineParameters& parameters,
     float* out,
@@ -132,6 +178,82 @@ void FMEngine::Render(
   ParameterInterpolator feedback_modulation(
       &previous_feedback_, 2.0f * parameters.morph - 1.0f, size);
   
+#ifdef __SSE2__
+  // Polyphase decimator: the kOversampling subsamples of a sample are
+  // weighted by the two halves of the FIR at once.
+  const __m128 fir_head = _mm_setr_ps(
+      fir_coefficient[3], fir_coefficient[2],
+      fir_coefficient[1], fir_coefficient[0]);
+  const __m128 fir_tail = _mm_loadu_ps(fir_coefficient);
+  
+  while (size--) {
+    const float amount = amount_modulation.Next();
+    const float feedback = feedback_modulation.Next();
+    const uint32_t carrier_increment = static_cast<uint32_t>(
+        4294967296.0f * carrier_frequency.Next());
+    float _modulator_frequency = modulator_frequency.Next();
+    
+    const __m128i carrier_phase = PhaseRamp(carrier_phase_, carrier_increment);
+    carrier_phase_ += carrier_increment * kOversampling;
+    
+    __m128 carrier;
+    float c[kOversampling];
+    if (feedback == 0.0f) {
+      // Without feedback, the 4 subsamples are independent. This only
+      // happens when MORPH is exactly at its centre.
+      const uint32_t modulator_increment = static_cast<uint32_t>(
+          4294967296.0f * _modulator_frequency);
+      const __m128 modulator = SinePM4(
+          PhaseRamp(modulator_phase_, modulator_increment),
+          _mm_setzero_ps());
+      modulator_phase_ += modulator_increment * kOversampling;
+      carrier = SinePM4(
+          carrier_phase, _mm_mul_ps(_mm_set1_ps(amount), modulator));
+      _mm_storeu_ps(c, carrier);
+      for (size_t j = 0; j < kOversampling; ++j) {
+        ONE_POLE(previous_sample_, c[j], 0.05f);
+      }
+    } else {
+      // Each subsample depends on the previous one through previous_sample_:
+      // the modulator and carrier remain a scalar chain.
+      float phase_feedback = feedback < 0.0f ? 0.5f * feedback * feedback : 0.0f;
+      float modulator_fb = feedback > 0.0f ? 0.25f * feedback * feedback : 0.0f;
+      uint32_t phase = carrier_phase_ - carrier_increment * kOversampling;
+      for (size_t j = 0; j < kOversampling; ++j) {
+        modulator_phase_ += static_cast<uint32_t>(4294967296.0f * \
+             _modulator_frequency * (1.0f + previous_sample_ * phase_feedback));
+        phase += carrier_increment;
+        float modulator = SinePM(
+            modulator_phase_, modulator_fb * previous_sample_);
+        c[j] = SinePM(phase, amount * modulator);
+        ONE_POLE(previous_sample_, c[j], 0.05f);
+      }
+      carrier = _mm_loadu_ps(c);
+    }
+    
+    // The sub oscillator is not in the feedback path: its 4 subsamples are
+    // always computed together.
+    const __m128 sub = SinePM4(
+        PhaseRamp(sub_phase_, carrier_increment >> 1),
+        _mm_mul_ps(_mm_set1_ps(amount * 0.25f), carrier));
+    sub_phase_ += (carrier_increment >> 1) * kOversampling;
+    
+    __m128 carrier_head = _mm_mul_ps(carrier, fir_head);
+    __m128 carrier_tail = _mm_mul_ps(carrier, fir_tail);
+    __m128 sub_head = _mm_mul_ps(sub, fir_head);
+    __m128 sub_tail = _mm_mul_ps(sub, fir_tail);
+    _MM_TRANSPOSE4_PS(carrier_head, carrier_tail, sub_head, sub_tail);
+    float fir[4];
+    _mm_storeu_ps(fir, _mm_add_ps(
+        _mm_add_ps(carrier_head, carrier_tail),
+        _mm_add_ps(sub_head, sub_tail)));
+    
+    *out++ = carrier_fir_ + fir[0];
+    *aux++ = sub_fir_ + fir[2];
+    carrier_fir_ = fir[1];
+    sub_fir_ = fir[3];
+  }
+#else
   Downsampler carrier_downsampler(&carrier_fir_);
   Downsampler sub_downsampler(&sub_fir_);
   
@@ -161,6 +283,7 @@ void FMEngine::Render(
     *out++ = carrier_downsampler.Read();
     *aux++ = sub_downsampler.Read();
   }
+#endif  // __SSE2__
 }
 
 }  // namespace plaits
@@ -38,9 +38,10 @@ using namespace stmlib;
 void SwarmEngine::Init(BufferAllocator* allocator) {
   const float n = (kNumSwarmVoices - 1) / 2;
   for (int i = 0; i < kNumSwarmVoices; ++i) {
-    float rank = (static_cast<float>(i) - n) / n;
-    swarm_voice_[i].Init(rank);
+    rank_[i] = (static_cast<float>(i) - n) / n;
   }
+  envelopes_.Init();
+  oscillators_.Init();
 }
 
 void SwarmEngine::Reset() { }
@@ -57,28 +58,33 @@ void SwarmEngine::Render(
       0.025f * control_rate;
   const float spread = parameters.harmonics * parameters.harmonics * \
       parameters.harmonics;
-  float size_ratio = 0.25f * SemitonesToRatio(
-      (1.0f - parameters.morph) * 84.0f);
   
   const bool burst_mode = !(parameters.trigger & TRIGGER_UNPATCHED);
   const bool start_burst = parameters.trigger & TRIGGER_RISING_EDGE;
-
-  fill(&out[0], &out[size], 0.0f);
-  fill(&aux[0], &aux[size], 0.0f);
   
+  float size_ratio[kNumSwarmVoices];
+  size_ratio[0] = 0.25f * SemitonesToRatio(
+      (1.0f - parameters.morph) * 84.0f);
+  for (int i = 1; i < kNumSwarmVoices; ++i) {
+    size_ratio[i] = size_ratio[i - 1] * 0.97f;
+  }
+  
+  float expo_amount[kNumSwarmVoices];
+  float amplitude[kNumSwarmVoices];
+  envelopes_.Step(density, burst_mode, start_burst);
+  envelopes_.Render(size_ratio, expo_amount, amplitude);
+  
+  const float scale = 1.0f / kNumSwarmVoices;
+  float frequency[kNumSwarmVoices];
   for (int i = 0; i < kNumSwarmVoices; ++i) {
-    swarm_voice_[i].Render(
-        f0,
-        density,
-        burst_mode,
-        start_burst,
-        spread,
-        size_ratio,
-        out,
-        aux,
-        size);
-    size_ratio *= 0.97f;
+    const float rank = rank_[i];
+    const float linear_amount = rank * (rank + 0.01f) * spread * 0.25f;
+    frequency[i] = f0 * SemitonesToRatio(48.0f * expo_amount[i] * spread * rank);
+    frequency[i] *= 1.0f + linear_amount;
+    amplitude[i] *= scale;
   }
+  
+  oscillators_.Render(frequency, amplitude, out, aux, size);
 }
 
 }  // namespace plaits
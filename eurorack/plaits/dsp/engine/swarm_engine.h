@@ -29,6 +29,10 @@
 #ifndef PLAITS_DSP_ENGINE_SWARM_ENGINE_H_
 #define PLAITS_DSP_ENGINE_SWARM_ENGINE_H_
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif  // __SSE__
+
 #include "stmlib/dsp/polyblep.h"
 #include "stmlib/dsp/units.h"
 #include "stmlib/utils/random.h"
@@ -43,192 +47,284 @@ namespace plaits {
 
 const int kNumSwarmVoices = 8;
 
-class GrainEnvelope {
+// The grain envelopes of all the voices of the swarm. They are stored as
+// arrays, one element per voice, and stepped together once per block.
+class GrainEnvelopeBank {
  public:
-  GrainEnvelope() { }
-  ~GrainEnvelope() { }
+  GrainEnvelopeBank() { }
+  ~GrainEnvelopeBank() { }
   
   void Init() {
-    from_ = 0.0f;
-    interval_ = 1.0f;
-    phase_ = 1.0f;
-    fm_ = 0.0f;
-    amplitude_ = 0.5f;
-    previous_size_ratio_ = 0.0f;
+    for (int i = 0; i < kNumSwarmVoices; ++i) {
+      from_[i] = 0.0f;
+      interval_[i] = 1.0f;
+      phase_[i] = 1.0f;
+      fm_[i] = 0.0f;
+      amplitude_[i] = 0.5f;
+      previous_size_ratio_[i] = 0.0f;
+      filter_coefficient_[i] = 0.0f;
+    }
   }
   
   inline void Step(float rate, bool burst_mode, bool start_burst) {
-    bool randomize = false;
+    bool randomize[kNumSwarmVoices];
     if (start_burst) {
-      phase_ = 0.5f;
-      fm_ = 16.0f;
-      randomize = true;
+      for (int i = 0; i < kNumSwarmVoices; ++i) {
+        phase_[i] = 0.5f;
+        fm_[i] = 16.0f;
+        randomize[i] = true;
+      }
     } else {
-      phase_ += rate * fm_;
-      if (phase_ >= 1.0f) {
-        phase_ -= static_cast<float>(static_cast<int>(phase_));
-        randomize = true;
+      for (int i = 0; i < kNumSwarmVoices; ++i) {
+        phase_[i] += rate * fm_[i];
+        randomize[i] = phase_[i] >= 1.0f;
+        if (randomize[i]) {
+          phase_[i] -= static_cast<float>(static_cast<int>(phase_[i]));
+        }
       }
     }
     
-    if (randomize) {
-      from_ += interval_;
-      interval_ = stmlib::Random::GetFloat() - from_;
-      // Randomize the duration of the grain.
-      if (burst_mode) {
-        fm_ *= 0.8f + 0.2f * stmlib::Random::GetFloat();
-      } else {
-        fm_ = 0.5f + 1.5f * stmlib::Random::GetFloat();
+    // The random numbers are drawn in voice order.
+    for (int i = 0; i < kNumSwarmVoices; ++i) {
+      if (randomize[i]) {
+        from_[i] += interval_[i];
+        interval_[i] = stmlib::Random::GetFloat() - from_[i];
+        // Randomize the duration of the grain.
+        if (burst_mode) {
+          fm_[i] *= 0.8f + 0.2f * stmlib::Random::GetFloat();
+        } else {
+          fm_[i] = 0.5f + 1.5f * stmlib::Random::GetFloat();
+        }
       }
     }
   }
   
-  inline float frequency(float size_ratio) const {
-    // We approximate two overlapping grains of frequencies f1 and f2
-    // By a continuous tone ramping from f1 to f2. This allows a continuous
-    // transition between the "grain cloud" and "swarm of glissandi" textures.
-    if (size_ratio < 1.0f) {
-      return 2.0f * (from_ + interval_ * phase_) - 1.0f;
-    } else {
-      return from_;
-    }
-  }
-  
-  inline float amplitude(float size_ratio) {
-    float target_amplitude = 1.0f;
-    if (size_ratio >= 1.0f) {
-      float phase = (phase_ - 0.5f) * size_ratio;
-      CONSTRAIN(phase, -1.0f, 1.0f);
-      float e = stmlib::InterpolateWrap(
-          lut_sine, 0.5f * phase + 1.25f, 1024.0f);
-      target_amplitude = 0.5f * (e + 1.0f);
-    }
-    
-    if ((size_ratio >= 1.0f) ^ (previous_size_ratio_ >= 1.0f)) {
-      filter_coefficient_ = 0.5f;
+  inline void Render(
+      const float* size_ratio,
+      float* frequency,
+      float* amplitude) {
+    for (int i = 0; i < kNumSwarmVoices; ++i) {
+      // We approximate two overlapping grains of frequencies f1 and f2
+      // By a continuous tone ramping from f1 to f2. This allows a continuous
+      // transition between the "grain cloud" and "swarm of glissandi"
+      // textures.
+      float target_amplitude = 1.0f;
+      if (size_ratio[i] < 1.0f) {
+        frequency[i] = 2.0f * (from_[i] + interval_[i] * phase_[i]) - 1.0f;
+      } else {
+        frequency[i] = from_[i];
+        float phase = (phase_[i] - 0.5f) * size_ratio[i];
+        CONSTRAIN(phase, -1.0f, 1.0f);
+        float e = stmlib::InterpolateWrap(
+            lut_sine, 0.5f * phase + 1.25f, 1024.0f);
+        target_amplitude = 0.5f * (e + 1.0f);
+      }
+      
+      if ((size_ratio[i] >= 1.0f) ^ (previous_size_ratio_[i] >= 1.0f)) {
+        filter_coefficient_[i] = 0.5f;
+      }
+      filter_coefficient_[i] *= 0.95f;
+      
+      previous_size_ratio_[i] = size_ratio[i];
+      ONE_POLE(amplitude_[i], target_amplitude, 0.5f - filter_coefficient_[i]);
+      amplitude[i] = amplitude_[i];
     }
-    filter_coefficient_ *= 0.95f;
-    
-    previous_size_ratio_ = size_ratio;
-    ONE_POLE(amplitude_, target_amplitude, 0.5f - filter_coefficient_);
-    return amplitude_;
   }
   
  private:
-  float from_;
-  float interval_;
-  float phase_;
-  float fm_;
-  float amplitude_;
-  float previous_size_ratio_;
-  float filter_coefficient_;
+  float from_[kNumSwarmVoices];
+  float interval_[kNumSwarmVoices];
+  float phase_[kNumSwarmVoices];
+  float fm_[kNumSwarmVoices];
+  float amplitude_[kNumSwarmVoices];
+  float previous_size_ratio_[kNumSwarmVoices];
+  float filter_coefficient_[kNumSwarmVoices];
   
-  DISALLOW_COPY_AND_ASSIGN(GrainEnvelope);
+  DISALLOW_COPY_AND_ASSIGN(GrainEnvelopeBank);
 };
 
-class AdditiveSawOscillator {
+// The sawtooth (additive polyBLEP) and sine (FastSineOscillator) oscillators
+// of all the voices of the swarm, rendered side by side and mixed together.
+class SwarmOscillatorBank {
  public:
-  AdditiveSawOscillator() { }
-  ~AdditiveSawOscillator() { }
-
-  inline void Init() {
-    phase_ = 0.0f;
-    next_sample_ = 0.0f;
-    frequency_ = 0.01f;
-    gain_ = 0.0f;
-  }
-
-  inline void Render(
-      float frequency,
-      float level,
-      float* out,
-      size_t size) {
-    if (frequency >= kMaxFrequency) {
-      frequency = kMaxFrequency;
-    }
-    stmlib::ParameterInterpolator fm(&frequency_, frequency, size);
-    stmlib::ParameterInterpolator gain(&gain_, level, size);
-
-    float next_sample = next_sample_;
-    float phase = phase_;
-
-    while (size--) {
-      float this_sample = next_sample;
-      next_sample = 0.0f;
-
-      const float frequency = fm.Next();
-
-      phase += frequency;
+  SwarmOscillatorBank() { }
+  ~SwarmOscillatorBank() { }
   
-      if (phase >= 1.0f) {
-        phase -= 1.0f;
-        float t = phase / frequency;
-        this_sample -= stmlib::ThisBlepSample(t);
-        next_sample -= stmlib::NextBlepSample(t);
-      }
-
-      next_sample += phase;
-      *out++ += (2.0f * this_sample - 1.0f) * gain.Next();
+  void Init() {
+    for (int i = 0; i < kNumSwarmVoices; ++i) {
+      saw_phase_[i] = 0.0f;
+      saw_next_sample_[i] = 0.0f;
+      saw_frequency_[i] = 0.01f;
+      saw_gain_[i] = 0.0f;
+      
+      sine_x_[i] = 1.0f;
+      sine_y_[i] = 0.0f;
+      sine_epsilon_[i] = 0.0f;
+      sine_gain_[i] = 0.0f;
     }
-    phase_ = phase;
-    next_sample_ = next_sample;
-  }
-
- private:
-  // Oscillator state.
-  float phase_;
-  float next_sample_;
-
-  // For interpolation of parameters.
-  float frequency_;
-  float gain_;
-
-  DISALLOW_COPY_AND_ASSIGN(AdditiveSawOscillator);
-};
-
-class SwarmVoice {
- public:
-  SwarmVoice() { }
-  ~SwarmVoice() { }
-  
-  void Init(float rank) {
-    rank_ = rank;
-    envelope_.Init();
-    saw_.Init();
-    sine_.Init();
   }
   
   void Render(
-      float f0,
-      float density,
-      bool burst_mode,
-      bool start_burst,
-      float spread,
-      float size_ratio,
+      const float* frequency,
+      const float* amplitude,
       float* saw,
       float* sine,
       size_t size) {
-    envelope_.Step(density, burst_mode, start_burst);
+    const float n = static_cast<float>(size);
     
-    const float scale = 1.0f / kNumSwarmVoices;
-    const float amplitude = envelope_.amplitude(size_ratio) * scale;
-
-    const float expo_amount = envelope_.frequency(size_ratio);
-    f0 *= stmlib::SemitonesToRatio(48.0f * expo_amount * spread * rank_);
+    float saw_frequency_increment[kNumSwarmVoices];
+    float saw_gain_increment[kNumSwarmVoices];
+    float sine_epsilon_increment[kNumSwarmVoices];
+    float sine_gain_increment[kNumSwarmVoices];
     
-    const float linear_amount = rank_ * (rank_ + 0.01f) * spread * 0.25f;
-    f0 *= 1.0f + linear_amount;
+    for (int i = 0; i < kNumSwarmVoices; ++i) {
+      float f = frequency[i];
+      float sine_amplitude = amplitude[i];
+      if (f >= kMaxFrequency) {
+        f = kMaxFrequency;
+        sine_amplitude = 0.0f;
+      } else {
+        sine_amplitude *= 1.0f - f * 4.0f;
+      }
+      saw_frequency_increment[i] = (f - saw_frequency_[i]) / n;
+      saw_gain_increment[i] = (amplitude[i] - saw_gain_[i]) / n;
+      sine_epsilon_increment[i] = (FastSineOscillator::Fast2Sin(f) - \
+          sine_epsilon_[i]) / n;
+      sine_gain_increment[i] = (sine_amplitude - sine_gain_[i]) / n;
+      
+      const float norm = sine_x_[i] * sine_x_[i] + sine_y_[i] * sine_y_[i];
+      if (norm <= 0.5f || norm >= 2.0f) {
+        const float scale = stmlib::fast_rsqrt_carmack(norm);
+        sine_x_[i] *= scale;
+        sine_y_[i] *= scale;
+      }
+    }
 
-    saw_.Render(f0, amplitude, saw, size);
-    sine_.Render(f0, amplitude, sine, size);
-  };
+#ifdef __SSE__
+    __m128 saw_phase[kNumBatches];
+    __m128 saw_next_sample[kNumBatches];
+    __m128 saw_frequency[kNumBatches];
+    __m128 saw_frequency_inc[kNumBatches];
+    __m128 saw_gain[kNumBatches];
+    __m128 saw_gain_inc[kNumBatches];
+    __m128 sine_x[kNumBatches];
+    __m128 sine_y[kNumBatches];
+    __m128 sine_epsilon[kNumBatches];
+    __m128 sine_epsilon_inc[kNumBatches];
+    __m128 sine_gain[kNumBatches];
+    __m128 sine_gain_inc[kNumBatches];
+    for (int i = 0; i < kNumBatches; ++i) {
+      saw_phase[i] = _mm_loadu_ps(&saw_phase_[i * 4]);
+      saw_next_sample[i] = _mm_loadu_ps(&saw_next_sample_[i * 4]);
+      saw_frequency[i] = _mm_loadu_ps(&saw_frequency_[i * 4]);
+      saw_frequency_inc[i] = _mm_loadu_ps(&saw_frequency_increment[i * 4]);
+      saw_gain[i] = _mm_loadu_ps(&saw_gain_[i * 4]);
+      saw_gain_inc[i] = _mm_loadu_ps(&saw_gain_increment[i * 4]);
+      sine_x[i] = _mm_loadu_ps(&sine_x_[i * 4]);
+      sine_y[i] = _mm_loadu_ps(&sine_y_[i * 4]);
+      sine_epsilon[i] = _mm_loadu_ps(&sine_epsilon_[i * 4]);
+      sine_epsilon_inc[i] = _mm_loadu_ps(&sine_epsilon_increment[i * 4]);
+      sine_gain[i] = _mm_loadu_ps(&sine_gain_[i * 4]);
+      sine_gain_inc[i] = _mm_loadu_ps(&sine_gain_increment[i * 4]);
+    }
+    
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    
+    while (size--) {
+      __m128 saw_sum = _mm_setzero_ps();
+      __m128 sine_sum = _mm_setzero_ps();
+      for (int i = 0; i < kNumBatches; ++i) {
+        __m128 this_sample = saw_next_sample[i];
+        saw_frequency[i] = _mm_add_ps(saw_frequency[i], saw_frequency_inc[i]);
+        saw_phase[i] = _mm_add_ps(saw_phase[i], saw_frequency[i]);
+        
+        // polyBLEP correction of the lanes which have wrapped around.
+        const __m128 wrap = _mm_cmpge_ps(saw_phase[i], one);
+        saw_phase[i] = _mm_sub_ps(saw_phase[i], _mm_and_ps(wrap, one));
+        const __m128 t = _mm_div_ps(saw_phase[i], saw_frequency[i]);
+        const __m128 t_1 = _mm_sub_ps(one, t);
+        this_sample = _mm_sub_ps(this_sample, _mm_and_ps(
+            wrap, _mm_mul_ps(half, _mm_mul_ps(t, t))));
+        saw_next_sample[i] = _mm_add_ps(saw_phase[i], _mm_and_ps(
+            wrap, _mm_mul_ps(half, _mm_mul_ps(t_1, t_1))));
+        
+        saw_gain[i] = _mm_add_ps(saw_gain[i], saw_gain_inc[i]);
+        saw_sum = _mm_add_ps(saw_sum, _mm_mul_ps(
+            _mm_sub_ps(_mm_mul_ps(two, this_sample), one), saw_gain[i]));
+        
+        sine_epsilon[i] = _mm_add_ps(sine_epsilon[i], sine_epsilon_inc[i]);
+        sine_x[i] = _mm_add_ps(sine_x[i], _mm_mul_ps(sine_epsilon[i], sine_y[i]));
+        sine_y[i] = _mm_sub_ps(sine_y[i], _mm_mul_ps(sine_epsilon[i], sine_x[i]));
+        sine_gain[i] = _mm_add_ps(sine_gain[i], sine_gain_inc[i]);
+        sine_sum = _mm_add_ps(sine_sum, _mm_mul_ps(sine_gain[i], sine_x[i]));
+      }
+      
+      // Sum of the 4 lanes.
+      saw_sum = _mm_add_ps(saw_sum, _mm_movehl_ps(saw_sum, saw_sum));
+      saw_sum = _mm_add_ss(saw_sum, _mm_shuffle_ps(saw_sum, saw_sum, 1));
+      sine_sum = _mm_add_ps(sine_sum, _mm_movehl_ps(sine_sum, sine_sum));
+      sine_sum = _mm_add_ss(sine_sum, _mm_shuffle_ps(sine_sum, sine_sum, 1));
+      *saw++ = _mm_cvtss_f32(saw_sum);
+      *sine++ = _mm_cvtss_f32(sine_sum);
+    }
+    
+    for (int i = 0; i < kNumBatches; ++i) {
+      _mm_storeu_ps(&saw_phase_[i * 4], saw_phase[i]);
+      _mm_storeu_ps(&saw_next_sample_[i * 4], saw_next_sample[i]);
+      _mm_storeu_ps(&saw_frequency_[i * 4], saw_frequency[i]);
+      _mm_storeu_ps(&saw_gain_[i * 4], saw_gain[i]);
+      _mm_storeu_ps(&sine_x_[i * 4], sine_x[i]);
+      _mm_storeu_ps(&sine_y_[i * 4], sine_y[i]);
+      _mm_storeu_ps(&sine_epsilon_[i * 4], sine_epsilon[i]);
+      _mm_storeu_ps(&sine_gain_[i * 4], sine_gain[i]);
+    }
+#else
+    while (size--) {
+      float saw_sum = 0.0f;
+      float sine_sum = 0.0f;
+      for (int i = 0; i < kNumSwarmVoices; ++i) {
+        float this_sample = saw_next_sample_[i];
+        float next_sample = 0.0f;
+        saw_frequency_[i] += saw_frequency_increment[i];
+        saw_phase_[i] += saw_frequency_[i];
+        if (saw_phase_[i] >= 1.0f) {
+          saw_phase_[i] -= 1.0f;
+          float t = saw_phase_[i] / saw_frequency_[i];
+          this_sample -= stmlib::ThisBlepSample(t);
+          next_sample -= stmlib::NextBlepSample(t);
+        }
+        saw_next_sample_[i] = next_sample + saw_phase_[i];
+        saw_gain_[i] += saw_gain_increment[i];
+        saw_sum += (2.0f * this_sample - 1.0f) * saw_gain_[i];
+        
+        sine_epsilon_[i] += sine_epsilon_increment[i];
+        sine_x_[i] += sine_epsilon_[i] * sine_y_[i];
+        sine_y_[i] -= sine_epsilon_[i] * sine_x_[i];
+        sine_gain_[i] += sine_gain_increment[i];
+        sine_sum += sine_gain_[i] * sine_x_[i];
+      }
+      *saw++ = saw_sum;
+      *sine++ = sine_sum;
+    }
+#endif  // __SSE__
+  }
   
  private:
-  float rank_;
-
-  GrainEnvelope envelope_;
-  AdditiveSawOscillator saw_;
-  FastSineOscillator sine_;
+  static const int kNumBatches = kNumSwarmVoices / 4;
+  
+  float saw_phase_[kNumSwarmVoices];
+  float saw_next_sample_[kNumSwarmVoices];
+  float saw_frequency_[kNumSwarmVoices];
+  float saw_gain_[kNumSwarmVoices];
+  
+  float sine_x_[kNumSwarmVoices];
+  float sine_y_[kNumSwarmVoices];
+  float sine_epsilon_[kNumSwarmVoices];
+  float sine_gain_[kNumSwarmVoices];
+  
+  DISALLOW_COPY_AND_ASSIGN(SwarmOscillatorBank);
 };
 
 class SwarmEngine : public Engine {
@@ -245,7 +341,10 @@ class SwarmEngine : public Engine {
       bool* already_enveloped);
   
  private:
-  SwarmVoice swarm_voice_[kNumSwarmVoices];
+  float rank_[kNumSwarmVoices];
+  
+  GrainEnvelopeBank envelopes_;
+  SwarmOscillatorBank oscillators_;
   
   DISALLOW_COPY_AND_ASSIGN(SwarmEngine);
 };
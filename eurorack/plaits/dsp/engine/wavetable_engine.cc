@@ -30,6 +30,10 @@
 
 #include <algorithm>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif  // __SSE2__
+
 #include "plaits/resources.h"
 
 namespace plaits {
@@ -54,6 +58,8 @@ void WavetableEngine::Init(BufferAllocator* allocator) {
   previous_f0_ = a0;
 
   diff_out_.Init();
+  
+  set_waves(NULL);
 }
 
 void WavetableEngine::Reset() {
@@ -71,20 +77,82 @@ inline float Clamp(float x, float amount) {
 const size_t table_size = 256;
 const float table_size_f = float(table_size);
 
-inline float ReadWave(
-    int x,
-    int y,
-    int z,
-    int randomize,
-    int phase_integral,
-    float phase_fractional) {
-  int wave = ((x + y * 8 + z * 64) * randomize) % 192;
-  return InterpolateWaveHermite(
-      wav_integrated_waves + wave * (table_size + 4),
-      phase_integral,
-      phase_fractional);
+void WavetableEngine::ComputeCorners(int x, int y, int z) {
+  cell_x_ = x;
+  cell_y_ = y;
+  cell_z_ = z;
+  
+  int z0 = z;
+  int z1 = z + 1;
+  
+  if (z0 >= 4) {
+    z0 = 7 - z0;
+  }
+  if (z1 >= 4) {
+    z1 = 7 - z1;
+  }
+  
+  int r0 = z0 == 3 ? 101 : 1;
+  int r1 = z1 == 3 ? 101 : 1;
+  
+  for (int i = 0; i < 2; ++i) {
+    const int xi = x + i;
+    const int wave[4] = {
+      ((xi + y * 8 + z0 * 64) * r0) % 192,
+      ((xi + (y + 1) * 8 + z0 * 64) * r0) % 192,
+      ((xi + y * 8 + z1 * 64) * r1) % 192,
+      ((xi + (y + 1) * 8 + z1 * 64) * r1) % 192
+    };
+    for (int j = 0; j < 4; ++j) {
+      corners_[i * 4 + j] = waves_ + wave[j] * (table_size + 4);
+    }
+  }
+}
+
+#ifdef __SSE2__
+
+// Reads the 4 samples around p_integral in 4 waves, and returns them
+// transposed: one vector per sample position, one lane per wave.
+static inline void ReadWaves(
+    const int16_t* const* waves,
+    int p_integral,
+    __m128* xm1,
+    __m128* x0,
+    __m128* x1,
+    __m128* x2) {
+  __m128 w[4];
+  for (int i = 0; i < 4; ++i) {
+    const __m128i s = _mm_loadl_epi64(
+        (const __m128i*) (waves[i] + p_integral));
+    w[i] = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+  }
+  _MM_TRANSPOSE4_PS(w[0], w[1], w[2], w[3]);
+  *xm1 = w[0];
+  *x0 = w[1];
+  *x1 = w[2];
+  *x2 = w[3];
+}
+
+// InterpolateWaveHermite, on 4 waves at once.
+static inline __m128 InterpolateWavesHermite(
+    const int16_t* const* waves,
+    int p_integral,
+    __m128 f) {
+  __m128 xm1, x0, x1, x2;
+  ReadWaves(waves, p_integral, &xm1, &x0, &x1, &x2);
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 c = _mm_mul_ps(_mm_sub_ps(x1, xm1), half);
+  const __m128 v = _mm_sub_ps(x0, x1);
+  const __m128 w = _mm_add_ps(c, v);
+  const __m128 a = _mm_add_ps(
+      _mm_add_ps(w, v), _mm_mul_ps(_mm_sub_ps(x2, x0), half));
+  const __m128 b_neg = _mm_add_ps(w, a);
+  return _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(
+      _mm_mul_ps(a, f), b_neg), f), c), f), x0);
 }
 
+#endif  // __SSE2__
+
 void WavetableEngine::Render(
     const EngineParameters& parameters,
     float* out,
@@ -148,49 +216,45 @@ void WavetableEngine::Render(
     const float p = phase_ * table_size_f;
     MAKE_INTEGRAL_FRACTIONAL(p);
     
-    {
-      int x0 = x_integral;
-      int x1 = x_integral + 1;
-      int y0 = y_integral;
-      int y1 = y_integral + 1;
-      int z0 = z_integral;
-      int z1 = z_integral + 1;
-      
-      if (z0 >= 4) {
-        z0 = 7 - z0;
-      }
-      if (z1 >= 4) {
-        z1 = 7 - z1;
-      }
-      
-      int r0 = z0 == 3 ? 101 : 1;
-      int r1 = z1 == 3 ? 101 : 1;
-
-      float x0y0z0 = ReadWave(x0, y0, z0, r0, p_integral, p_fractional);
-      float x1y0z0 = ReadWave(x1, y0, z0, r0, p_integral, p_fractional);
-      float xy0z0 = x0y0z0 + (x1y0z0 - x0y0z0) * x_fractional;
-
-      float x0y1z0 = ReadWave(x0, y1, z0, r0, p_integral, p_fractional); 
-      float x1y1z0 = ReadWave(x1, y1, z0, r0, p_integral, p_fractional);
-      float xy1z0 = x0y1z0 + (x1y1z0 - x0y1z0) * x_fractional;
-
-      float xyz0 = xy0z0 + (xy1z0 - xy0z0) * y_fractional;
-
-      float x0y0z1 = ReadWave(x0, y0, z1, r1, p_integral, p_fractional);
-      float x1y0z1 = ReadWave(x1, y0, z1, r1, p_integral, p_fractional);
-      float xy0z1 = x0y0z1 + (x1y0z1 - x0y0z1) * x_fractional;
-
-      float x0y1z1 = ReadWave(x0, y1, z1, r1, p_integral, p_fractional);
-      float x1y1z1 = ReadWave(x1, y1, z1, r1, p_integral, p_fractional);
-      float xy1z1 = x0y1z1 + (x1y1z1 - x0y1z1) * x_fractional;
-      
-      float xyz1 = xy0z1 + (xy1z1 - xy0z1) * y_fractional;
-
-      float mix = xyz0 + (xyz1 - xyz0) * z_fractional;
-      mix = diff_out_.Process(cutoff, mix) * gain;
-      *out++ = mix;
-      *aux++ = static_cast<float>(static_cast<int>(mix * 32.0f)) / 32.0f;
+    // The wave indices only change when another cell of the terrain is
+    // entered.
+    if (x_integral != cell_x_ || y_integral != cell_y_ ||
+        z_integral != cell_z_) {
+      ComputeCorners(x_integral, y_integral, z_integral);
     }
+    
+#ifdef __SSE2__
+    // Lanes: (y0, z0), (y1, z0), (y0, z1), (y1, z1).
+    const __m128 p_f = _mm_set1_ps(p_fractional);
+    const __m128 x0yz = InterpolateWavesHermite(&corners_[0], p_integral, p_f);
+    const __m128 x1yz = InterpolateWavesHermite(&corners_[4], p_integral, p_f);
+    const __m128 xyz = _mm_add_ps(x0yz, _mm_mul_ps(
+        _mm_sub_ps(x1yz, x0yz), _mm_set1_ps(x_fractional)));
+    const __m128 xy1z = _mm_shuffle_ps(xyz, xyz, _MM_SHUFFLE(2, 3, 0, 1));
+    const __m128 xz = _mm_add_ps(xyz, _mm_mul_ps(
+        _mm_sub_ps(xy1z, xyz), _mm_set1_ps(y_fractional)));
+    const float xyz0 = _mm_cvtss_f32(xz);
+    const float xyz1 = _mm_cvtss_f32(_mm_movehl_ps(xz, xz));
+#else
+    float corner[8];
+    for (int i = 0; i < 8; ++i) {
+      corner[i] = InterpolateWaveHermite(
+          corners_[i], p_integral, p_fractional);
+    }
+    
+    float xy0z0 = corner[0] + (corner[4] - corner[0]) * x_fractional;
+    float xy1z0 = corner[1] + (corner[5] - corner[1]) * x_fractional;
+    float xyz0 = xy0z0 + (xy1z0 - xy0z0) * y_fractional;
+    
+    float xy0z1 = corner[2] + (corner[6] - corner[2]) * x_fractional;
+    float xy1z1 = corner[3] + (corner[7] - corner[3]) * x_fractional;
+    float xyz1 = xy0z1 + (xy1z1 - xy0z1) * y_fractional;
+#endif  // __SSE2__
+    
+    float mix = xyz0 + (xyz1 - xyz0) * z_fractional;
+    mix = diff_out_.Process(cutoff, mix) * gain;
+    *out++ = mix;
+    *aux++ = static_cast<float>(static_cast<int>(mix * 32.0f)) / 32.0f;
   }
 }
 
@@ -33,6 +33,7 @@
 
 #include "plaits/dsp/engine/engine.h"
 #include "plaits/dsp/oscillator/wavetable_oscillator.h"
+#include "plaits/resources.h"
 
 namespace plaits {
 
@@ -49,7 +50,28 @@ class WavetableEngine : public Engine {
       size_t size,
       bool* already_enveloped);
   
+  // Replaces the built-in waves with 192 user waves, in the same integrated
+  // format (256 + 4 samples per wave). The waves are not copied, and can be
+  // shared by several engines. NULL restores the built-in waves.
+  inline void set_waves(const int16_t* waves) {
+    waves_ = waves ? waves : wav_integrated_waves;
+    cell_x_ = -1;
+  }
+  
  private:
+  void ComputeCorners(int x, int y, int z);
+  
+  const int16_t* waves_;
+  
+  // Cell of the wave terrain in which the corners were last computed.
+  int cell_x_;
+  int cell_y_;
+  int cell_z_;
+  
+  // The 8 waves at the corners of the cell: first the 4 (y, z) combinations
+  // for x, then the same for x + 1.
+  const int16_t* corners_[8];
+  
   float phase_;
   
   float x_pre_lp_;
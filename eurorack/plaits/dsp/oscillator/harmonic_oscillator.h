@@ -31,9 +31,12 @@
 #ifndef PLAITS_DSP_OSCILLATOR_HARMONIC_OSCILLATOR_H_
 #define PLAITS_DSP_OSCILLATOR_HARMONIC_OSCILLATOR_H_
 
+#include <algorithm>
+
 #include "stmlib/dsp/dsp.h"
 #include "stmlib/dsp/parameter_interpolator.h"
 
+#include "plaits/dsp/dsp.h"
 #include "plaits/resources.h"
 
 namespace plaits {
@@ -62,45 +65,69 @@ class HarmonicOscillator {
       frequency = 0.5f;
     }
     
-    stmlib::ParameterInterpolator am[num_harmonics];
-    stmlib::ParameterInterpolator fm(&frequency_, frequency, size);
+    // The recurrence is sequential over the harmonics, but independent from
+    // one sample to the next. The block is thus rendered with the samples as
+    // the SIMD lanes: the per-sample state is computed first, then the
+    // recurrence advances all the samples at once, one harmonic at a time.
+    float two_x[kMaxBlockSize];
+    float previous[kMaxBlockSize];
+    float current[kMaxBlockSize];
+    float sum[kMaxBlockSize];
+    // Amplitude of each harmonic on each sample.
+    float am[num_harmonics][kMaxBlockSize];
     
+    float amplitude[num_harmonics];
+    float increment[num_harmonics];
     for (int i = 0; i < num_harmonics; ++i) {
       float f = frequency * static_cast<float>(first_harmonic_index + i);
       if (f >= 0.5f) {
         f = 0.5f;
       }
-      am[i].Init(&amplitude_[i], amplitudes[i] * (1.0f - f * 2.0f), size);
+      amplitude[i] = amplitude_[i];
+      increment[i] = (amplitudes[i] * (1.0f - f * 2.0f) - amplitude_[i]) / \
+          static_cast<float>(size);
+    }
+    for (size_t j = 0; j < size; ++j) {
+      for (int i = 0; i < num_harmonics; ++i) {
+        amplitude[i] += increment[i];
+        am[i][j] = amplitude[i];
+      }
     }
+    std::copy(&amplitude[0], &amplitude[num_harmonics], &amplitude_[0]);
 
-    while (size--) {
+    stmlib::ParameterInterpolator fm(&frequency_, frequency, size);
+    for (size_t j = 0; j < size; ++j) {
       phase_ += fm.Next();
       if (phase_ >= 1.0f) {
         phase_ -= 1.0f;
       }
-      const float two_x = 2.0f * stmlib::Interpolate(lut_sine, phase_, 1024.0f);
-      float previous, current;
+      two_x[j] = 2.0f * stmlib::Interpolate(lut_sine, phase_, 1024.0f);
       if (first_harmonic_index == 1) {
-        previous = 1.0f;
-        current = two_x * 0.5f;
+        previous[j] = 1.0f;
+        current[j] = two_x[j] * 0.5f;
       } else {
         const float k = first_harmonic_index;
-        previous = stmlib::InterpolateWrap(
+        previous[j] = stmlib::InterpolateWrap(
             lut_sine, phase_ * (k - 1.0f) + 0.25f, 1024.0f);
-        current = stmlib::InterpolateWrap(lut_sine, phase_ * k, 1024.0f);
+        current[j] = stmlib::InterpolateWrap(lut_sine, phase_ * k, 1024.0f);
       }
-      
-      float sum = 0.0f;
-      for (int i = 0; i < num_harmonics; ++i) {
-        sum += am[i].Next() * current;
-        float temp = current;
-        current = two_x * current - previous;
-        previous = temp;
+      sum[j] = 0.0f;
+    }
+    
+    for (int i = 0; i < num_harmonics; ++i) {
+      for (size_t j = 0; j < size; ++j) {
+        sum[j] += am[i][j] * current[j];
+        float temp = current[j];
+        current[j] = two_x[j] * current[j] - previous[j];
+        previous[j] = temp;
       }
+    }
+    
+    for (size_t j = 0; j < size; ++j) {
       if (first_harmonic_index == 1) {
-        *out++ = sum;
+        out[j] = sum[j];
       } else {
-        *out++ += sum;
+        out[j] += sum[j];
       }
     }
   }
@@ -40,6 +40,10 @@
 
 #include <algorithm>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif  // __SSE2__
+
 #include "stmlib/dsp/dsp.h"
 #include "stmlib/dsp/parameter_interpolator.h"
 #include "stmlib/dsp/polyblep.h"
@@ -173,6 +177,311 @@ class StringSynthOscillator {
 
   DISALLOW_COPY_AND_ASSIGN(StringSynthOscillator);
 };
+
+// num_lanes StringSynthOscillators sharing the same registration, rendered
+// side by side. Only the lanes whose bit is set in active_mask are rendered:
+// the others are silent and keep their state, like an oscillator that is not
+// called. Each lane is mixed into out, and also into aux when its bit is set
+// in aux_mask. On x86, num_lanes must be a multiple of 4.
+template<int num_lanes>
+class StringSynthOscillatorBank {
+ public:
+  StringSynthOscillatorBank() { }
+  ~StringSynthOscillatorBank() { }
+  
+  inline void Init() {
+    for (int i = 0; i < num_lanes; ++i) {
+      phase_[i] = 0.0f;
+      next_sample_[i] = 0.0f;
+      segment_[i] = 0;
+      
+      frequency_[i] = 0.001f;
+      saw_8_gain_[i] = 0.0f;
+      saw_4_gain_[i] = 0.0f;
+      saw_2_gain_[i] = 0.0f;
+      saw_1_gain_[i] = 0.0f;
+    }
+  }
+  
+  inline void Render(
+      const float* frequency,
+      const float* unshifted_registration,
+      const float* gain,
+      int active_mask,
+      int aux_mask,
+      float* out,
+      float* aux,
+      size_t size) {
+    const float n = static_cast<float>(size);
+    float frequency_increment[num_lanes];
+    float saw_8_gain_increment[num_lanes];
+    float saw_4_gain_increment[num_lanes];
+    float saw_2_gain_increment[num_lanes];
+    float saw_1_gain_increment[num_lanes];
+    
+    for (int i = 0; i < num_lanes; ++i) {
+      float f = frequency[i] * 8.0f;
+      float g = gain[i];
+      
+      // See StringSynthOscillator::Render.
+      size_t shift = 0;
+      while (f > 0.5f) {
+        shift += 2;
+        f *= 0.5f;
+      }
+      if (shift >= 8) {
+        shift = 7;
+        g = 0.0f;
+      }
+      
+      float registration[7];
+      std::fill(&registration[0], &registration[shift], 0.0f);
+      std::copy(
+          &unshifted_registration[0],
+          &unshifted_registration[7 - shift],
+          &registration[shift]);
+      
+      frequency_increment[i] = (f - frequency_[i]) / n;
+      saw_8_gain_increment[i] = \
+          ((registration[0] + 2.0f * registration[1]) * g - \
+          saw_8_gain_[i]) / n;
+      saw_4_gain_increment[i] = \
+          ((registration[2] - registration[1] + 2.0f * registration[3]) * g - \
+          saw_4_gain_[i]) / n;
+      saw_2_gain_increment[i] = \
+          ((registration[4] - registration[3] + 2.0f * registration[5]) * g - \
+          saw_2_gain_[i]) / n;
+      saw_1_gain_increment[i] = \
+          ((registration[6] - registration[5]) * g - saw_1_gain_[i]) / n;
+    }
+
+#ifdef __SSE2__
+    const int kNumBatches = num_lanes / 4;
+    __m128 phase[kNumBatches];
+    __m128 next_sample[kNumBatches];
+    __m128i segment[kNumBatches];
+    __m128 frequency_v[kNumBatches];
+    __m128 frequency_inc[kNumBatches];
+    __m128 saw_8_gain[kNumBatches];
+    __m128 saw_8_gain_inc[kNumBatches];
+    __m128 saw_4_gain[kNumBatches];
+    __m128 saw_4_gain_inc[kNumBatches];
+    __m128 saw_2_gain[kNumBatches];
+    __m128 saw_2_gain_inc[kNumBatches];
+    __m128 saw_1_gain[kNumBatches];
+    __m128 saw_1_gain_inc[kNumBatches];
+    __m128 active_lanes[kNumBatches];
+    __m128 aux_lanes[kNumBatches];
+    for (int i = 0; i < kNumBatches; ++i) {
+      phase[i] = _mm_loadu_ps(&phase_[i * 4]);
+      next_sample[i] = _mm_loadu_ps(&next_sample_[i * 4]);
+      segment[i] = _mm_loadu_si128((const __m128i*) &segment_[i * 4]);
+      frequency_v[i] = _mm_loadu_ps(&frequency_[i * 4]);
+      frequency_inc[i] = _mm_loadu_ps(&frequency_increment[i * 4]);
+      saw_8_gain[i] = _mm_loadu_ps(&saw_8_gain_[i * 4]);
+      saw_8_gain_inc[i] = _mm_loadu_ps(&saw_8_gain_increment[i * 4]);
+      saw_4_gain[i] = _mm_loadu_ps(&saw_4_gain_[i * 4]);
+      saw_4_gain_inc[i] = _mm_loadu_ps(&saw_4_gain_increment[i * 4]);
+      saw_2_gain[i] = _mm_loadu_ps(&saw_2_gain_[i * 4]);
+      saw_2_gain_inc[i] = _mm_loadu_ps(&saw_2_gain_increment[i * 4]);
+      saw_1_gain[i] = _mm_loadu_ps(&saw_1_gain_[i * 4]);
+      saw_1_gain_inc[i] = _mm_loadu_ps(&saw_1_gain_increment[i * 4]);
+      active_lanes[i] = LaneMask(active_mask >> (i * 4));
+      aux_lanes[i] = LaneMask((active_mask & aux_mask) >> (i * 4));
+    }
+    
+    const __m128i zero_i = _mm_setzero_si128();
+    const __m128i one_i = _mm_set1_epi32(1);
+    const __m128i three_i = _mm_set1_epi32(3);
+    const __m128i four_i = _mm_set1_epi32(4);
+    const __m128i six_i = _mm_set1_epi32(6);
+    const __m128i seven_i = _mm_set1_epi32(7);
+    const __m128i eight_i = _mm_set1_epi32(8);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    
+    while (size--) {
+      __m128 out_sum = _mm_setzero_ps();
+      __m128 aux_sum = _mm_setzero_ps();
+      for (int i = 0; i < kNumBatches; ++i) {
+        __m128 this_sample = next_sample[i];
+        
+        frequency_v[i] = _mm_add_ps(frequency_v[i], frequency_inc[i]);
+        saw_8_gain[i] = _mm_add_ps(saw_8_gain[i], saw_8_gain_inc[i]);
+        saw_4_gain[i] = _mm_add_ps(saw_4_gain[i], saw_4_gain_inc[i]);
+        saw_2_gain[i] = _mm_add_ps(saw_2_gain[i], saw_2_gain_inc[i]);
+        saw_1_gain[i] = _mm_add_ps(saw_1_gain[i], saw_1_gain_inc[i]);
+        
+        phase[i] = _mm_add_ps(phase[i], frequency_v[i]);
+        __m128i next_segment = _mm_cvttps_epi32(phase[i]);
+        const __m128 unchanged = _mm_castsi128_ps(
+            _mm_cmpeq_epi32(next_segment, segment[i]));
+        const __m128i wrap = _mm_cmpeq_epi32(next_segment, eight_i);
+        phase[i] = _mm_sub_ps(
+            phase[i], _mm_cvtepi32_ps(_mm_and_si128(wrap, eight_i)));
+        next_segment = _mm_sub_epi32(
+            next_segment, _mm_and_si128(wrap, eight_i));
+        
+        // Discontinuities of the sawtooths which have wrapped around.
+        __m128 discontinuity = _mm_add_ps(
+            saw_1_gain[i], _mm_and_ps(_mm_castsi128_ps(wrap), saw_8_gain[i]));
+        discontinuity = _mm_add_ps(discontinuity, _mm_and_ps(
+            _mm_castsi128_ps(_mm_cmpeq_epi32(
+                _mm_and_si128(next_segment, three_i), zero_i)),
+            saw_4_gain[i]));
+        discontinuity = _mm_add_ps(discontinuity, _mm_and_ps(
+            _mm_castsi128_ps(_mm_cmpeq_epi32(
+                _mm_and_si128(next_segment, one_i), zero_i)),
+            saw_2_gain[i]));
+        
+        const __m128 t = _mm_div_ps(
+            _mm_sub_ps(phase[i], _mm_cvtepi32_ps(next_segment)),
+            frequency_v[i]);
+        const __m128 t_1 = _mm_sub_ps(one, t);
+        this_sample = _mm_sub_ps(this_sample, _mm_andnot_ps(
+            unchanged,
+            _mm_mul_ps(_mm_mul_ps(half, _mm_mul_ps(t, t)), discontinuity)));
+        __m128 next = _mm_andnot_ps(
+            unchanged,
+            _mm_mul_ps(_mm_mul_ps(half, _mm_mul_ps(t_1, t_1)), discontinuity));
+        segment[i] = next_segment;
+        
+        const __m128 p = phase[i];
+        next = _mm_add_ps(next, _mm_mul_ps(
+            _mm_sub_ps(p, _mm_set1_ps(4.0f)),
+            _mm_mul_ps(saw_8_gain[i], _mm_set1_ps(0.125f))));
+        next = _mm_add_ps(next, _mm_mul_ps(
+            _mm_sub_ps(_mm_sub_ps(p, _mm_cvtepi32_ps(
+                _mm_and_si128(next_segment, four_i))), _mm_set1_ps(2.0f)),
+            _mm_mul_ps(saw_4_gain[i], _mm_set1_ps(0.25f))));
+        next = _mm_add_ps(next, _mm_mul_ps(
+            _mm_sub_ps(_mm_sub_ps(p, _mm_cvtepi32_ps(
+                _mm_and_si128(next_segment, six_i))), one),
+            _mm_mul_ps(saw_2_gain[i], half)));
+        next = _mm_add_ps(next, _mm_mul_ps(
+            _mm_sub_ps(_mm_sub_ps(p, _mm_cvtepi32_ps(
+                _mm_and_si128(next_segment, seven_i))), half),
+            saw_1_gain[i]));
+        next_sample[i] = next;
+        
+        const __m128 s = _mm_add_ps(this_sample, this_sample);
+        out_sum = _mm_add_ps(out_sum, _mm_and_ps(active_lanes[i], s));
+        aux_sum = _mm_add_ps(aux_sum, _mm_and_ps(aux_lanes[i], s));
+      }
+      
+      // Sum of the 4 lanes.
+      out_sum = _mm_add_ps(out_sum, _mm_movehl_ps(out_sum, out_sum));
+      out_sum = _mm_add_ss(out_sum, _mm_shuffle_ps(out_sum, out_sum, 1));
+      aux_sum = _mm_add_ps(aux_sum, _mm_movehl_ps(aux_sum, aux_sum));
+      aux_sum = _mm_add_ss(aux_sum, _mm_shuffle_ps(aux_sum, aux_sum, 1));
+      *out++ += _mm_cvtss_f32(out_sum);
+      *aux++ += _mm_cvtss_f32(aux_sum);
+    }
+    
+    // The inactive lanes were advanced with the others, but keep the state
+    // they had before the block.
+    for (int i = 0; i < kNumBatches; ++i) {
+      const __m128 m = active_lanes[i];
+      Store(m, phase[i], &phase_[i * 4]);
+      Store(m, next_sample[i], &next_sample_[i * 4]);
+      Store(m, _mm_castsi128_ps(segment[i]), (float*) &segment_[i * 4]);
+      Store(m, frequency_v[i], &frequency_[i * 4]);
+      Store(m, saw_8_gain[i], &saw_8_gain_[i * 4]);
+      Store(m, saw_4_gain[i], &saw_4_gain_[i * 4]);
+      Store(m, saw_2_gain[i], &saw_2_gain_[i * 4]);
+      Store(m, saw_1_gain[i], &saw_1_gain_[i * 4]);
+    }
+#else
+    for (int i = 0; i < num_lanes; ++i) {
+      if (!((1 << i) & active_mask)) {
+        continue;
+      }
+      float phase = phase_[i];
+      float next_sample = next_sample_[i];
+      int segment = segment_[i];
+      float* destination = (1 << i) & aux_mask ? aux : NULL;
+      for (size_t j = 0; j < size; ++j) {
+        float this_sample = next_sample;
+        next_sample = 0.0f;
+    
+        const float frequency = frequency_[i] += frequency_increment[i];
+        const float saw_8_gain = saw_8_gain_[i] += saw_8_gain_increment[i];
+        const float saw_4_gain = saw_4_gain_[i] += saw_4_gain_increment[i];
+        const float saw_2_gain = saw_2_gain_[i] += saw_2_gain_increment[i];
+        const float saw_1_gain = saw_1_gain_[i] += saw_1_gain_increment[i];
+  
+        phase += frequency;
+        int next_segment = static_cast<int>(phase);
+        if (next_segment != segment) {
+          float discontinuity = 0.0f;
+          if (next_segment == 8) {
+            phase -= 8.0f;
+            next_segment -= 8;
+            discontinuity -= saw_8_gain;
+          }
+          if ((next_segment & 3) == 0) {
+            discontinuity -= saw_4_gain;
+          }
+          if ((next_segment & 1) == 0) {
+            discontinuity -= saw_2_gain;
+          }
+          discontinuity -= saw_1_gain;
+          if (discontinuity != 0.0f) {
+            float fraction = phase - static_cast<float>(next_segment);
+            float t = fraction / frequency;
+            this_sample += stmlib::ThisBlepSample(t) * discontinuity;
+            next_sample += stmlib::NextBlepSample(t) * discontinuity;
+          }
+        }
+        segment = next_segment;
+        
+        next_sample += (phase - 4.0f) * saw_8_gain * 0.125f;
+        next_sample += (phase - float(segment & 4) - 2.0f) * saw_4_gain * 0.25f;
+        next_sample += (phase - float(segment & 6) - 1.0f) * saw_2_gain * 0.5f;
+        next_sample += (phase - float(segment & 7) - 0.5f) * saw_1_gain;
+        out[j] += 2.0f * this_sample;
+        if (destination) {
+          destination[j] += 2.0f * this_sample;
+        }
+      }
+      phase_[i] = phase;
+      next_sample_[i] = next_sample;
+      segment_[i] = segment;
+    }
+#endif  // __SSE2__
+  }
+ 
+ private:
+#ifdef __SSE2__
+  // All bits set in the lanes whose bit is set in bits.
+  static inline __m128 LaneMask(int bits) {
+    const __m128i lane_bits = _mm_setr_epi32(1, 2, 4, 8);
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(
+        _mm_and_si128(_mm_set1_epi32(bits), lane_bits), lane_bits));
+  }
+  
+  // Stores the lanes of value selected by mask, leaves the others unchanged.
+  static inline void Store(__m128 mask, __m128 value, float* destination) {
+    const __m128 previous = _mm_loadu_ps(destination);
+    _mm_storeu_ps(destination, _mm_or_ps(
+        _mm_and_ps(mask, value), _mm_andnot_ps(mask, previous)));
+  }
+#endif  // __SSE2__
+
+  // Oscillator state.
+  float phase_[num_lanes];
+  float next_sample_[num_lanes];
+  int32_t segment_[num_lanes];
+
+  // For interpolation of parameters.
+  float frequency_[num_lanes];
+  float saw_8_gain_[num_lanes];
+  float saw_4_gain_[num_lanes];
+  float saw_2_gain_[num_lanes];
+  float saw_1_gain_[num_lanes];
+
+  DISALLOW_COPY_AND_ASSIGN(StringSynthOscillatorBank);
+};
   
 }  // namespace plaits
 
@@ -30,6 +30,11 @@
 #define PLAITS_DSP_OSCILLATOR_WAVETABLE_OSCILLATOR_H_
 
 #include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif  // __SSE2__
 
 #include "stmlib/dsp/dsp.h"
 #include "stmlib/dsp/parameter_interpolator.h"
@@ -181,6 +186,273 @@ class WavetableOscillator {
   
   DISALLOW_COPY_AND_ASSIGN(WavetableOscillator);
 };
+
+// num_lanes WavetableOscillators (with approximate scaling) given the same
+// waveform, rendered side by side. Only the lanes whose bit is set in
+// active_mask are rendered: the others are silent and keep their state, like
+// an oscillator that is not called. Each lane is mixed into out, and also
+// into aux when its bit is set in aux_mask. On x86, num_lanes must be a
+// multiple of 4.
+template<
+    size_t wavetable_size,
+    size_t num_waves,
+    int num_lanes>
+class WavetableOscillatorBank {
+ public:
+  WavetableOscillatorBank() { }
+  ~WavetableOscillatorBank() { }
+
+  void Init() {
+    for (int i = 0; i < num_lanes; ++i) {
+      phase_[i] = 0.0f;
+      frequency_[i] = 0.0f;
+      amplitude_[i] = 0.0f;
+      lp_[i] = 0.0f;
+      differentiator_lp_[i] = 0.0f;
+      differentiator_previous_[i] = 0.0f;
+      waveform_[i] = 0.0f;
+    }
+  }
+  
+  void Render(
+      const float* frequency,
+      const float* amplitude,
+      float waveform,
+      const int16_t** wavetable,
+      int active_mask,
+      int aux_mask,
+      float* out,
+      float* aux,
+      size_t size) {
+    const float n = static_cast<float>(size);
+    float frequency_increment[num_lanes];
+    float amplitude_increment[num_lanes];
+    float waveform_increment[num_lanes];
+    waveform *= float(num_waves - 1.0001f);
+    
+    for (int i = 0; i < num_lanes; ++i) {
+      float f = frequency[i];
+      if (f >= kMaxFrequency) {
+        f = kMaxFrequency;
+      }
+      float a = amplitude[i];
+      a *= 1.0f - 2.0f * f;
+      a *= 1.0f / (f * 131072.0f) * (0.95f - f);
+      
+      frequency_increment[i] = (f - frequency_[i]) / n;
+      amplitude_increment[i] = (a - amplitude_[i]) / n;
+      // Each lane ramps from the waveform it last rendered.
+      waveform_increment[i] = (waveform - waveform_[i]) / n;
+    }
+
+#ifdef __SSE2__
+    const int kNumBatches = num_lanes / 4;
+    __m128 phase[kNumBatches];
+    __m128 frequency_v[kNumBatches];
+    __m128 frequency_inc[kNumBatches];
+    __m128 amplitude_v[kNumBatches];
+    __m128 amplitude_inc[kNumBatches];
+    __m128 lp[kNumBatches];
+    __m128 differentiator_lp[kNumBatches];
+    __m128 differentiator_previous[kNumBatches];
+    __m128 waveform_v[kNumBatches];
+    __m128 waveform_inc[kNumBatches];
+    __m128 active_lanes[kNumBatches];
+    __m128 aux_lanes[kNumBatches];
+    for (int i = 0; i < kNumBatches; ++i) {
+      phase[i] = _mm_loadu_ps(&phase_[i * 4]);
+      frequency_v[i] = _mm_loadu_ps(&frequency_[i * 4]);
+      frequency_inc[i] = _mm_loadu_ps(&frequency_increment[i * 4]);
+      amplitude_v[i] = _mm_loadu_ps(&amplitude_[i * 4]);
+      amplitude_inc[i] = _mm_loadu_ps(&amplitude_increment[i * 4]);
+      lp[i] = _mm_loadu_ps(&lp_[i * 4]);
+      differentiator_lp[i] = _mm_loadu_ps(&differentiator_lp_[i * 4]);
+      differentiator_previous[i] = _mm_loadu_ps(
+          &differentiator_previous_[i * 4]);
+      waveform_v[i] = _mm_loadu_ps(&waveform_[i * 4]);
+      waveform_inc[i] = _mm_loadu_ps(&waveform_increment[i * 4]);
+      active_lanes[i] = LaneMask(active_mask >> (i * 4));
+      aux_lanes[i] = LaneMask((active_mask & aux_mask) >> (i * 4));
+    }
+    
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 table_size = _mm_set1_ps(float(wavetable_size));
+    
+    while (size--) {
+      __m128 out_sum = _mm_setzero_ps();
+      __m128 aux_sum = _mm_setzero_ps();
+      for (int i = 0; i < kNumBatches; ++i) {
+        const __m128 f0 = frequency_v[i] = _mm_add_ps(
+            frequency_v[i], frequency_inc[i]);
+        const __m128 cutoff = _mm_min_ps(_mm_mul_ps(table_size, f0), one);
+        
+        phase[i] = _mm_add_ps(phase[i], f0);
+        phase[i] = _mm_sub_ps(
+            phase[i], _mm_and_ps(_mm_cmpge_ps(phase[i], one), one));
+        
+        const __m128 p = _mm_mul_ps(phase[i], table_size);
+        const __m128i p_integral = _mm_cvttps_epi32(p);
+        const __m128 p_fractional = _mm_sub_ps(
+            p, _mm_cvtepi32_ps(p_integral));
+        
+        waveform_v[i] = _mm_add_ps(waveform_v[i], waveform_inc[i]);
+        const __m128i waveform_integral = _mm_cvttps_epi32(waveform_v[i]);
+        const __m128 waveform_f = _mm_sub_ps(
+            waveform_v[i], _mm_cvtepi32_ps(waveform_integral));
+        
+        // The table lookups are done one lane at a time. Each one reads the
+        // two consecutive samples to interpolate as a 32-bit word.
+        int32_t index[4];
+        int32_t wave[4];
+        _mm_storeu_si128((__m128i*) index, p_integral);
+        _mm_storeu_si128((__m128i*) wave, waveform_integral);
+        const __m128i w_0 = _mm_setr_epi32(
+            Pair(wavetable[wave[0]], index[0]),
+            Pair(wavetable[wave[1]], index[1]),
+            Pair(wavetable[wave[2]], index[2]),
+            Pair(wavetable[wave[3]], index[3]));
+        const __m128i w_1 = _mm_setr_epi32(
+            Pair(wavetable[wave[0] + 1], index[0]),
+            Pair(wavetable[wave[1] + 1], index[1]),
+            Pair(wavetable[wave[2] + 1], index[2]),
+            Pair(wavetable[wave[3] + 1], index[3]));
+        const __m128 a_0 = _mm_cvtepi32_ps(
+            _mm_srai_epi32(_mm_slli_epi32(w_0, 16), 16));
+        const __m128 b_0 = _mm_cvtepi32_ps(_mm_srai_epi32(w_0, 16));
+        const __m128 a_1 = _mm_cvtepi32_ps(
+            _mm_srai_epi32(_mm_slli_epi32(w_1, 16), 16));
+        const __m128 b_1 = _mm_cvtepi32_ps(_mm_srai_epi32(w_1, 16));
+        const __m128 x0 = _mm_add_ps(a_0, _mm_mul_ps(
+            _mm_sub_ps(b_0, a_0), p_fractional));
+        const __m128 x1 = _mm_add_ps(a_1, _mm_mul_ps(
+            _mm_sub_ps(b_1, a_1), p_fractional));
+        const __m128 s = _mm_add_ps(
+            x0, _mm_mul_ps(_mm_sub_ps(x1, x0), waveform_f));
+        
+        // Differentiator, then one-pole low-pass filter.
+        differentiator_lp[i] = _mm_add_ps(differentiator_lp[i], _mm_mul_ps(
+            cutoff,
+            _mm_sub_ps(
+                _mm_sub_ps(s, differentiator_previous[i]),
+                differentiator_lp[i])));
+        differentiator_previous[i] = s;
+        lp[i] = _mm_add_ps(lp[i], _mm_mul_ps(
+            _mm_mul_ps(cutoff, half),
+            _mm_sub_ps(differentiator_lp[i], lp[i])));
+        
+        amplitude_v[i] = _mm_add_ps(amplitude_v[i], amplitude_inc[i]);
+        const __m128 y = _mm_mul_ps(amplitude_v[i], lp[i]);
+        out_sum = _mm_add_ps(out_sum, _mm_and_ps(active_lanes[i], y));
+        aux_sum = _mm_add_ps(aux_sum, _mm_and_ps(aux_lanes[i], y));
+      }
+      
+      // Sum of the 4 lanes.
+      out_sum = _mm_add_ps(out_sum, _mm_movehl_ps(out_sum, out_sum));
+      out_sum = _mm_add_ss(out_sum, _mm_shuffle_ps(out_sum, out_sum, 1));
+      aux_sum = _mm_add_ps(aux_sum, _mm_movehl_ps(aux_sum, aux_sum));
+      aux_sum = _mm_add_ss(aux_sum, _mm_shuffle_ps(aux_sum, aux_sum, 1));
+      *out++ += _mm_cvtss_f32(out_sum);
+      *aux++ += _mm_cvtss_f32(aux_sum);
+    }
+    
+    // The inactive lanes were advanced with the others, but keep the state
+    // they had before the block.
+    for (int i = 0; i < kNumBatches; ++i) {
+      const __m128 m = active_lanes[i];
+      Store(m, phase[i], &phase_[i * 4]);
+      Store(m, frequency_v[i], &frequency_[i * 4]);
+      Store(m, amplitude_v[i], &amplitude_[i * 4]);
+      Store(m, lp[i], &lp_[i * 4]);
+      Store(m, differentiator_lp[i], &differentiator_lp_[i * 4]);
+      Store(m, differentiator_previous[i], &differentiator_previous_[i * 4]);
+      Store(m, waveform_v[i], &waveform_[i * 4]);
+    }
+#else
+    while (size--) {
+      float out_sum = 0.0f;
+      float aux_sum = 0.0f;
+      for (int i = 0; i < num_lanes; ++i) {
+        if (!((1 << i) & active_mask)) {
+          continue;
+        }
+        const float f0 = frequency_[i] += frequency_increment[i];
+        const float cutoff = std::min(float(wavetable_size) * f0, 1.0f);
+        
+        phase_[i] += f0;
+        if (phase_[i] >= 1.0f) {
+          phase_[i] -= 1.0f;
+        }
+        
+        const float p = phase_[i] * float(wavetable_size);
+        MAKE_INTEGRAL_FRACTIONAL(p);
+        
+        const float waveform = waveform_[i] += waveform_increment[i];
+        MAKE_INTEGRAL_FRACTIONAL(waveform);
+        const int16_t* wave_0 = wavetable[waveform_integral];
+        const int16_t* wave_1 = wavetable[waveform_integral + 1];
+        
+        const float x0 = InterpolateWave(wave_0, p_integral, p_fractional);
+        const float x1 = InterpolateWave(wave_1, p_integral, p_fractional);
+        const float s = x0 + (x1 - x0) * waveform_fractional;
+        
+        ONE_POLE(
+            differentiator_lp_[i],
+            s - differentiator_previous_[i],
+            cutoff);
+        differentiator_previous_[i] = s;
+        ONE_POLE(lp_[i], differentiator_lp_[i], cutoff * 0.5f);
+        
+        const float y = (amplitude_[i] += amplitude_increment[i]) * lp_[i];
+        out_sum += y;
+        if ((1 << i) & aux_mask) {
+          aux_sum += y;
+        }
+      }
+      *out++ += out_sum;
+      *aux++ += aux_sum;
+    }
+#endif  // __SSE2__
+  }
+
+ private:
+#ifdef __SSE2__
+  static inline int32_t Pair(const int16_t* table, int32_t index) {
+    int32_t pair;
+    memcpy(&pair, &table[index], sizeof(pair));
+    return pair;
+  }
+  
+  // All bits set in the lanes whose bit is set in bits.
+  static inline __m128 LaneMask(int bits) {
+    const __m128i lane_bits = _mm_setr_epi32(1, 2, 4, 8);
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(
+        _mm_and_si128(_mm_set1_epi32(bits), lane_bits), lane_bits));
+  }
+  
+  // Stores the lanes of value selected by mask, leaves the others unchanged.
+  static inline void Store(__m128 mask, __m128 value, float* destination) {
+    const __m128 previous = _mm_loadu_ps(destination);
+    _mm_storeu_ps(destination, _mm_or_ps(
+        _mm_and_ps(mask, value), _mm_andnot_ps(mask, previous)));
+  }
+#endif  // __SSE2__
+
+  // Oscillator state.
+  float phase_[num_lanes];
+
+  // For interpolation of parameters.
+  float frequency_[num_lanes];
+  float amplitude_[num_lanes];
+  float waveform_[num_lanes];
+  float lp_[num_lanes];
+  
+  // See Differentiator.
+  float differentiator_lp_[num_lanes];
+  float differentiator_previous_[num_lanes];
+  
+  DISALLOW_COPY_AND_ASSIGN(WavetableOscillatorBank);
+};
   
 }  // namespace plaits
 
@@ -51,9 +51,7 @@ void Resonator::Init(float position, int resolution) {
     mode_amplitude_[i] = amplitudes.Next() * 0.25f;
   }
   
-  for (int i = 0; i < kMaxNumModes / kModeBatchSize; ++i) {
-    mode_filters_[i].Init();
-  }
+  mode_filters_.Init();
 }
 
 inline float NthHarmonicCompensation(int n, float stiffness) {
@@ -88,37 +86,28 @@ void Resonator::Process(
   brightness *= 1.0f - damping * 0.3f;
   float q_loss = brightness * (2.0f - brightness) * 0.85f + 0.15f;
   
-  float mode_q[kModeBatchSize];
-  float mode_f[kModeBatchSize];
-  float mode_a[kModeBatchSize];
-  int batch_counter = 0;
-  
-  ResonatorSvf<kModeBatchSize>* batch_processor = &mode_filters_[0];
+  float mode_q[kMaxNumModes];
+  float mode_f[kMaxNumModes];
+  float mode_a[kMaxNumModes];
   
+  // The modes above Nyquist are clamped to it and are not rendered. With a
+  // high Q they still rang at Nyquist, so skipping them removes an audible
+  // high-frequency component: high notes sound darker than in the original
+  // firmware.
+  int num_modes = 0;
   
   for (int i = 0; i < resolution_; ++i) {
     float mode_frequency = harmonic * stretch_factor;
     if (mode_frequency >= 0.499f) {
       mode_frequency = 0.499f;
+    } else {
+      num_modes = i + 1;
     }
     const float mode_attenuation = 1.0f - mode_frequency * 2.0f;
     
-    mode_f[batch_counter] = mode_frequency;
-    mode_q[batch_counter] = 1.0f + mode_frequency * q;
-    mode_a[batch_counter] = mode_amplitude_[i] * mode_attenuation;
-    ++batch_counter;
-    
-    if (batch_counter == kModeBatchSize) {
-      batch_counter = 0;
-      batch_processor->Process<FILTER_MODE_BAND_PASS, true>(
-          mode_f,
-          mode_q,
-          mode_a,
-          in,
-          out,
-          size);
-      ++batch_processor;
-    }
+    mode_f[i] = mode_frequency;
+    mode_q[i] = 1.0f + mode_frequency * q;
+    mode_a[i] = mode_amplitude_[i] * mode_attenuation;
     
     stretch_factor += stiffness;
     if (stiffness < 0.0f) {
@@ -131,6 +120,8 @@ void Resonator::Process(
     harmonic += f0;
     q *= q_loss;
   }
+  
+  mode_filters_.Process<true>(mode_f, mode_q, mode_a, num_modes, in, out, size);
 }
 
 }  // namespace plaits
@@ -29,6 +29,12 @@
 #ifndef PLAITS_DSP_PHYSICAL_MODELLING_RESONATOR_H_
 #define PLAITS_DSP_PHYSICAL_MODELLING_RESONATOR_H_
 
+#include <algorithm>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif  // __SSE__
+
 #include "stmlib/dsp/filter.h"
 
 namespace plaits {
@@ -105,6 +111,177 @@ class ResonatorSvf {
   DISALLOW_COPY_AND_ASSIGN(ResonatorSvf);
 };
 
+// Up to max_num_modes modes, in batches of kModeBatchSize that are processed
+// together. On x86, a batch is one SSE vector and all the batches are
+// advanced in the same loop, so that their computations overlap. Only the
+// first num_modes modes are rendered: the state of the others is cleared, and
+// the lanes of the last batch beyond num_modes are silent. f, q and gain are
+// only read for the first num_modes modes.
+template<int max_num_modes>
+class ResonatorSvfBank {
+ public:
+  ResonatorSvfBank() { }
+  ~ResonatorSvfBank() { }
+  
+  void Init() {
+    for (int i = 0; i < max_num_modes; ++i) {
+      state_1_[i] = state_2_[i] = 0.0f;
+    }
+  }
+  
+  template<bool add>
+  void Process(
+      const float* f,
+      const float* q,
+      const float* gain,
+      int num_modes,
+      const float* in,
+      float* out,
+      size_t size) {
+    STATIC_ASSERT(max_num_modes % kModeBatchSize == 0, partial_batch);
+    num_modes = std::min(num_modes, max_num_modes);
+    const int num_batches = (num_modes + kModeBatchSize - 1) / kModeBatchSize;
+    float g[max_num_modes];
+    float r_plus_g[max_num_modes];
+    float h[max_num_modes];
+    float gains[max_num_modes];
+    for (int i = 0; i < num_modes; ++i) {
+      g[i] = stmlib::OnePole::tan<stmlib::FREQUENCY_FAST>(f[i]);
+      const float r = 1.0f / q[i];
+      h[i] = 1.0f / (1.0f + r * g[i] + g[i] * g[i]);
+      r_plus_g[i] = r + g[i];
+      gains[i] = gain[i];
+    }
+    // With g = h = 0, the state of a padding lane stays at 0.
+    for (int i = num_modes; i < max_num_modes; ++i) {
+      g[i] = r_plus_g[i] = h[i] = gains[i] = 0.0f;
+      state_1_[i] = state_2_[i] = 0.0f;
+    }
+    
+#ifdef __SSE__
+    ProcessBatches<add>(
+        BatchCount<kNumBatches>(), num_batches, g, r_plus_g, h, gains, in, out,
+        size);
+#else
+    const int n = num_batches * kModeBatchSize;
+    while (size--) {
+      float s_in = *in++;
+      float s_out = 0.0f;
+      for (int i = 0; i < n; ++i) {
+        const float hp = (s_in - r_plus_g[i] * state_1_[i] - state_2_[i]) * h[i];
+        const float bp = g[i] * hp + state_1_[i];
+        state_1_[i] = g[i] * hp + bp;
+        const float lp = g[i] * bp + state_2_[i];
+        state_2_[i] = g[i] * bp + lp;
+        s_out += gains[i] * bp;
+      }
+      if (add) {
+        *out++ += s_out;
+      } else {
+        *out++ = s_out;
+      }
+    }
+#endif  // __SSE__
+  }
+  
+ private:
+  static const int kNumBatches = max_num_modes / kModeBatchSize;
+
+#ifdef __SSE__
+  template<int n> struct BatchCount { };
+  
+  template<bool add>
+  void ProcessBatches(
+      BatchCount<0>,
+      int n,
+      const float* g,
+      const float* r_plus_g,
+      const float* h,
+      const float* gain,
+      const float* in,
+      float* out,
+      size_t size) {
+    if (!add) {
+      std::fill(&out[0], &out[size], 0.0f);
+    }
+  }
+  
+  // The number of batches is a template parameter, so that the loop over the
+  // batches is unrolled and the coefficients and state live in fixed-size
+  // local arrays. With 6 batches, the 36 vectors do not all fit in the 16
+  // SSE registers: some are spilled to the stack, which stays in L1.
+  template<bool add, int num_batches>
+  void ProcessBatches(
+      BatchCount<num_batches>,
+      int n,
+      const float* g,
+      const float* r_plus_g,
+      const float* h,
+      const float* gain,
+      const float* in,
+      float* out,
+      size_t size) {
+    if (n != num_batches) {
+      ProcessBatches<add>(
+          BatchCount<num_batches - 1>(), n, g, r_plus_g, h, gain, in, out, size);
+      return;
+    }
+    
+    __m128 g_v[num_batches];
+    __m128 r_plus_g_v[num_batches];
+    __m128 h_v[num_batches];
+    __m128 gain_v[num_batches];
+    __m128 state_1[num_batches];
+    __m128 state_2[num_batches];
+    for (int i = 0; i < num_batches; ++i) {
+      g_v[i] = _mm_loadu_ps(&g[i * 4]);
+      r_plus_g_v[i] = _mm_loadu_ps(&r_plus_g[i * 4]);
+      h_v[i] = _mm_loadu_ps(&h[i * 4]);
+      gain_v[i] = _mm_loadu_ps(&gain[i * 4]);
+      state_1[i] = _mm_loadu_ps(&state_1_[i * 4]);
+      state_2[i] = _mm_loadu_ps(&state_2_[i * 4]);
+    }
+    
+    while (size--) {
+      const __m128 s_in = _mm_set1_ps(*in++);
+      __m128 s_out = _mm_setzero_ps();
+      for (int i = 0; i < num_batches; ++i) {
+        const __m128 hp = _mm_mul_ps(
+            _mm_sub_ps(
+                _mm_sub_ps(s_in, _mm_mul_ps(r_plus_g_v[i], state_1[i])),
+                state_2[i]),
+            h_v[i]);
+        const __m128 g_hp = _mm_mul_ps(g_v[i], hp);
+        const __m128 bp = _mm_add_ps(g_hp, state_1[i]);
+        state_1[i] = _mm_add_ps(g_hp, bp);
+        const __m128 g_bp = _mm_mul_ps(g_v[i], bp);
+        const __m128 lp = _mm_add_ps(g_bp, state_2[i]);
+        state_2[i] = _mm_add_ps(g_bp, lp);
+        s_out = _mm_add_ps(s_out, _mm_mul_ps(gain_v[i], bp));
+      }
+      // Sum of the 4 lanes.
+      s_out = _mm_add_ps(s_out, _mm_movehl_ps(s_out, s_out));
+      s_out = _mm_add_ss(s_out, _mm_shuffle_ps(s_out, s_out, 1));
+      if (add) {
+        *out++ += _mm_cvtss_f32(s_out);
+      } else {
+        *out++ = _mm_cvtss_f32(s_out);
+      }
+    }
+    
+    for (int i = 0; i < num_batches; ++i) {
+      _mm_storeu_ps(&state_1_[i * 4], state_1[i]);
+      _mm_storeu_ps(&state_2_[i * 4], state_2[i]);
+    }
+  }
+#endif  // __SSE__
+  
+  float state_1_[max_num_modes];
+  float state_2_[max_num_modes];
+  
+  DISALLOW_COPY_AND_ASSIGN(ResonatorSvfBank);
+};
+
 class Resonator {
  public:
   Resonator() { }
@@ -124,7 +301,7 @@ class Resonator {
   int resolution_;
   
   float mode_amplitude_[kMaxNumModes];
-  ResonatorSvf<kModeBatchSize> mode_filters_[kMaxNumModes / kModeBatchSize];
+  ResonatorSvfBank<kMaxNumModes> mode_filters_;
   
   DISALLOW_COPY_AND_ASSIGN(Resonator);
 };
@@ -28,35 +28,19 @@
 
 #include "plaits/dsp/voice.h"
 
+#include <new>
+
 namespace plaits {
 
 using namespace std;
 using namespace stmlib;
 
 void Voice::Init(BufferAllocator* allocator) {
-  engines_.Init();
-  engines_.RegisterInstance(&virtual_analog_engine_, false, 0.8f, 0.8f);
-  engines_.RegisterInstance(&waveshaping_engine_, false, 0.7f, 0.6f);
-  engines_.RegisterInstance(&fm_engine_, false, 0.6f, 0.6f);
-  engines_.RegisterInstance(&grain_engine_, false, 0.7f, 0.6f);
-  engines_.RegisterInstance(&additive_engine_, false, 0.8f, 0.8f);
-  engines_.RegisterInstance(&wavetable_engine_, false, 0.6f, 0.6f);
-  engines_.RegisterInstance(&chord_engine_, false, 0.8f, 0.8f);
-  engines_.RegisterInstance(&speech_engine_, false, -0.7f, 0.8f);
-
-  engines_.RegisterInstance(&swarm_engine_, false, -3.0f, 1.0f);
-  engines_.RegisterInstance(&noise_engine_, false, -1.0f, -1.0f);
-  engines_.RegisterInstance(&particle_engine_, false, -2.0f, 1.0f);
-  engines_.RegisterInstance(&string_engine_, true, -1.0f, 0.8f);
-  engines_.RegisterInstance(&modal_engine_, true, -1.0f, 0.8f);
-  engines_.RegisterInstance(&bass_drum_engine_, true, 0.8f, 0.8f);
-  engines_.RegisterInstance(&snare_drum_engine_, true, 0.8f, 0.8f);
-  engines_.RegisterInstance(&hi_hat_engine_, true, 0.8f, 0.8f);
-  for (int i = 0; i < engines_.size(); ++i) {
-    // All engines will share the same RAM space.
-    allocator->Free();
-    engines_.get(i)->Init(allocator);
-  }
+  // All engines will share the same RAM space: the rest of the allocator.
+  size_t ram_size = allocator->free();
+  allocator_.Init(allocator->Allocate<uint8_t>(ram_size), ram_size);
+  engine_ = NULL;
+  wavetable_waves_ = NULL;
 
   engine_quantizer_.Init();
   previous_engine_index_ = -1;
@@ -74,11 +58,134 @@ void Voice::Init(BufferAllocator* allocator) {
   trigger_delay_.Init(trigger_delay_line_);
 }
 
+// Out gain, aux gain, already enveloped. A negative gain indicates that a
+// limiter must be used.
+static const PostProcessingSettings post_processing_settings[kMaxEngines] = {
+  { 0.8f, 0.8f, false },  // Virtual analog
+  { 0.7f, 0.6f, false },  // Waveshaping
+  { 0.6f, 0.6f, false },  // FM
+  { 0.7f, 0.6f, false },  // Grain
+  { 0.8f, 0.8f, false },  // Additive
+  { 0.6f, 0.6f, false },  // Wavetable
+  { 0.8f, 0.8f, false },  // Chord
+  { -0.7f, 0.8f, false },  // Speech
+
+  { -3.0f, 1.0f, false },  // Swarm
+  { -1.0f, -1.0f, false },  // Noise
+  { -2.0f, 1.0f, false },  // Particle
+  { -1.0f, 0.8f, true },  // String
+  { -1.0f, 0.8f, true },  // Modal
+  { 0.8f, 0.8f, true },  // Bass drum
+  { 0.8f, 0.8f, true },  // Snare drum
+  { 0.8f, 0.8f, true },  // Hi-hat
+};
+
+Engine* Voice::ConstructEngine(int index) {
+  // The previous engine is not destroyed: none of them has anything to
+  // release.
+  Engine* e = NULL;
+  switch (index) {
+    case 0: e = new(&engine_storage_.virtual_analog) VirtualAnalogEngine; break;
+    case 1: e = new(&engine_storage_.waveshaping) WaveshapingEngine; break;
+    case 2: e = new(&engine_storage_.fm) FMEngine; break;
+    case 3: e = new(&engine_storage_.grain) GrainEngine; break;
+    case 4: e = new(&engine_storage_.additive) AdditiveEngine; break;
+    case 5: e = new(&engine_storage_.wavetable) WavetableEngine; break;
+    case 6: e = new(&engine_storage_.chord) ChordEngine; break;
+    case 7: e = new(&engine_storage_.speech) SpeechEngine; break;
+    case 8: e = new(&engine_storage_.swarm) SwarmEngine; break;
+    case 9: e = new(&engine_storage_.noise) NoiseEngine; break;
+    case 10: e = new(&engine_storage_.particle) ParticleEngine; break;
+    case 11: e = new(&engine_storage_.string) StringEngine; break;
+    case 12: e = new(&engine_storage_.modal) ModalEngine; break;
+    case 13: e = new(&engine_storage_.bass_drum) BassDrumEngine; break;
+    case 14: e = new(&engine_storage_.snare_drum) SnareDrumEngine; break;
+    default: e = new(&engine_storage_.hi_hat) HiHatEngine; break;
+  }
+  e->post_processing_settings = post_processing_settings[index];
+  allocator_.Free();
+  e->Init(&allocator_);
+  e->Reset();
+  if (index == 5) {
+    engine_storage_.wavetable.set_waves(wavetable_waves_);
+  }
+  return e;
+}
+
+void Voice::set_wavetable_waves(const int16_t* waves) {
+  wavetable_waves_ = waves;
+  // All the engines share the same storage: the active one is identified by
+  // its index, not by its address.
+  if (previous_engine_index_ == 5) {
+    engine_storage_.wavetable.set_waves(waves);
+  }
+}
+
 void Voice::Render(
     const Patch& patch,
     const Modulations& modulations,
     Frame* frames,
     size_t size) {
+  bool lpg_bypass = RenderEngine(patch, modulations, size);
+  const PostProcessingSettings& pp_s = engine_->post_processing_settings;
+
+  out_post_processor_.Process(
+      pp_s.out_gain,
+      lpg_bypass,
+      lpg_envelope_.gain(),
+      lpg_envelope_.frequency(),
+      lpg_envelope_.hf_bleed(),
+      out_buffer_,
+      &frames->out,
+      size,
+      2);
+
+  aux_post_processor_.Process(
+      pp_s.aux_gain,
+      lpg_bypass,
+      lpg_envelope_.gain(),
+      lpg_envelope_.frequency(),
+      lpg_envelope_.hf_bleed(),
+      aux_buffer_,
+      &frames->aux,
+      size,
+      2);
+}
+
+void Voice::Render(
+    const Patch& patch,
+    const Modulations& modulations,
+    float* out,
+    float* aux,
+    size_t size) {
+  bool lpg_bypass = RenderEngine(patch, modulations, size);
+  const PostProcessingSettings& pp_s = engine_->post_processing_settings;
+
+  out_post_processor_.Process(
+      pp_s.out_gain,
+      lpg_bypass,
+      lpg_envelope_.gain(),
+      lpg_envelope_.frequency(),
+      lpg_envelope_.hf_bleed(),
+      out_buffer_,
+      out,
+      size);
+
+  aux_post_processor_.Process(
+      pp_s.aux_gain,
+      lpg_bypass,
+      lpg_envelope_.gain(),
+      lpg_envelope_.frequency(),
+      lpg_envelope_.hf_bleed(),
+      aux_buffer_,
+      aux,
+      size);
+}
+
+bool Voice::RenderEngine(
+    const Patch& patch,
+    const Modulations& modulations,
+    size_t size) {
   // Trigger, LPG, internal envelope.
 
   // Delay trigger by 1ms to deal with sequencers or MIDI interfaces whose
@@ -109,16 +216,15 @@ void Voice::Render(
   int engine_index = engine_quantizer_.Process(
       patch.engine,
       engine_cv_,
-      engines_.size(),
+      kMaxEngines,
       0.25f);
 
-  Engine* e = engines_.get(engine_index);
-
   if (engine_index != previous_engine_index_) {
-    e->Reset();
+    engine_ = ConstructEngine(engine_index);
     out_post_processor_.Reset();
     previous_engine_index_ = engine_index;
   }
+  Engine* e = engine_;
   EngineParameters p;
 
   bool rising_edge = trigger_state_ && !previous_trigger_state;
@@ -153,10 +259,10 @@ void Voice::Render(
   if (engine_index == 7) {
     internal_envelope_amplitude = 2.0f - p.harmonics * 6.0f;
     CONSTRAIN(internal_envelope_amplitude, 0.0f, 1.0f);
-    speech_engine_.set_prosody_amount(
+    engine_storage_.speech.set_prosody_amount(
         !modulations.trigger_patched ?
             0.0f : patch.frequency_lpg_amount);
-    speech_engine_.set_speed(
+    engine_storage_.speech.set_speed(
         !modulations.trigger_patched ?
             0.0f : patch.morph_lpg_amount);
   }
@@ -229,29 +335,8 @@ void Voice::Render(
       lpg_envelope_.ProcessPing(attack, short_decay, decay_tail, hf);
     }
   }
-
-  out_post_processor_.Process(
-      pp_s.out_gain,
-      lpg_bypass,
-      lpg_envelope_.gain(),
-      lpg_envelope_.frequency(),
-      lpg_envelope_.hf_bleed(),
-      out_buffer_,
-      &frames->out,
-      size,
-      2);
-
-  aux_post_processor_.Process(
-      pp_s.aux_gain,
-      lpg_bypass,
-      lpg_envelope_.gain(),
-      lpg_envelope_.frequency(),
-      lpg_envelope_.hf_bleed(),
-      aux_buffer_,
-      &frames->aux,
-      size,
-      2);
-    epars = p;
+  epars = p;
+  return lpg_bypass;
 }
 
 }  // namespace plaits
@@ -108,6 +108,38 @@ class ChannelPostProcessor {
     }
   }
 
+  void Process(
+      float gain,
+      bool bypass_lpg,
+      float low_pass_gate_gain,
+      float low_pass_gate_frequency,
+      float low_pass_gate_hf_bleed,
+      float* in,
+      float* out,
+      size_t size) {
+    if (gain < 0.0f) {
+      limiter_.Process(-gain, in, size);
+    }
+    // No inversion: the codec output goes through an inverting op-amp.
+    const float post_gain = gain < 0.0f ? 1.0f : gain;
+    if (!bypass_lpg) {
+      lpg_.Process(
+          post_gain * low_pass_gate_gain,
+          low_pass_gate_frequency,
+          low_pass_gate_hf_bleed,
+          in,
+          out,
+          size);
+    } else {
+      for (size_t i = 0; i < size; ++i) {
+        out[i] = in[i] * post_gain;
+      }
+    }
+    for (size_t i = 0; i < size; ++i) {
+      CONSTRAIN(out[i], -1.0f, 1.0f);
+    }
+  }
+
  private:
   stmlib::Limiter limiter_;
   LowPassGate lpg_;
@@ -168,10 +200,30 @@ class Voice {
       const Modulations& modulations,
       Frame* frames,
       size_t size);
+  
+  // Writes planar float buffers instead of the codec frames, at the polarity
+  // of the output jacks and clipped to [-1, 1].
+  void Render(
+      const Patch& patch,
+      const Modulations& modulations,
+      float* out,
+      float* aux,
+      size_t size);
   inline int active_engine() const { return previous_engine_index_; }
+  
+  // Waves of the wavetable engine, see WavetableEngine::set_waves. NULL
+  // selects the built-in waves.
+  void set_wavetable_waves(const int16_t* waves);
   float getDecayEnvelopeValue() const { return decay_envelope_.value(); } 
  private:
   void ComputeDecayParameters(const Patch& settings);
+  
+  // Renders the engine in out_buffer_ and aux_buffer_, and updates the LPG.
+  // Returns true if the LPG must be bypassed.
+  bool RenderEngine(
+      const Patch& patch,
+      const Modulations& modulations,
+      size_t size);
 
   inline float ApplyModulations(
       float base_value,
@@ -202,25 +254,40 @@ class Voice {
     return value;
   }
 
-  AdditiveEngine additive_engine_;
-  BassDrumEngine bass_drum_engine_;
-  ChordEngine chord_engine_;
-  FMEngine fm_engine_;
-  GrainEngine grain_engine_;
-  HiHatEngine hi_hat_engine_;
-  ModalEngine modal_engine_;
-  NoiseEngine noise_engine_;
-  ParticleEngine particle_engine_;
-  SnareDrumEngine snare_drum_engine_;
-  SpeechEngine speech_engine_;
-  StringEngine string_engine_;
-  SwarmEngine swarm_engine_;
-  VirtualAnalogEngine virtual_analog_engine_;
-  WaveshapingEngine waveshaping_engine_;
-  WavetableEngine wavetable_engine_;
+  Engine* ConstructEngine(int index);
+
+  // Only the active engine is constructed, and it is initialized again each
+  // time the engine changes. A voice thus only touches the state and the RAM
+  // of the engine it renders with.
+  union EngineStorage {
+    EngineStorage() { }
+    ~EngineStorage() { }
+    AdditiveEngine additive;
+    BassDrumEngine bass_drum;
+    ChordEngine chord;
+    FMEngine fm;
+    GrainEngine grain;
+    HiHatEngine hi_hat;
+    ModalEngine modal;
+    NoiseEngine noise;
+    ParticleEngine particle;
+    SnareDrumEngine snare_drum;
+    SpeechEngine speech;
+    StringEngine string;
+    SwarmEngine swarm;
+    VirtualAnalogEngine virtual_analog;
+    WaveshapingEngine waveshaping;
+    WavetableEngine wavetable;
+  };
+
+  EngineStorage engine_storage_;
+  Engine* engine_;
+  stmlib::BufferAllocator allocator_;
 
   stmlib::HysteresisQuantizer engine_quantizer_;
 
+  const int16_t* wavetable_waves_;
+
   int previous_engine_index_;
   float engine_cv_;
 
@@ -236,8 +303,6 @@ class Voice {
   ChannelPostProcessor out_post_processor_;
   ChannelPostProcessor aux_post_processor_;
 
-  EngineRegistry<kMaxEngines> engines_;
-
   float out_buffer_[kMaxBlockSize];
   float aux_buffer_[kMaxBlockSize];
 
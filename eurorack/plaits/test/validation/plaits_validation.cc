@@ -0,0 +1,258 @@
+// Copyright 2026 Poly_AudibleInstruments contributors.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// Checks of the vectorized Plaits engines against reference renders.
+//
+// The additive, modal, swarm, chord, wavetable and FM engines are rendered
+// across notes and morph values, and compared with the renders of the scalar
+// code they replaced, stored in plaits/test/validation/references. Engines
+// whose maths is unchanged must match exactly. The others must stay within
+// the bounds given below, in LSB of a 16-bit output (1 / 32768), and the
+// reason of each bound is documented with it. Returns a non-zero exit code on
+// failure.
+//
+// Usage: plaits_validation [--write]. Run it from the eurorack directory.
+// --write renders the references instead of checking them. They were written
+// by this program built against the engines before they were vectorized
+// (commit fa3bfe2), and must not be rewritten from the current code.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "plaits/dsp/dsp.h"
+#include "plaits/dsp/engine/additive_engine.h"
+#include "plaits/dsp/engine/chord_engine.h"
+#include "plaits/dsp/engine/fm_engine.h"
+#include "plaits/dsp/engine/modal_engine.h"
+#include "plaits/dsp/engine/swarm_engine.h"
+#include "plaits/dsp/engine/wavetable_engine.h"
+#include "stmlib/utils/buffer_allocator.h"
+#include "stmlib/utils/random.h"
+
+using namespace plaits;
+using namespace std;
+using namespace stmlib;
+
+// One file per engine, of little-endian 32-bit floats.
+const char* kReferenceDirectory = "plaits/test/validation/references/";
+
+const float kNotes[] = { 36.0f, 60.0f, 84.0f, 96.0f };
+// 0.5 is in the crossfade between the divide-down and wavetable voices of the
+// chord engine, and is the only value without feedback in the FM engine.
+const float kMorphs[] = { 0.0f, 0.25f, 0.5f, 0.75f, 1.0f };
+const size_t kNumNotes = sizeof(kNotes) / sizeof(float);
+const size_t kNumMorphs = sizeof(kMorphs) / sizeof(float);
+
+// Long enough for the smoothed morph of the chord engine to settle.
+const size_t kNumBlocks = 64;
+const size_t kNumSamples = kNumBlocks * kBlockSize;
+
+// Out, then aux, for each note and each morph value.
+const size_t kNumReferenceSamples = kNumNotes * kNumMorphs * 2 * kNumSamples;
+
+char ram_block[16 * 1024];
+int num_failures = 0;
+
+// Each render uses a new engine, in zeroed memory: some engines did not clear
+// all their state in Init.
+template<typename T>
+Engine* NewEngine() {
+  void* storage = calloc(1, sizeof(T));
+  return new(storage) T;
+}
+
+template<typename T>
+void DeleteEngine(Engine* engine) {
+  static_cast<T*>(engine)->~T();
+  free(engine);
+}
+
+struct EngineCheck {
+  const char* name;
+  Engine* (*new_engine)();
+  void (*delete_engine)(Engine*);
+  // Largest difference with the reference allowed at each note, in LSB. 0
+  // means that the render must be bit-identical.
+  float max_error[kNumNotes];
+};
+
+void Render(
+    const EngineCheck& check,
+    float note,
+    float morph,
+    float* out,
+    float* aux) {
+  Engine* engine = check.new_engine();
+  BufferAllocator allocator(ram_block, sizeof(ram_block));
+  Random::Seed(0x21);
+  engine->Init(&allocator);
+  engine->Reset();
+
+  EngineParameters parameters;
+  parameters.note = note;
+  parameters.timbre = 0.5f;
+  parameters.morph = morph;
+  parameters.harmonics = 0.5f;
+  parameters.accent = 0.8f;
+  for (size_t i = 0; i < kNumBlocks; ++i) {
+    // Struck once, for the modal engine.
+    parameters.trigger = i == 0 ? TRIGGER_RISING_EDGE : TRIGGER_LOW;
+    bool already_enveloped = false;
+    engine->Render(
+        parameters,
+        &out[i * kBlockSize],
+        &aux[i * kBlockSize],
+        kBlockSize,
+        &already_enveloped);
+  }
+  check.delete_engine(engine);
+}
+
+void RenderAll(const EngineCheck& check, float* output) {
+  for (size_t i = 0; i < kNumNotes; ++i) {
+    for (size_t j = 0; j < kNumMorphs; ++j) {
+      float* out = &output[(i * kNumMorphs + j) * 2 * kNumSamples];
+      Render(check, kNotes[i], kMorphs[j], out, out + kNumSamples);
+    }
+  }
+}
+
+string ReferencePath(const char* name) {
+  return string(kReferenceDirectory) + name + ".bin";
+}
+
+bool WriteReference(const char* name, const vector<float>& output) {
+  FILE* fp = fopen(ReferencePath(name).c_str(), "wb");
+  if (!fp) {
+    return false;
+  }
+  size_t written = fwrite(&output[0], sizeof(float), output.size(), fp);
+  fclose(fp);
+  return written == output.size();
+}
+
+bool ReadReference(const char* name, vector<float>* output) {
+  FILE* fp = fopen(ReferencePath(name).c_str(), "rb");
+  if (!fp) {
+    return false;
+  }
+  output->resize(kNumReferenceSamples);
+  size_t read = fread(&(*output)[0], sizeof(float), output->size(), fp);
+  fclose(fp);
+  return read == output->size();
+}
+
+void ValidateEngine(const EngineCheck& check) {
+  printf("%s\n", check.name);
+
+  vector<float> reference;
+  if (!ReadReference(check.name, &reference)) {
+    printf("  cannot read %s FAIL\n", ReferencePath(check.name).c_str());
+    ++num_failures;
+    return;
+  }
+  vector<float> output(kNumReferenceSamples);
+  RenderAll(check, &output[0]);
+
+  for (size_t i = 0; i < kNumNotes; ++i) {
+    const float bound = check.max_error[i];
+    for (size_t j = 0; j < kNumMorphs; ++j) {
+      const size_t offset = (i * kNumMorphs + j) * 2 * kNumSamples;
+      const float* a = &output[offset];
+      const float* b = &reference[offset];
+      bool identical = !memcmp(a, b, 2 * kNumSamples * sizeof(float));
+      float error = 0.0f;
+      for (size_t k = 0; k < 2 * kNumSamples; ++k) {
+        error = max(error, fabsf(a[k] - b[k]) * 32768.0f);
+      }
+      bool pass = bound == 0.0f ? identical : error <= bound;
+      if (!pass) {
+        ++num_failures;
+      }
+      char label[64];
+      sprintf(label, "note %2.0f morph %.2f", kNotes[i], kMorphs[j]);
+      if (bound == 0.0f) {
+        printf(
+            "  %-28s %s %s\n",
+            label,
+            identical ? "identical    " : "differs      ",
+            pass ? "ok" : "FAIL");
+      } else {
+        printf(
+            "  %-28s %9.3f LSB at most %9.1f %s\n",
+            label,
+            error,
+            bound,
+            pass ? "ok" : "FAIL");
+      }
+    }
+  }
+}
+
+#define ENGINE(T) &NewEngine<T>, &DeleteEngine<T>
+
+EngineCheck engine_checks[] = {
+  // The harmonic oscillator computes the same sums, sample by sample.
+  { "additive", ENGINE(AdditiveEngine), { 0.0f, 0.0f, 0.0f, 0.0f } },
+  // The modes are summed in another order. The modes above Nyquist are not
+  // rendered any more: they used to be clamped to Nyquist, where they still
+  // rang a little, which shows at the highest notes.
+  { "modal", ENGINE(ModalEngine), { 0.1f, 0.1f, 1.0f, 8.0f } },
+  // The voices are summed in another order.
+  { "swarm", ENGINE(SwarmEngine), { 0.1f, 0.1f, 0.1f, 0.1f } },
+  // The voices are summed in another order. The inactive voices are frozen,
+  // as when each one was an oscillator of its own.
+  { "chord", ENGINE(ChordEngine), { 0.1f, 0.1f, 0.1f, 0.1f } },
+  // The 8 corners are read together, with the same arithmetic.
+  { "wavetable", ENGINE(WavetableEngine), { 0.0f, 0.0f, 0.0f, 0.0f } },
+  // The decimator sums its taps in another order.
+  { "fm", ENGINE(FMEngine), { 0.1f, 0.1f, 0.1f, 0.1f } },
+};
+
+const size_t kNumEngineChecks = sizeof(engine_checks) / sizeof(EngineCheck);
+
+int main(int argc, char** argv) {
+  bool write = argc > 1 && !strcmp(argv[1], "--write");
+
+  for (size_t i = 0; i < kNumEngineChecks; ++i) {
+    if (write) {
+      vector<float> output(kNumReferenceSamples);
+      RenderAll(engine_checks[i], &output[0]);
+      if (!WriteReference(engine_checks[i].name, output)) {
+        printf("Cannot write %s\n", ReferencePath(engine_checks[i].name).c_str());
+        return 1;
+      }
+    } else {
+      ValidateEngine(engine_checks[i]);
+    }
+  }
+
+  if (write) {
+    printf("References written\n");
+    return 0;
+  }
+  if (num_failures) {
+    printf("%d check(s) failed\n", num_failures);
+    return 1;
+  }
+  printf("All checks passed\n");
+  return 0;
+}
@@ -5,126 +5,74 @@
 #include "marbles/random/t_generator.h"
 #include "marbles/random/x_y_generator.h"
 #include "marbles/note_filter.h"
+#include "MarblesEntropy.hpp"
+#include "MarblesPresets.hpp"
+#include "MarblesSnapshot.hpp"
+#include "ScalaScale.hpp"
+#include <osdialog.h>
+#include <atomic>
+#include <mutex>
 
 
-static const int BLOCK_SIZE = 5;
+// Parameters and clocks are processed by blocks of block_size samples, which
+// also delays the outputs by block_size samples.
+static const int MAX_BLOCK_SIZE = 32;
+static const int DEFAULT_BLOCK_SIZE = 5;
+static const int block_sizes[] = {1, 2, 4, 5, 8, 16, 32};
 
 
-static const marbles::Scale preset_scales[6] = {
-	// C major
-	{
-		1.0f,
-		12,
-		{
-			{ 0.0000f, 255 },  // C
-			{ 0.0833f, 16 },   // C#
-			{ 0.1667f, 96 },   // D
-			{ 0.2500f, 24 },   // D#
-			{ 0.3333f, 128 },  // E
-			{ 0.4167f, 64 },   // F
-			{ 0.5000f, 8 },    // F#
-			{ 0.5833f, 192 },  // G
-			{ 0.6667f, 16 },   // G#
-			{ 0.7500f, 96 },   // A
-			{ 0.8333f, 24 },   // A#
-			{ 0.9167f, 128 },  // B
-		}
-	},
-
-	// C minor
-	{
-		1.0f,
-		12,
-		{
-			{ 0.0000f, 255 },  // C
-			{ 0.0833f, 16 },   // C#
-			{ 0.1667f, 96 },   // D
-			{ 0.2500f, 128 },  // Eb
-			{ 0.3333f, 8 },    // E
-			{ 0.4167f, 64 },   // F
-			{ 0.5000f, 4 },    // F#
-			{ 0.5833f, 192 },  // G
-			{ 0.6667f, 16 },   // G#
-			{ 0.7500f, 96 },   // A
-			{ 0.8333f, 128 },  // Bb
-			{ 0.9167f, 16 },   // B
-		}
-	},
-
-	// Pentatonic
-	{
-		1.0f,
-		12,
-		{
-			{ 0.0000f, 255 },  // C
-			{ 0.0833f, 4 },    // C#
-			{ 0.1667f, 96 },   // D
-			{ 0.2500f, 4 },    // Eb
-			{ 0.3333f, 4 },    // E
-			{ 0.4167f, 140 },  // F
-			{ 0.5000f, 4 },    // F#
-			{ 0.5833f, 192 },  // G
-			{ 0.6667f, 4 },    // G#
-			{ 0.7500f, 96 },   // A
-			{ 0.8333f, 4 },    // Bb
-			{ 0.9167f, 4 },    // B
-		}
-	},
-
-	// Pelog
-	{
-		1.0f,
-		7,
-		{
-			{ 0.0000f, 255 },  // C
-			{ 0.1275f, 128 },  // Db+
-			{ 0.2625f, 32 },  // Eb-
-			{ 0.4600f, 8 },    // F#-
-			{ 0.5883f, 192 },  // G
-			{ 0.7067f, 64 },  // Ab
-			{ 0.8817f, 16 },    // Bb+
-		}
-	},
-
-	// Raag Bhairav That
-	{
-		1.0f,
-		12,
-		{
-			{ 0.0000f, 255 }, // ** Sa
-			{ 0.0752f, 128 }, // ** Komal Re
-			{ 0.1699f, 4 },   //    Re
-			{ 0.2630f, 4 },   //    Komal Ga
-			{ 0.3219f, 128 }, // ** Ga
-			{ 0.4150f, 64 },  // ** Ma
-			{ 0.4918f, 4 },   //    Tivre Ma
-			{ 0.5850f, 192 }, // ** Pa
-			{ 0.6601f, 64 },  // ** Komal Dha
-			{ 0.7549f, 4 },   //    Dha
-			{ 0.8479f, 4 },   //    Komal Ni
-			{ 0.9069f, 64 },  // ** Ni
-		}
-	},
-
-	// Raag Shri
-	{
-		1.0f,
-		12,
-		{
-			{ 0.0000f, 255 }, // ** Sa
-			{ 0.0752f, 4 },   //    Komal Re
-			{ 0.1699f, 128 }, // ** Re
-			{ 0.2630f, 64 },  // ** Komal Ga
-			{ 0.3219f, 4 },   //    Ga
-			{ 0.4150f, 128 }, // ** Ma
-			{ 0.4918f, 4 },   //    Tivre Ma
-			{ 0.5850f, 192 }, // ** Pa
-			{ 0.6601f, 4 },   //    Komal Dha
-			{ 0.7549f, 64 },  // ** Dha
-			{ 0.8479f, 128 }, // ** Komal Ni
-			{ 0.9069f, 4 },   //    Ni
-		}
-	},
+static const int NUM_SNAPSHOT_SLOTS = 8;
+// Samples between two copies of the state for the UI thread, at least
+static const int STATE_PUBLISH_INTERVAL = 64;
+
+// Words of system entropy written to the random stream on each block, at most
+static const int ENTROPY_WORDS_PER_BLOCK = 4;
+
+static const float CLOCK_THRESHOLD = 1.7f;
+
+// Time elapsed since the clock crossed the threshold between the previous and
+// the current sample, in samples, assuming a linear segment between them.
+static float clockEdgeOffset(float previous, float current) {
+	float delta = current - previous;
+	if (delta == 0.f)
+		return 1.f;
+	return clamp((current - CLOCK_THRESHOLD) / delta, 0.f, 1.f);
+}
+
+
+// t modes follow marbles::TGeneratorModel. The button cycles through the
+// first three, or through the alternate three when one of them is selected.
+static const int NUM_T_MODES = 7;
+static const int T_MODE_MARKOV = marbles::T_GENERATOR_MODEL_MARKOV;
+
+
+static const int USER_SCALE_INDEX = NUM_PRESET_SCALES;
+
+static const std::string scaleLabels[NUM_PRESET_SCALES] = {
+	"Major",
+	"Minor",
+	"Pentatonic",
+	"Pelog",
+	"Raag Bhairav That",
+	"Raag Shri",
+};
+
+// Y is the first of the Y groups. The other ones are on the channels of the
+// polyphonic Y output. Their settings follow the X controls, or are set to
+// one of NUM_Y_LEVELS levels from 0 to 1.
+static const int FOLLOW_X = -1;
+static const int NUM_Y_LEVELS = 11;
+
+struct YGroup {
+	int divider_index = DEFAULT_Y_DIVIDER_INDEX;
+	// Levels, or FOLLOW_X
+	int spread = FOLLOW_X;
+	int bias = FOLLOW_X;
+	int steps = FOLLOW_X;
+	int deja_vu = 0;
+	// Scale slot and marbles::VoltageRange, or FOLLOW_X
+	int scale = FOLLOW_X;
+	int range = FOLLOW_X;
 };
 
 
@@ -191,9 +139,11 @@ struct Marbles : Module {
 
 	marbles::RandomGenerator random_generator;
 	marbles::RandomStream random_stream;
+	EntropySource entropy_source;
 	marbles::TGenerator t_generator;
 	marbles::XYGenerator xy_generator;
 	marbles::NoteFilter note_filter;
+	bool generators_initialized = false;
 
 	// State
 	dsp::BooleanTrigger tDejaVuTrigger;
@@ -203,6 +153,7 @@ struct Marbles : Module {
 	dsp::BooleanTrigger tRangeTrigger;
 	dsp::BooleanTrigger xRangeTrigger;
 	dsp::BooleanTrigger externalTrigger;
+	dsp::ClockDivider lightDivider;
 	bool t_deja_vu;
 	bool x_deja_vu;
 	int t_mode;
@@ -211,20 +162,79 @@ struct Marbles : Module {
 	int x_range;
 	bool external;
 	int x_scale;
-	int y_divider_index;
+	YGroup y_groups[marbles::kMaxNumYGroups];
 	int x_clock_source_internal;
+	// Mix system entropy into the random stream, so that instances never
+	// repeat each other. Off by default, and set with setEntropy().
+	bool use_entropy = false;
+
+	// Compiled scales, shared with the other instances
+	std::shared_ptr<const marbles::QuantizerTable> scale_tables[marbles::kNumScaleSlots];
+	// User scale handed over by the UI thread, applied in process()
+	std::mutex user_scale_mutex;
+	std::shared_ptr<const marbles::QuantizerTable> pending_user_scale_table;
+	std::atomic<bool> user_scale_changed{false};
+	std::string scala_tuning;
+	std::string scala_mapping;
+	std::string scala_name;
+
+	// Snapshots of the random memory. Capture and recall are requested by the
+	// UI thread and performed in process() on the next block boundary.
+	// snapshot_mutex guards the snapshots and the loaded state, which both
+	// threads access.
+	std::mutex snapshot_mutex;
+	MarblesSnapshot snapshots[NUM_SNAPSHOT_SLOTS];
+	std::atomic<bool> snapshot_used[NUM_SNAPSHOT_SLOTS];
+	std::atomic<int> capture_request{-1};
+	std::atomic<int> recall_request{-1};
+	// State read from the patch, also restored in process()
+	MarblesSnapshot loaded_state;
+	std::atomic<bool> loaded_state_pending{false};
+	// Current state, published by process() for the UI thread, which saves it
+	// in the patch. process() writes the buffer the UI thread is not reading.
+	// The sequence counter is odd while a buffer is written, and tells the UI
+	// thread to copy again if its buffer was overwritten during the copy.
+	MarblesSnapshot published_states[2];
+	std::atomic<uint32_t> published_state_sequence{0};
+	int published_state_age = 0;
 	
 	// Buffers
-	stmlib::GateFlags t_clocks[BLOCK_SIZE] = {};
+	stmlib::GateFlags t_clocks[MAX_BLOCK_SIZE] = {};
 	stmlib::GateFlags last_t_clock = 0;
-	stmlib::GateFlags xy_clocks[BLOCK_SIZE] = {};
+	stmlib::GateFlags xy_clocks[MAX_BLOCK_SIZE] = {};
 	stmlib::GateFlags last_xy_clock = 0;
-	float ramp_master[BLOCK_SIZE] = {};
-	float ramp_external[BLOCK_SIZE] = {};
-	float ramp_slave[2][BLOCK_SIZE] = {};
-	bool gates[BLOCK_SIZE * 2] = {};
-	float voltages[BLOCK_SIZE * 4] = {};
+	// Time elapsed since the threshold crossing, in samples, for each clock edge
+	float t_clock_edge_offsets[MAX_BLOCK_SIZE] = {};
+	float last_t_clock_voltage = 0.f;
+	float xy_clock_edge_offsets[MAX_BLOCK_SIZE] = {};
+	float last_xy_clock_voltage = 0.f;
+	float ramp_master[MAX_BLOCK_SIZE] = {};
+	float ramp_external[MAX_BLOCK_SIZE] = {};
+	float ramp_slave[2][MAX_BLOCK_SIZE] = {};
+	bool gates[MAX_BLOCK_SIZE * 2] = {};
+	float voltages[MAX_BLOCK_SIZE * 4] = {};
+	float poly_x_voltages[MAX_BLOCK_SIZE * marbles::kMaxNumPolyXChannels] = {};
+	float y_group_voltages[MAX_BLOCK_SIZE * marbles::kMaxNumYGroups] = {};
 	int blockIndex = 0;
+	int block_size = DEFAULT_BLOCK_SIZE;
+	// Set from the UI, applied on the next block boundary
+	int requested_block_size = DEFAULT_BLOCK_SIZE;
+	// Size and number of channels of the last computed block, which is being
+	// output
+	int output_block_size = DEFAULT_BLOCK_SIZE;
+	int output_poly_x_channels = 1;
+	int output_num_y_groups = 1;
+	// Number of channels of the X₁ output. Above 1, X₁ carries the polyphonic
+	// X bank instead of X₁.
+	int poly_x_channels = 1;
+	int requested_poly_x_channels = 1;
+	// Number of channels of the Y output, one per Y group
+	int num_y_groups = 1;
+	int requested_num_y_groups = 1;
+	// Light levels accumulated since the last light update
+	float light_gates[3] = {};
+	float light_voltages[4] = {};
+	int light_samples = 0;
 
 	Marbles() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -245,9 +255,17 @@ struct Marbles : Module {
 		configParam(X_STEPS_PARAM, 0.0, 1.0, 0.5, "Smoothness");
 		configParam(GATE_LEN_PARAM, 0.0, 1.0, 0.5, "Gate length");
 		configParam(GATE_LEN_RAND_PARAM, 0.0, 1.0, 0.0, "Gate length randomization");
+		lightDivider.setDivision(64);
 		random_generator.Init(1);
 		random_stream.Init(&random_generator);
 		note_filter.Init();
+		for (int i = 0; i < NUM_PRESET_SCALES; i++) {
+			scale_tables[i] = getQuantizerTable(preset_scales[i]);
+		}
+		scale_tables[USER_SCALE_INDEX] = scale_tables[0];
+		for (int i = 0; i < NUM_SNAPSHOT_SLOTS; i++) {
+			snapshot_used[i] = false;
+		}
 		onSampleRateChange();
 		onReset();
 	}
@@ -261,7 +279,9 @@ struct Marbles : Module {
 		x_range = 1;
 		external = false;
 		x_scale = 0;
-		y_divider_index = 8;
+		for (int i = 0; i < (int) marbles::kMaxNumYGroups; i++) {
+			y_groups[i] = YGroup();
+		}
 		x_clock_source_internal = 0;
 	}
 
@@ -273,16 +293,131 @@ struct Marbles : Module {
 	}
 
 	void onSampleRateChange() override {
+		// Keep the loops across sample rate changes
+		MarblesSnapshot snapshot;
+		if (generators_initialized)
+			saveSnapshot(&snapshot);
+
 		float sampleRate = APP->engine->getSampleRate();
 		t_generator.Init(&random_stream, sampleRate);
 		xy_generator.Init(&random_stream, sampleRate);
+		if (generators_initialized)
+			restoreSnapshot(snapshot);
+		generators_initialized = true;
+		publishState();
+
+		// Set scales. The tables are already compiled.
+		for (int i = 0; i < marbles::kNumScaleSlots; i++) {
+			xy_generator.LoadScale(i, scale_tables[i].get());
+		}
+	}
+
+	void setEntropy(bool enabled) {
+		use_entropy = enabled;
+		entropy_source.setEnabled(enabled);
+	}
+
+	void saveSnapshot(MarblesSnapshot *snapshot) {
+		snapshot->random_state = random_generator.state();
+		t_generator.SaveState(&snapshot->t);
+		xy_generator.SaveState(&snapshot->xy);
+	}
+
+	void restoreSnapshot(const MarblesSnapshot &snapshot) {
+		random_generator.Init(snapshot.random_state);
+		t_generator.RestoreState(snapshot.t);
+		xy_generator.RestoreState(snapshot.xy);
+	}
 
-		// Set scales
-		for (int i = 0; i < 6; i++) {
-			xy_generator.LoadScale(i, preset_scales[i]);
+	void applySnapshotRequests() {
+		// The requests are retried on the next block if the UI thread holds the
+		// lock
+		if (!snapshot_mutex.try_lock())
+			return;
+		if (loaded_state_pending) {
+			restoreSnapshot(loaded_state);
+			loaded_state_pending = false;
+		}
+		int slot = capture_request.exchange(-1);
+		if (slot >= 0) {
+			saveSnapshot(&snapshots[slot]);
+			snapshot_used[slot] = true;
+		}
+		slot = recall_request.exchange(-1);
+		if (slot >= 0 && snapshot_used[slot]) {
+			restoreSnapshot(snapshots[slot]);
+		}
+		snapshot_mutex.unlock();
+	}
+
+	// Called by process() only
+	void publishState() {
+		uint32_t sequence = published_state_sequence.load(std::memory_order_relaxed);
+		published_state_sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		saveSnapshot(&published_states[(sequence / 2 + 1) % 2]);
+		published_state_sequence.store(sequence + 2, std::memory_order_release);
+		published_state_age = 0;
+	}
+
+	// Called by the UI thread. Copies the last state published by process(),
+	// without touching the generators. A copy is only retried if process()
+	// published twice in the meantime.
+	void readState(MarblesSnapshot *state) {
+		while (true) {
+			uint32_t sequence = published_state_sequence.load(std::memory_order_acquire);
+			*state = published_states[(sequence / 2) % 2];
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (published_state_sequence.load(std::memory_order_relaxed) - (sequence & ~1u) <= 2)
+				return;
 		}
 	}
 
+	bool loadScala(const std::string &tuningText, const std::string &mappingText, std::string *error) {
+		ScalaTuning tuning;
+		if (!parseScalaTuning(tuningText, &tuning, error))
+			return false;
+		ScalaKeyboardMapping mapping;
+		if (!mappingText.empty() && !parseScalaKeyboardMapping(mappingText, &mapping, error))
+			return false;
+		marbles::Scale scale;
+		if (!compileScalaScale(tuning, mappingText.empty() ? NULL : &mapping, &scale, error))
+			return false;
+		std::shared_ptr<const marbles::QuantizerTable> table = getQuantizerTable(scale);
+		if (!table) {
+			*error = "Invalid scale";
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(user_scale_mutex);
+		pending_user_scale_table = table;
+		user_scale_changed = true;
+		scala_tuning = tuningText;
+		scala_mapping = mappingText;
+		scala_name = tuning.description;
+		return true;
+	}
+
+	// Returns the user slot to its default scale
+	void clearScala() {
+		std::lock_guard<std::mutex> lock(user_scale_mutex);
+		pending_user_scale_table = getQuantizerTable(preset_scales[0]);
+		user_scale_changed = true;
+		scala_tuning.clear();
+		scala_mapping.clear();
+		scala_name.clear();
+	}
+
+	void applyUserScale() {
+		if (!user_scale_changed || !user_scale_mutex.try_lock())
+			return;
+		// The previous table is released by the UI thread, not here
+		std::swap(scale_tables[USER_SCALE_INDEX], pending_user_scale_table);
+		xy_generator.LoadScale(USER_SCALE_INDEX, scale_tables[USER_SCALE_INDEX].get());
+		user_scale_changed = false;
+		user_scale_mutex.unlock();
+	}
+
 	json_t *dataToJson() override {
 		json_t *rootJ = json_object();
 
@@ -294,8 +429,49 @@ struct Marbles : Module {
 		json_object_set_new(rootJ, "x_range", json_integer(x_range));
 		json_object_set_new(rootJ, "external", json_boolean(external));
 		json_object_set_new(rootJ, "x_scale", json_integer(x_scale));
-		json_object_set_new(rootJ, "y_divider_index", json_integer(y_divider_index));
+		json_object_set_new(rootJ, "y_divider_index", json_integer(y_groups[0].divider_index));
+		json_t *y_groupsJ = json_array();
+		for (int i = 0; i < (int) marbles::kMaxNumYGroups; i++) {
+			const YGroup &group = y_groups[i];
+			json_t *groupJ = json_object();
+			json_object_set_new(groupJ, "divider_index", json_integer(group.divider_index));
+			json_object_set_new(groupJ, "spread", json_integer(group.spread));
+			json_object_set_new(groupJ, "bias", json_integer(group.bias));
+			json_object_set_new(groupJ, "steps", json_integer(group.steps));
+			json_object_set_new(groupJ, "deja_vu", json_integer(group.deja_vu));
+			json_object_set_new(groupJ, "scale", json_integer(group.scale));
+			json_object_set_new(groupJ, "range", json_integer(group.range));
+			json_array_append_new(y_groupsJ, groupJ);
+		}
+		json_object_set_new(rootJ, "y_groups", y_groupsJ);
 		json_object_set_new(rootJ, "x_clock_source_internal", json_integer(x_clock_source_internal));
+		json_object_set_new(rootJ, "block_size", json_integer(requested_block_size));
+		json_object_set_new(rootJ, "poly_x_channels", json_integer(requested_poly_x_channels));
+		json_object_set_new(rootJ, "num_y_groups", json_integer(requested_num_y_groups));
+		json_object_set_new(rootJ, "entropy", json_boolean(use_entropy));
+		{
+			std::lock_guard<std::mutex> lock(user_scale_mutex);
+			if (!scala_tuning.empty()) {
+				json_object_set_new(rootJ, "scala_tuning", json_string(scala_tuning.c_str()));
+				json_object_set_new(rootJ, "scala_mapping", json_string(scala_mapping.c_str()));
+			}
+		}
+
+		MarblesSnapshot state;
+		readState(&state);
+		std::lock_guard<std::mutex> lock(snapshot_mutex);
+		// The state of a patch is not applied until the module is processed
+		if (loaded_state_pending)
+			state = loaded_state;
+		json_object_set_new(rootJ, "state", json_string(encodeMarblesSnapshot(state).c_str()));
+		json_t *snapshotsJ = json_array();
+		for (int i = 0; i < NUM_SNAPSHOT_SLOTS; i++) {
+			if (snapshot_used[i])
+				json_array_append_new(snapshotsJ, json_string(encodeMarblesSnapshot(snapshots[i]).c_str()));
+			else
+				json_array_append_new(snapshotsJ, json_null());
+		}
+		json_object_set_new(rootJ, "snapshots", snapshotsJ);
 		return rootJ;
 	}
 
@@ -310,7 +486,7 @@ struct Marbles : Module {
 
 		json_t *t_modeJ = json_object_get(rootJ, "t_mode");
 		if (t_modeJ)
-			t_mode = json_integer_value(t_modeJ);
+			t_mode = clamp((int) json_integer_value(t_modeJ), 0, NUM_T_MODES - 1);
 
 		json_t *x_modeJ = json_object_get(rootJ, "x_mode");
 		if (x_modeJ)
@@ -334,15 +510,79 @@ struct Marbles : Module {
 
 		json_t *y_divider_indexJ = json_object_get(rootJ, "y_divider_index");
 		if (y_divider_indexJ)
-			y_divider_index = json_integer_value(y_divider_indexJ);
+			y_groups[0].divider_index = clamp((int) json_integer_value(y_divider_indexJ), 0, (int) LENGTHOF(y_divider_ratios) - 1);
+
+		json_t *y_groupsJ = json_object_get(rootJ, "y_groups");
+		if (y_groupsJ) {
+			for (int i = 0; i < (int) marbles::kMaxNumYGroups; i++) {
+				json_t *groupJ = json_array_get(y_groupsJ, i);
+				if (!groupJ)
+					break;
+				YGroup &group = y_groups[i];
+				group.divider_index = clamp((int) json_integer_value(json_object_get(groupJ, "divider_index")), 0, (int) LENGTHOF(y_divider_ratios) - 1);
+				group.spread = clamp((int) json_integer_value(json_object_get(groupJ, "spread")), FOLLOW_X, NUM_Y_LEVELS - 1);
+				group.bias = clamp((int) json_integer_value(json_object_get(groupJ, "bias")), FOLLOW_X, NUM_Y_LEVELS - 1);
+				group.steps = clamp((int) json_integer_value(json_object_get(groupJ, "steps")), FOLLOW_X, NUM_Y_LEVELS - 1);
+				group.deja_vu = clamp((int) json_integer_value(json_object_get(groupJ, "deja_vu")), FOLLOW_X, NUM_Y_LEVELS - 1);
+				group.scale = clamp((int) json_integer_value(json_object_get(groupJ, "scale")), FOLLOW_X, marbles::kNumScaleSlots - 1);
+				group.range = clamp((int) json_integer_value(json_object_get(groupJ, "range")), FOLLOW_X, (int) marbles::VOLTAGE_RANGE_FULL);
+			}
+		}
 
 		json_t *x_clock_source_internalJ = json_object_get(rootJ, "x_clock_source_internal");
 		if (x_clock_source_internalJ)
 			x_clock_source_internal = json_integer_value(x_clock_source_internalJ);
-		
+
+		json_t *block_sizeJ = json_object_get(rootJ, "block_size");
+		if (block_sizeJ)
+			requested_block_size = clamp((int) json_integer_value(block_sizeJ), 1, MAX_BLOCK_SIZE);
+
+		json_t *poly_x_channelsJ = json_object_get(rootJ, "poly_x_channels");
+		if (poly_x_channelsJ)
+			requested_poly_x_channels = clamp((int) json_integer_value(poly_x_channelsJ), 1, (int) marbles::kMaxNumPolyXChannels);
+
+		json_t *num_y_groupsJ = json_object_get(rootJ, "num_y_groups");
+		if (num_y_groupsJ)
+			requested_num_y_groups = clamp((int) json_integer_value(num_y_groupsJ), 1, (int) marbles::kMaxNumYGroups);
+
+		// Patches saved before this option keep their deterministic stream
+		json_t *entropyJ = json_object_get(rootJ, "entropy");
+		setEntropy(entropyJ && json_boolean_value(entropyJ));
+
+		json_t *scala_tuningJ = json_object_get(rootJ, "scala_tuning");
+		if (scala_tuningJ) {
+			json_t *scala_mappingJ = json_object_get(rootJ, "scala_mapping");
+			std::string error;
+			if (!loadScala(json_string_value(scala_tuningJ), scala_mappingJ ? json_string_value(scala_mappingJ) : "", &error))
+				WARN("Marbles: could not restore Scala scale: %s", error.c_str());
+		}
+		else {
+			clearScala();
+		}
+
+		std::lock_guard<std::mutex> lock(snapshot_mutex);
+		json_t *stateJ = json_object_get(rootJ, "state");
+		if (stateJ) {
+			if (decodeMarblesSnapshot(json_string_value(stateJ), &loaded_state))
+				loaded_state_pending = true;
+			else
+				WARN("Marbles: could not restore random memory");
+		}
+
+		json_t *snapshotsJ = json_object_get(rootJ, "snapshots");
+		if (snapshotsJ) {
+			for (int i = 0; i < NUM_SNAPSHOT_SLOTS; i++) {
+				json_t *snapshotJ = json_array_get(snapshotsJ, i);
+				snapshot_used[i] = false;
+				if (snapshotJ && json_is_string(snapshotJ))
+					snapshot_used[i] = decodeMarblesSnapshot(json_string_value(snapshotJ), &snapshots[i]);
+			}
+		}
 	}
 
 	void process(const ProcessArgs &args) override {
+		applyUserScale();
+
 		// Buttons
 		if (tDejaVuTrigger.process(params[T_DEJA_VU_PARAM].getValue() <= 0.f)) {
 			t_deja_vu = !t_deja_vu;
@@ -351,7 +591,10 @@ struct Marbles : Module {
 			x_deja_vu = !x_deja_vu;
 		}
 		if (tModeTrigger.process(params[T_MODE_PARAM].getValue() <= 0.f)) {
-			t_mode = (t_mode + 1) % 3;
+			if (t_mode == T_MODE_MARKOV)
+				t_mode = 0;
+			else
+				t_mode = t_mode / 3 * 3 + (t_mode + 1) % 3;
 		}
 		if (xModeTrigger.process(params[X_MODE_PARAM].getValue() <= 0.f)) {
 			x_mode = (x_mode + 1) % 3;
@@ -367,27 +610,79 @@ struct Marbles : Module {
 		}
 
 		// Clocks
-		bool t_gate = (inputs[T_CLOCK_INPUT].getVoltage() >= 1.7f);
+		if (blockIndex == 0) {
+			block_size = requested_block_size;
+			poly_x_channels = requested_poly_x_channels;
+			num_y_groups = requested_num_y_groups;
+		}
+
+		float t_clock_voltage = inputs[T_CLOCK_INPUT].getVoltage();
+		bool t_gate = (t_clock_voltage >= CLOCK_THRESHOLD);
 		last_t_clock = stmlib::ExtractGateFlags(last_t_clock, t_gate);
 		t_clocks[blockIndex] = last_t_clock;
+		t_clock_edge_offsets[blockIndex] = clockEdgeOffset(last_t_clock_voltage, t_clock_voltage);
+		last_t_clock_voltage = t_clock_voltage;
 
-		bool x_gate = (inputs[X_CLOCK_INPUT].getVoltage() >= 1.7f);
+		float x_clock_voltage = inputs[X_CLOCK_INPUT].getVoltage();
+		bool x_gate = (x_clock_voltage >= CLOCK_THRESHOLD);
 		last_xy_clock = stmlib::ExtractGateFlags(last_xy_clock, x_gate);
 		xy_clocks[blockIndex] = last_xy_clock;
+		xy_clock_edge_offsets[blockIndex] = clockEdgeOffset(last_xy_clock_voltage, x_clock_voltage);
+		last_xy_clock_voltage = x_clock_voltage;
 
 		// Process block
-		if (++blockIndex >= BLOCK_SIZE) {
+		if (++blockIndex >= block_size) {
 			blockIndex = 0;
 			stepBlock();
 		}
 
-		// Lights and outputs
+		// Outputs. After a change of the block size or of the number of
+		// channels, the outputs follow the previous block until the first block
+		// with the new settings is ready, holding its last values if it was
+		// shorter.
+		int outputIndex = std::min(blockIndex, output_block_size - 1);
+		outputs[T1_OUTPUT].setVoltage(gates[outputIndex*2 + 0] ? 10.f : 0.f);
+		outputs[T2_OUTPUT].setVoltage((ramp_master[outputIndex] < 0.5f) ? 10.f : 0.f);
+		outputs[T3_OUTPUT].setVoltage(gates[outputIndex*2 + 1] ? 10.f : 0.f);
+
+		if (output_poly_x_channels > 1) {
+			outputs[X1_OUTPUT].setChannels(output_poly_x_channels);
+			for (int c = 0; c < output_poly_x_channels; c++) {
+				outputs[X1_OUTPUT].setVoltage(poly_x_voltages[outputIndex*marbles::kMaxNumPolyXChannels + c], c);
+			}
+		}
+		else {
+			outputs[X1_OUTPUT].setChannels(1);
+			outputs[X1_OUTPUT].setVoltage(voltages[outputIndex*4 + 0]);
+		}
+		outputs[X2_OUTPUT].setVoltage(voltages[outputIndex*4 + 1]);
+		outputs[X3_OUTPUT].setVoltage(voltages[outputIndex*4 + 2]);
+		if (output_num_y_groups > 1) {
+			outputs[Y_OUTPUT].setChannels(output_num_y_groups);
+			for (int c = 0; c < output_num_y_groups; c++) {
+				outputs[Y_OUTPUT].setVoltage(y_group_voltages[outputIndex*marbles::kMaxNumYGroups + c], c);
+			}
+		}
+		else {
+			outputs[Y_OUTPUT].setChannels(1);
+			outputs[Y_OUTPUT].setVoltage(voltages[outputIndex*4 + 3]);
+		}
+
+		// Lights
+		if (lightDivider.process()) {
+			updateLights(args.sampleTime * lightDivider.getDivision());
+		}
+	}
 
+	void updateLights(float deltaTime) {
 		lights[T_DEJA_VU_LIGHT].setBrightness(t_deja_vu);
 		lights[X_DEJA_VU_LIGHT].setBrightness(x_deja_vu);
 
-		lights[T_MODE_LIGHTS + 0].setBrightness(t_mode == 0 || t_mode == 1);
-		lights[T_MODE_LIGHTS + 1].setBrightness(t_mode == 1 || t_mode == 2);
+		// The alternate models are shown dimmed, Markov with both lights off
+		int t_mode_light = t_mode % 3;
+		float t_mode_brightness = (t_mode == T_MODE_MARKOV) ? 0.f : (t_mode < 3) ? 1.f : 0.5f;
+		lights[T_MODE_LIGHTS + 0].setBrightness((t_mode_light == 0 || t_mode_light == 1) * t_mode_brightness);
+		lights[T_MODE_LIGHTS + 1].setBrightness((t_mode_light == 1 || t_mode_light == 2) * t_mode_brightness);
 
 		lights[X_MODE_LIGHTS + 0].setBrightness(x_mode == 0 || x_mode == 1);
 		lights[X_MODE_LIGHTS + 1].setBrightness(x_mode == 1 || x_mode == 2);
@@ -400,24 +695,71 @@ struct Marbles : Module {
 
 		lights[EXTERNAL_LIGHT].setBrightness(external);
 
-		outputs[T1_OUTPUT].setVoltage(gates[blockIndex*2 + 0] ? 10.f : 0.f);
-		lights[T1_LIGHT].setSmoothBrightness(gates[blockIndex*2 + 0], args.sampleTime);
-		outputs[T2_OUTPUT].setVoltage((ramp_master[blockIndex] < 0.5f) ? 10.f : 0.f);
-		lights[T2_LIGHT].setSmoothBrightness(ramp_master[blockIndex] < 0.5f, args.sampleTime);
-		outputs[T3_OUTPUT].setVoltage(gates[blockIndex*2 + 1] ? 10.f : 0.f);
-		lights[T3_LIGHT].setSmoothBrightness(gates[blockIndex*2 + 1], args.sampleTime);
-
-		outputs[X1_OUTPUT].setVoltage(voltages[blockIndex*4 + 0]);
-		lights[X1_LIGHT].setSmoothBrightness(voltages[blockIndex*4 + 0], args.sampleTime);
-		outputs[X2_OUTPUT].setVoltage(voltages[blockIndex*4 + 1]);
-		lights[X2_LIGHT].setSmoothBrightness(voltages[blockIndex*4 + 1], args.sampleTime);
-		outputs[X3_OUTPUT].setVoltage(voltages[blockIndex*4 + 2]);
-		lights[X3_LIGHT].setSmoothBrightness(voltages[blockIndex*4 + 2], args.sampleTime);
-		outputs[Y_OUTPUT].setVoltage(voltages[blockIndex*4 + 3]);
-		lights[Y_LIGHT].setSmoothBrightness(voltages[blockIndex*4 + 3], args.sampleTime);
+		// Blocks may be longer than the light period
+		if (light_samples == 0)
+			return;
+
+		// A gate seen at any time since the last update lights up its LED
+		lights[T1_LIGHT].setSmoothBrightness(light_gates[0], deltaTime);
+		lights[T2_LIGHT].setSmoothBrightness(light_gates[1], deltaTime);
+		lights[T3_LIGHT].setSmoothBrightness(light_gates[2], deltaTime);
+
+		float scale = 1.f / light_samples;
+		lights[X1_LIGHT].setSmoothBrightness(light_voltages[0] * scale, deltaTime);
+		lights[X2_LIGHT].setSmoothBrightness(light_voltages[1] * scale, deltaTime);
+		lights[X3_LIGHT].setSmoothBrightness(light_voltages[2] * scale, deltaTime);
+		lights[Y_LIGHT].setSmoothBrightness(light_voltages[3] * scale, deltaTime);
+
+		std::fill(light_gates, light_gates + 3, 0.f);
+		std::fill(light_voltages, light_voltages + 4, 0.f);
+		light_samples = 0;
+	}
+
+	// Accumulates the block's outputs for the next light update
+	void accumulateLights() {
+		for (int i = 0; i < block_size; i++) {
+			light_gates[0] = std::max(light_gates[0], gates[i*2 + 0] ? 1.f : 0.f);
+			light_gates[1] = std::max(light_gates[1], ramp_master[i] < 0.5f ? 1.f : 0.f);
+			light_gates[2] = std::max(light_gates[2], gates[i*2 + 1] ? 1.f : 0.f);
+			for (int j = 0; j < 4; j++) {
+				light_voltages[j] += voltages[i*4 + j];
+			}
+		}
+		light_samples += block_size;
+	}
+
+	marbles::GroupSettings getYGroupSettings(const YGroup &group, const marbles::GroupSettings &x) {
+		marbles::GroupSettings y;
+		y.control_mode = marbles::CONTROL_MODE_IDENTICAL;
+		y.voltage_range = (group.range == FOLLOW_X) ? x.voltage_range : (marbles::VoltageRange) group.range;
+		y.register_mode = false;
+		y.register_value = 0.0f;
+		y.spread = getYGroupLevel(group.spread, x.spread);
+		y.bias = getYGroupLevel(group.bias, x.bias);
+		y.steps = getYGroupLevel(group.steps, x.steps);
+		y.deja_vu = getYGroupLevel(group.deja_vu, x.deja_vu);
+		y.length = (y.deja_vu > 0.f) ? x.length : 1;
+		y.ratio = y_divider_ratios[group.divider_index];
+		y.scale_index = (group.scale == FOLLOW_X) ? x.scale_index : group.scale;
+		return y;
+	}
+
+	static float getYGroupLevel(int level, float x) {
+		return (level == FOLLOW_X) ? x : (float) level / (NUM_Y_LEVELS - 1);
 	}
 
 	void stepBlock() {
+		applySnapshotRequests();
+
+		// Entropy
+
+		if (use_entropy) {
+			uint32_t word;
+			for (int i = 0; i < ENTROPY_WORDS_PER_BLOCK && entropy_source.read(&word); i++) {
+				random_stream.Write(word);
+			}
+		}
+
 		// Ramps
 
 		marbles::Ramps ramps;
@@ -459,7 +801,7 @@ struct Marbles : Module {
 		t_generator.set_pulse_width_mean(params[GATE_LEN_PARAM].getValue());
 		//t_generator.set_pulse_width_std(_gate_len_dev);
 		t_generator.set_pulse_width_std(params[GATE_LEN_RAND_PARAM].getValue());
-		t_generator.Process(t_external_clock, t_clocks, ramps, gates, BLOCK_SIZE);
+		t_generator.Process(t_external_clock, t_clocks, ramps, gates, block_size, t_clock_edge_offsets);
 
 		// Set up XYGenerator
 
@@ -488,36 +830,25 @@ struct Marbles : Module {
 		x.ratio.q = 1;
 		x.scale_index = x_scale;
 
-		marbles::GroupSettings y;
-		y.control_mode = marbles::CONTROL_MODE_IDENTICAL;
-		// TODO
-		y.voltage_range = (marbles::VoltageRange) x_range;
-		y.register_mode = false;
-		y.register_value = 0.0f;
-		// TODO
-		y.spread = x_spread;
-		y.bias = x_bias;
-		y.steps = x_steps;
-		y.deja_vu = 0.0f;
-		y.length = 1;
-		static const marbles::Ratio y_divider_ratios[] = {
-			{ 1, 64 },
-			{ 1, 48 },
-			{ 1, 32 },
-			{ 1, 24 },
-			{ 1, 16 },
-			{ 1, 12 },
-			{ 1, 8 },
-			{ 1, 6 },
-			{ 1, 4 },
-			{ 1, 3 },
-			{ 1, 2 },
-			{ 1, 1 },
-		};
-		y.ratio = y_divider_ratios[y_divider_index];
-		y.scale_index = x_scale;
+		marbles::GroupSettings y = getYGroupSettings(y_groups[0], x);
+		for (int i = 1; i < num_y_groups; i++) {
+			xy_generator.set_y_group_settings(i, getYGroupSettings(y_groups[i], x));
+		}
+
+		xy_generator.set_num_poly_x_channels(poly_x_channels > 1 ? poly_x_channels : 0);
+		xy_generator.set_num_y_groups(num_y_groups);
+		xy_generator.Process(x_clock_source, x, y, xy_clocks, ramps, voltages, block_size, poly_x_channels > 1 ? poly_x_voltages : NULL, xy_clock_edge_offsets, num_y_groups > 1 ? y_group_voltages : NULL);
+		output_block_size = block_size;
+		output_poly_x_channels = poly_x_channels;
+		output_num_y_groups = num_y_groups;
 
-		xy_generator.Process(x_clock_source, x, y, xy_clocks, ramps, voltages, BLOCK_SIZE);
+		// The state is published every few blocks only, as the copy costs more
+		// than a block of 1 sample.
+		published_state_age += block_size;
+		if (published_state_age >= STATE_PUBLISH_INTERVAL)
+			publishState();
+
+		accumulateLights();
 	}
 };
 
@@ -597,6 +928,32 @@ struct MarblesWidget : ModuleWidget {
 	void appendContextMenu(Menu *menu) override {
 		Marbles *module = dynamic_cast<Marbles*>(this->module);
 
+		struct TModeItem : MenuItem {
+			Marbles *module;
+			int t_mode;
+			void onAction(const event::Action &e) override {
+				module->t_mode = t_mode;
+			}
+		};
+
+		menu->addChild(new MenuEntry);
+		menu->addChild(createMenuLabel("t mode"));
+		const std::string tModeLabels[NUM_T_MODES] = {
+			"Complementary Bernoulli",
+			"Clusters",
+			"Drums",
+			"Independent Bernoulli",
+			"Divider",
+			"Three states",
+			"Markov",
+		};
+		for (int i = 0; i < NUM_T_MODES; i++) {
+			TModeItem *item = createMenuItem<TModeItem>(tModeLabels[i], CHECKMARK(module->t_mode == i));
+			item->module = module;
+			item->t_mode = i;
+			menu->addChild(item);
+		}
+
 		struct ScaleItem : MenuItem {
 			Marbles *module;
 			int scale;
@@ -607,20 +964,68 @@ struct MarblesWidget : ModuleWidget {
 
 		menu->addChild(new MenuEntry);
 		menu->addChild(createMenuLabel("Scales"));
-		const std::string scaleLabels[] = {
-			"Major",
-			"Minor",
-			"Pentatonic",
-			"Pelog",
-			"Raag Bhairav That",
-			"Raag Shri",
-		};
-		for (int i = 0; i < (int) LENGTHOF(scaleLabels); i++) {
+		for (int i = 0; i < NUM_PRESET_SCALES; i++) {
 			ScaleItem *item = createMenuItem<ScaleItem>(scaleLabels[i], CHECKMARK(module->x_scale == i));
 			item->module = module;
 			item->scale = i;
 			menu->addChild(item);
 		}
+		std::string userScaleLabel = "Scala: " + (module->scala_tuning.empty() ? std::string("(none loaded)") : module->scala_name);
+		ScaleItem *userScaleItem = createMenuItem<ScaleItem>(userScaleLabel, CHECKMARK(module->x_scale == USER_SCALE_INDEX));
+		userScaleItem->module = module;
+		userScaleItem->scale = USER_SCALE_INDEX;
+		menu->addChild(userScaleItem);
+
+		struct LoadScalaItem : MenuItem {
+			Marbles *module;
+			bool mapping;
+			void onAction(const event::Action &e) override {
+				osdialog_filters *filters = osdialog_filters_parse(mapping ? "Scala keyboard mapping:kbm" : "Scala tuning:scl");
+				char *path = osdialog_file(OSDIALOG_OPEN, NULL, NULL, filters);
+				osdialog_filters_free(filters);
+				if (!path)
+					return;
+				std::string text;
+				std::string error;
+				bool read = readScalaFile(path, &text, &error);
+				free(path);
+				if (!read) {
+					osdialog_message(OSDIALOG_WARNING, OSDIALOG_OK, error.c_str());
+					return;
+				}
+
+				std::string tuning = mapping ? module->scala_tuning : text;
+				std::string keyboardMapping = mapping ? text : module->scala_mapping;
+				if (module->loadScala(tuning, keyboardMapping, &error))
+					module->x_scale = USER_SCALE_INDEX;
+				else
+					osdialog_message(OSDIALOG_WARNING, OSDIALOG_OK, error.c_str());
+			}
+		};
+
+		struct ClearScalaMappingItem : MenuItem {
+			Marbles *module;
+			void onAction(const event::Action &e) override {
+				std::string error;
+				module->loadScala(module->scala_tuning, "", &error);
+			}
+		};
+
+		LoadScalaItem *loadTuningItem = createMenuItem<LoadScalaItem>("Load Scala tuning (.scl)...");
+		loadTuningItem->module = module;
+		loadTuningItem->mapping = false;
+		menu->addChild(loadTuningItem);
+		if (!module->scala_tuning.empty()) {
+			LoadScalaItem *loadMappingItem = createMenuItem<LoadScalaItem>("Load Scala keyboard mapping (.kbm)...");
+			loadMappingItem->module = module;
+			loadMappingItem->mapping = true;
+			menu->addChild(loadMappingItem);
+		}
+		if (!module->scala_mapping.empty()) {
+			ClearScalaMappingItem *clearMappingItem = createMenuItem<ClearScalaMappingItem>("Clear keyboard mapping");
+			clearMappingItem->module = module;
+			menu->addChild(clearMappingItem);
+		}
 
 		struct XClockSourceInternal : MenuItem {
 			Marbles *module;
@@ -645,46 +1050,229 @@ struct MarblesWidget : ModuleWidget {
 			menu->addChild(item);
 		}
 
-		struct YDividerIndexItem : MenuItem {
+		// Y group settings are ints, chosen from a list of labels for the
+		// values firstValue, firstValue + 1...
+		struct YGroupValueItem : MenuItem {
+			int *setting;
+			int value;
+			void onAction(const event::Action &e) override {
+				*setting = value;
+			}
+		};
+
+		struct YGroupSettingItem : MenuItem {
+			int *setting;
+			int firstValue;
+			std::vector<std::string> labels;
+			Menu *createChildMenu() override {
+				Menu *menu = new Menu();
+				for (int i = 0; i < (int) labels.size(); i++) {
+					YGroupValueItem *item = createMenuItem<YGroupValueItem>(labels[i], CHECKMARK(*setting == firstValue + i));
+					item->setting = setting;
+					item->value = firstValue + i;
+					menu->addChild(item);
+				}
+				return menu;
+			}
+		};
+
+		struct YGroupItem : MenuItem {
+			Marbles *module;
+			int group;
+			void addSetting(Menu *menu, std::string text, int *setting, int firstValue, const std::vector<std::string> &labels) {
+				YGroupSettingItem *item = createMenuItem<YGroupSettingItem>(text, RIGHT_ARROW);
+				item->setting = setting;
+				item->firstValue = firstValue;
+				item->labels = labels;
+				menu->addChild(item);
+			}
+			Menu *createChildMenu() override {
+				Menu *menu = new Menu();
+				YGroup &settings = module->y_groups[group];
+
+				std::vector<std::string> dividerLabels;
+				for (int i = 0; i < (int) LENGTHOF(y_divider_ratios); i++) {
+					const marbles::Ratio &ratio = y_divider_ratios[i];
+					dividerLabels.push_back(ratio.q == 1 ? string::f("%d", ratio.p) : string::f("%d/%d", ratio.p, ratio.q));
+				}
+				addSetting(menu, "Divider ratio", &settings.divider_index, 0, dividerLabels);
+
+				std::vector<std::string> levelLabels = {"Follow X"};
+				for (int i = 0; i < NUM_Y_LEVELS; i++) {
+					levelLabels.push_back(string::f("%d%%", i * 100 / (NUM_Y_LEVELS - 1)));
+				}
+				addSetting(menu, "Spread", &settings.spread, FOLLOW_X, levelLabels);
+				addSetting(menu, "Bias", &settings.bias, FOLLOW_X, levelLabels);
+				addSetting(menu, "Steps", &settings.steps, FOLLOW_X, levelLabels);
+				addSetting(menu, "Deja vu", &settings.deja_vu, FOLLOW_X, levelLabels);
+
+				std::vector<std::string> scaleSlotLabels = {"Follow X"};
+				scaleSlotLabels.insert(scaleSlotLabels.end(), scaleLabels, scaleLabels + NUM_PRESET_SCALES);
+				scaleSlotLabels.push_back("Scala");
+				addSetting(menu, "Scale", &settings.scale, FOLLOW_X, scaleSlotLabels);
+
+				addSetting(menu, "Voltage range", &settings.range, FOLLOW_X, {"Follow X", "0V to 2V", "0V to 5V", "-5V to 5V"});
+				return menu;
+			}
+		};
+
+		struct YGroupsValueItem : MenuItem {
+			Marbles *module;
+			int groups;
+			void onAction(const event::Action &e) override {
+				module->requested_num_y_groups = groups;
+			}
+		};
+
+		struct YGroupsItem : MenuItem {
+			Marbles *module;
+			Menu *createChildMenu() override {
+				Menu *menu = new Menu();
+				for (int groups = 1; groups <= (int) marbles::kMaxNumYGroups; groups++) {
+					std::string label = (groups == 1) ? "Monophonic (Y)" : string::f("%d", groups);
+					YGroupsValueItem *item = createMenuItem<YGroupsValueItem>(label, CHECKMARK(module->requested_num_y_groups == groups));
+					item->module = module;
+					item->groups = groups;
+					menu->addChild(item);
+				}
+				return menu;
+			}
+		};
+
+		menu->addChild(new MenuEntry);
+		menu->addChild(createMenuLabel("Y groups"));
+		YGroupsItem *yGroupsItem = createMenuItem<YGroupsItem>("Y polyphony", RIGHT_ARROW);
+		yGroupsItem->module = module;
+		menu->addChild(yGroupsItem);
+		for (int i = 0; i < module->requested_num_y_groups; i++) {
+			std::string label = (i == 0) ? "Y" : string::f("Y channel %d", i + 1);
+			YGroupItem *yGroupItem = createMenuItem<YGroupItem>(label, RIGHT_ARROW);
+			yGroupItem->module = module;
+			yGroupItem->group = i;
+			menu->addChild(yGroupItem);
+		}
+
+		struct BlockSizeValueItem : MenuItem {
+			Marbles *module;
+			int block_size;
+			void onAction(const event::Action &e) override {
+				module->requested_block_size = block_size;
+			}
+		};
+
+		struct BlockSizeItem : MenuItem {
+			Marbles *module;
+			Menu *createChildMenu() override {
+				Menu *menu = new Menu();
+				for (int i = 0; i < (int) LENGTHOF(block_sizes); i++) {
+					std::string label = string::f("%d", block_sizes[i]);
+					if (block_sizes[i] == 1)
+						label += " (sample accurate)";
+					else if (block_sizes[i] == DEFAULT_BLOCK_SIZE)
+						label += " (default)";
+					BlockSizeValueItem *item = createMenuItem<BlockSizeValueItem>(label, CHECKMARK(module->requested_block_size == block_sizes[i]));
+					item->module = module;
+					item->block_size = block_sizes[i];
+					menu->addChild(item);
+				}
+				return menu;
+			}
+		};
+
+		menu->addChild(new MenuEntry);
+		BlockSizeItem *blockSizeItem = createMenuItem<BlockSizeItem>("Block size (latency vs. CPU)", RIGHT_ARROW);
+		blockSizeItem->module = module;
+		menu->addChild(blockSizeItem);
+
+		struct PolyXChannelsValueItem : MenuItem {
 			Marbles *module;
-			int index;
+			int channels;
 			void onAction(const event::Action &e) override {
-				module->y_divider_index = index;
+				module->requested_poly_x_channels = channels;
 			}
 		};
 
-		struct YDividerItem : MenuItem {
+		struct PolyXChannelsItem : MenuItem {
 			Marbles *module;
 			Menu *createChildMenu() override {
 				Menu *menu = new Menu();
-				const std::string yDividerRatioLabels[] = {
-					"1/64",
-					"1/48",
-					"1/32",
-					"1/24",
-					"1/16",
-					"1/12",
-					"1/8",
-					"1/6",
-					"1/4",
-					"1/3",
-					"1/2",
-					"1",
-				};
-				for (int i = 0; i < (int) LENGTHOF(yDividerRatioLabels); i++) {
-					YDividerIndexItem *item = createMenuItem<YDividerIndexItem>(yDividerRatioLabels[i], CHECKMARK(module->y_divider_index == i));
+				for (int channels = 1; channels <= (int) marbles::kMaxNumPolyXChannels; channels++) {
+					std::string label = (channels == 1) ? "Monophonic (X₁)" : string::f("%d", channels);
+					PolyXChannelsValueItem *item = createMenuItem<PolyXChannelsValueItem>(label, CHECKMARK(module->requested_poly_x_channels == channels));
 					item->module = module;
-					item->index = i;
+					item->channels = channels;
 					menu->addChild(item);
 				}
 				return menu;
 			}
 		};
 
+		PolyXChannelsItem *polyXChannelsItem = createMenuItem<PolyXChannelsItem>("X₁ polyphony", RIGHT_ARROW);
+		polyXChannelsItem->module = module;
+		menu->addChild(polyXChannelsItem);
+
+		struct CaptureSnapshotItem : MenuItem {
+			Marbles *module;
+			int slot;
+			void onAction(const event::Action &e) override {
+				module->capture_request = slot;
+			}
+		};
+
+		struct RecallSnapshotItem : MenuItem {
+			Marbles *module;
+			int slot;
+			void onAction(const event::Action &e) override {
+				module->recall_request = slot;
+			}
+		};
+
+		struct SnapshotItem : MenuItem {
+			Marbles *module;
+			bool recall;
+			Menu *createChildMenu() override {
+				Menu *menu = new Menu();
+				for (int i = 0; i < NUM_SNAPSHOT_SLOTS; i++) {
+					std::string label = string::f("Slot %d", i + 1);
+					if (recall) {
+						RecallSnapshotItem *item = createMenuItem<RecallSnapshotItem>(label);
+						item->module = module;
+						item->slot = i;
+						item->disabled = !module->snapshot_used[i];
+						menu->addChild(item);
+					}
+					else {
+						CaptureSnapshotItem *item = createMenuItem<CaptureSnapshotItem>(label, module->snapshot_used[i] ? "Used" : "");
+						item->module = module;
+						item->slot = i;
+						menu->addChild(item);
+					}
+				}
+				return menu;
+			}
+		};
+
+		struct EntropyItem : MenuItem {
+			Marbles *module;
+			void onAction(const event::Action &e) override {
+				module->setEntropy(!module->use_entropy);
+			}
+		};
+
+		EntropyItem *entropyItem = createMenuItem<EntropyItem>("Mix in system entropy", CHECKMARK(module->use_entropy));
+		entropyItem->module = module;
+		menu->addChild(entropyItem);
+
 		menu->addChild(new MenuEntry);
-		YDividerItem *yDividerItem = createMenuItem<YDividerItem>("Y divider ratio");
-		yDividerItem->module = module;
-		menu->addChild(yDividerItem);
+		menu->addChild(createMenuLabel("Random memory snapshots"));
+		SnapshotItem *captureItem = createMenuItem<SnapshotItem>("Capture", RIGHT_ARROW);
+		captureItem->module = module;
+		captureItem->recall = false;
+		menu->addChild(captureItem);
+		SnapshotItem *recallItem = createMenuItem<SnapshotItem>("Recall", RIGHT_ARROW);
+		recallItem->module = module;
+		recallItem->recall = true;
+		menu->addChild(recallItem);
 
 		
 		menu->addChild(new MenuEntry);
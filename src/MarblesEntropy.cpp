@@ -0,0 +1,76 @@
+#include "MarblesEntropy.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+// Refill period of the buffers
+static const std::chrono::milliseconds refillPeriod(10);
+
+// The sources are registered and unregistered by the UI thread, when they are
+// enabled and disabled. The background thread runs while there is at least one
+// source.
+static std::mutex sourcesMutex;
+static std::condition_variable sourcesChanged;
+static std::vector<EntropySource*> sources;
+static std::thread refillThread;
+// Incremented to stop the current thread. A thread started right after, while
+// the previous one is still being joined, gets a new generation.
+static int refillGeneration = 0;
+
+static void refill(int generation) {
+	// Some implementations of random_device are deterministic, so the words
+	// are also mixed with the clock.
+	std::random_device device;
+	uint32_t counter = 0;
+	std::unique_lock<std::mutex> lock(sourcesMutex);
+	while (generation == refillGeneration) {
+		for (EntropySource *source : sources) {
+			while (!source->buffer.full()) {
+				uint32_t word = device();
+				word ^= (uint32_t) std::chrono::high_resolution_clock::now().time_since_epoch().count();
+				// Finalizer of MurmurHash3, to spread the clock bits
+				word ^= ++counter * 0x9e3779b9;
+				word ^= word >> 16;
+				word *= 0x85ebca6b;
+				word ^= word >> 13;
+				word *= 0xc2b2ae35;
+				word ^= word >> 16;
+				source->buffer.push(word);
+			}
+		}
+		sourcesChanged.wait_for(lock, refillPeriod);
+	}
+}
+
+EntropySource::~EntropySource() {
+	setEnabled(false);
+}
+
+void EntropySource::setEnabled(bool enabled) {
+	std::thread thread;
+	{
+		std::lock_guard<std::mutex> lock(sourcesMutex);
+		bool registered = std::find(sources.begin(), sources.end(), this) != sources.end();
+		if (enabled == registered)
+			return;
+		if (enabled) {
+			sources.push_back(this);
+			if (!refillThread.joinable())
+				refillThread = std::thread(refill, refillGeneration);
+			sourcesChanged.notify_one();
+			return;
+		}
+		sources.erase(std::remove(sources.begin(), sources.end(), this), sources.end());
+		if (!sources.empty())
+			return;
+		refillGeneration++;
+		std::swap(thread, refillThread);
+	}
+	sourcesChanged.notify_all();
+	thread.join();
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "plugin.hpp"
+
+// Words of system randomness for the Marbles random streams. A background
+// thread, shared by all the instances, keeps the buffer of each registered
+// source full. The audio thread only reads from its own buffer: no lock, no
+// system call, and nothing to wait for when the buffer is empty.
+struct EntropySource {
+	// Single producer (the background thread), single consumer (the audio
+	// thread).
+	dsp::RingBuffer<uint32_t, 256> buffer;
+
+	EntropySource() {}
+	~EntropySource();
+
+	// A source is registered, and its buffer refilled, only while it is
+	// enabled. Called by the UI thread.
+	void setEnabled(bool enabled);
+
+	bool read(uint32_t *word) {
+		if (buffer.empty())
+			return false;
+		*word = buffer.shift();
+		return true;
+	}
+};
@@ -0,0 +1,222 @@
+#include "MarblesSnapshot.hpp"
+#include <cstring>
+#include <vector>
+
+
+static const char snapshotMagic[4] = {'M', 'B', 'S', 'S'};
+// Version 3 is the first one whose fields are written one by one. Versions 1
+// and 2 were copies of the structs, which depended on the compiler.
+static const uint32_t snapshotVersion = 3;
+
+static const char base64Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static std::string toBase64(const uint8_t *data, size_t size) {
+	std::string text;
+	text.reserve((size + 2) / 3 * 4);
+	for (size_t i = 0; i < size; i += 3) {
+		uint32_t word = data[i] << 16;
+		if (i + 1 < size)
+			word |= data[i + 1] << 8;
+		if (i + 2 < size)
+			word |= data[i + 2];
+		text += base64Chars[(word >> 18) & 0x3f];
+		text += base64Chars[(word >> 12) & 0x3f];
+		text += (i + 1 < size) ? base64Chars[(word >> 6) & 0x3f] : '=';
+		text += (i + 2 < size) ? base64Chars[word & 0x3f] : '=';
+	}
+	return text;
+}
+
+static bool fromBase64(const std::string &text, std::vector<uint8_t> *data) {
+	data->clear();
+	uint32_t word = 0;
+	int bits = 0;
+	for (char c : text) {
+		if (c == '=')
+			break;
+		const char *p = strchr(base64Chars, c);
+		if (!p || !c)
+			return false;
+		word = (word << 6) | (p - base64Chars);
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			data->push_back((word >> bits) & 0xff);
+		}
+	}
+	return true;
+}
+
+
+// Writes each field as a little-endian 32-bit word, whatever its type in the
+// structs.
+struct SnapshotWriter {
+	std::vector<uint8_t> data;
+
+	void field(uint32_t value) {
+		for (int i = 0; i < 4; i++)
+			data.push_back((value >> (8 * i)) & 0xff);
+	}
+	void field(int32_t value) {
+		field((uint32_t) value);
+	}
+	void field(int8_t value) {
+		field((int32_t) value);
+	}
+	void field(float value) {
+		uint32_t word;
+		memcpy(&word, &value, sizeof(word));
+		field(word);
+	}
+};
+
+struct SnapshotReader {
+	const std::vector<uint8_t> &data;
+	size_t position;
+	bool overrun;
+
+	SnapshotReader(const std::vector<uint8_t> &data) : data(data), position(0), overrun(false) {}
+
+	uint32_t word() {
+		if (position + 4 > data.size()) {
+			overrun = true;
+			return 0;
+		}
+		uint32_t value = 0;
+		for (int i = 0; i < 4; i++)
+			value |= (uint32_t) data[position++] << (8 * i);
+		return value;
+	}
+	void field(uint32_t &value) {
+		value = word();
+	}
+	void field(int32_t &value) {
+		value = (int32_t) word();
+	}
+	void field(int8_t &value) {
+		value = (int8_t) (int32_t) word();
+	}
+	void field(float &value) {
+		uint32_t w = word();
+		memcpy(&value, &w, sizeof(value));
+	}
+};
+
+// The fields are listed once, and both written and read in this order.
+template <typename T>
+static void serialize(T &io, marbles::RandomSequenceState &state) {
+	for (int i = 0; i < marbles::kDejaVuBufferSize; i++)
+		io.field(state.loop[i]);
+	for (int i = 0; i < marbles::kHistoryBufferSize; i++)
+		io.field(state.history[i]);
+	io.field(state.loop_write_head);
+	io.field(state.length);
+	io.field(state.step);
+	io.field(state.record_head);
+	io.field(state.replay_head);
+	io.field(state.replay_start);
+	io.field(state.replay_hash);
+	io.field(state.replay_shift);
+	io.field(state.redo_read_index);
+	io.field(state.redo_write_index);
+	io.field(state.redo_write_history_index);
+}
+
+template <typename T>
+static void serialize(T &io, marbles::OutputChannelState &state) {
+	io.field(state.previous_voltage);
+	io.field(state.voltage);
+	io.field(state.quantized_voltage);
+}
+
+template <typename T>
+static void serialize(T &io, marbles::RampDividerState &state) {
+	io.field(state.phase);
+	io.field(state.train_phase);
+	io.field(state.max_train_phase);
+	io.field(state.f_ratio);
+	io.field(state.reset_counter);
+}
+
+template <typename T>
+static void serialize(T &io, marbles::TGeneratorState &state) {
+	serialize(io, state.sequence);
+	io.field(state.master_phase);
+	io.field(state.jitter_multiplier);
+	io.field(state.phase_difference);
+	io.field(state.divider_pattern_length);
+	for (size_t i = 0; i < marbles::kMarkovHistorySize; i++)
+		io.field(state.streak_counter[i]);
+	for (size_t i = 0; i < marbles::kMarkovHistorySize; i++)
+		io.field(state.markov_history[i]);
+	io.field(state.markov_history_ptr);
+	io.field(state.drum_pattern_step);
+	io.field(state.drum_pattern_index);
+}
+
+template <typename T>
+static void serialize(T &io, marbles::YGroupState &state) {
+	serialize(io, state.sequence);
+	serialize(io, state.output_channel);
+	serialize(io, state.ramp_divider);
+}
+
+// The number of Y groups is stored, so that it can change without breaking
+// the patches.
+template <typename T>
+static void serialize(T &io, marbles::XYGeneratorState &state, uint32_t numYGroups) {
+	for (size_t i = 0; i < marbles::kNumChannels; i++)
+		serialize(io, state.sequence[i]);
+	for (size_t i = 0; i < marbles::kNumChannels; i++)
+		serialize(io, state.output_channel[i]);
+	serialize(io, state.ramp_divider);
+	for (uint32_t i = 0; i < numYGroups; i++) {
+		marbles::YGroupState unused;
+		serialize(io, i < marbles::kMaxNumYGroups - 1 ? state.y_group[i] : unused);
+	}
+}
+
+
+std::string encodeMarblesSnapshot(const MarblesSnapshot &snapshot) {
+	MarblesSnapshot state = snapshot;
+	SnapshotWriter writer;
+	writer.data.assign(snapshotMagic, snapshotMagic + sizeof(snapshotMagic));
+	writer.field(snapshotVersion);
+	uint32_t numYGroups = marbles::kMaxNumYGroups - 1;
+	writer.field(numYGroups);
+	writer.field(state.random_state);
+	serialize(writer, state.t);
+	serialize(writer, state.xy, numYGroups);
+	return toBase64(&writer.data[0], writer.data.size());
+}
+
+bool decodeMarblesSnapshot(const std::string &text, MarblesSnapshot *snapshot) {
+	std::vector<uint8_t> data;
+	if (!fromBase64(text, &data) || data.size() < sizeof(snapshotMagic))
+		return false;
+	if (memcmp(&data[0], snapshotMagic, sizeof(snapshotMagic)) != 0)
+		return false;
+
+	SnapshotReader reader(data);
+	reader.position = sizeof(snapshotMagic);
+	uint32_t version;
+	reader.field(version);
+	if (version != snapshotVersion)
+		return false;
+	uint32_t numYGroups;
+	reader.field(numYGroups);
+	if (reader.overrun || numYGroups > 64)
+		return false;
+
+	// Indices are checked again when the state is restored. The Y groups
+	// missing from the snapshot start from silent, empty loops.
+	MarblesSnapshot state;
+	memset(&state, 0, sizeof(state));
+	reader.field(state.random_state);
+	serialize(reader, state.t);
+	serialize(reader, state.xy, numYGroups);
+	if (reader.overrun || reader.position != data.size())
+		return false;
+	*snapshot = state;
+	return true;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+#include "marbles/random/t_generator.h"
+#include "marbles/random/x_y_generator.h"
+
+// Random memory of a Marbles instance: the deja vu loops, the T generator
+// patterns and the values held by the outputs. Restoring it reproduces the
+// same sequences from the same clocks.
+struct MarblesSnapshot {
+	uint32_t random_state;
+	marbles::TGeneratorState t;
+	marbles::XYGeneratorState xy;
+};
+
+// Snapshots are stored in patches as base64 text. The fields are written one
+// by one, in little-endian order, after a version number which must be bumped
+// when they change.
+std::string encodeMarblesSnapshot(const MarblesSnapshot &snapshot);
+bool decodeMarblesSnapshot(const std::string &text, MarblesSnapshot *snapshot);
@@ -0,0 +1,475 @@
+#include "plugin.hpp"
+#include "plaits/dsp/voice.h"
+#include <osdialog.h>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+
+#define MAX_PLAITS_VOICES 16
+
+// Scratch RAM of each voice. All the engines of a voice share it.
+static const int PLAITS_VOICE_BUFFER_SIZE = 16384;
+
+// A wavetable bank holds 192 integrated waves of 256 + 4 samples, stored as
+// little-endian 16-bit integers, like the built-in waves.
+static const int PLAITS_WAVETABLE_BANK_SIZE = 192 * (256 + 4);
+
+static const char *modelLabels[16] = {
+	"Pair of classic waveforms",
+	"Waveshaping oscillator",
+	"Two operator FM",
+	"Granular formant oscillator",
+	"Harmonic oscillator",
+	"Wavetable oscillator",
+	"Chords",
+	"Vowel and speech synthesis",
+	"Granular cloud",
+	"Filtered noise",
+	"Particle noise",
+	"Inharmonic string modeling",
+	"Modal resonator",
+	"Analog bass drum",
+	"Analog snare drum",
+	"Analog hi-hat",
+};
+
+
+struct Plaits : Module {
+	enum ParamIds {
+		MODEL1_PARAM,
+		MODEL2_PARAM,
+		FREQ_PARAM,
+		HARMONICS_PARAM,
+		TIMBRE_PARAM,
+		MORPH_PARAM,
+		TIMBRE_CV_PARAM,
+		FREQ_CV_PARAM,
+		MORPH_CV_PARAM,
+		LPG_COLOR_PARAM,
+		LPG_DECAY_PARAM,
+		NUM_PARAMS
+	};
+	enum InputIds {
+		ENGINE_INPUT,
+		TIMBRE_INPUT,
+		FREQ_INPUT,
+		MORPH_INPUT,
+		HARMONICS_INPUT,
+		TRIGGER_INPUT,
+		LEVEL_INPUT,
+		NOTE_INPUT,
+		NUM_INPUTS
+	};
+	enum OutputIds {
+		OUT_OUTPUT,
+		AUX_OUTPUT,
+		NUM_OUTPUTS
+	};
+	enum LightIds {
+		ENUMS(MODEL_LIGHT, 8 * 2),
+		NUM_LIGHTS
+	};
+
+	plaits::Voice voice[MAX_PLAITS_VOICES];
+	plaits::Patch patch = {};
+	// One pool for the scratch RAM of all the voices, split in one region per
+	// voice.
+	alignas(16) char shared_buffer[MAX_PLAITS_VOICES][PLAITS_VOICE_BUFFER_SIZE] = {};
+	float triPhase = 0.f;
+
+	// Out and aux of all the voices are resampled together.
+	dsp::SampleRateConverter<MAX_PLAITS_VOICES * 2> outputSrc;
+	dsp::DoubleRingBuffer<dsp::Frame<MAX_PLAITS_VOICES * 2>, 256> outputBuffer;
+	bool lowCpu = false;
+	// The timbre and morph knobs set the LPG response and decay
+	bool lpgMode = false;
+
+	// User wavetable bank, shared by all the voices. Null for the built-in
+	// waves.
+	std::shared_ptr<const std::vector<int16_t>> waves;
+	// Wavetable bank handed over by the UI thread, applied in process()
+	std::mutex wavesMutex;
+	std::shared_ptr<const std::vector<int16_t>> pendingWaves;
+	std::atomic<bool> wavesChanged{false};
+	std::string wavesPath;
+
+	dsp::BooleanTrigger model1Trigger;
+	dsp::BooleanTrigger model2Trigger;
+
+	Plaits() {
+		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
+		configParam(MODEL1_PARAM, 0.0, 1.0, 0.0, "Pitched models");
+		configParam(MODEL2_PARAM, 0.0, 1.0, 0.0, "Noise/percussive models");
+		configParam(FREQ_PARAM, -4.0, 4.0, 0.0, "Frequency", " semitones", 0.f, 12.f);
+		configParam(HARMONICS_PARAM, 0.0, 1.0, 0.5, "Harmonics", "%", 0.f, 100.f);
+		configParam(TIMBRE_PARAM, 0.0, 1.0, 0.5, "Timbre", "%", 0.f, 100.f);
+		configParam(LPG_COLOR_PARAM, 0.0, 1.0, 0.5, "Lowpass gate response", "%", 0.f, 100.f);
+		configParam(MORPH_PARAM, 0.0, 1.0, 0.5, "Morph", "%", 0.f, 100.f);
+		configParam(LPG_DECAY_PARAM, 0.0, 1.0, 0.5, "Lowpass gate decay", "%", 0.f, 100.f);
+		configParam(TIMBRE_CV_PARAM, -1.0, 1.0, 0.0, "Timbre CV");
+		configParam(FREQ_CV_PARAM, -1.0, 1.0, 0.0, "Frequency CV");
+		configParam(MORPH_CV_PARAM, -1.0, 1.0, 0.0, "Morph CV");
+
+		for (int i = 0; i < MAX_PLAITS_VOICES; i++) {
+			stmlib::BufferAllocator allocator(shared_buffer[i], sizeof(shared_buffer[i]));
+			voice[i].Init(&allocator);
+		}
+
+		onReset();
+	}
+
+	// Loads a wavetable bank, or goes back to the built-in waves if the path
+	// is empty.
+	bool loadWaves(const std::string &path, std::string *error) {
+		std::shared_ptr<std::vector<int16_t>> bank;
+		if (!path.empty()) {
+			std::ifstream file(path, std::ios::binary);
+			if (!file) {
+				*error = "Could not open " + path;
+				return false;
+			}
+			bank = std::make_shared<std::vector<int16_t>>(PLAITS_WAVETABLE_BANK_SIZE);
+			file.read((char*) bank->data(), PLAITS_WAVETABLE_BANK_SIZE * sizeof(int16_t));
+			if (file.gcount() != PLAITS_WAVETABLE_BANK_SIZE * (int) sizeof(int16_t) || file.peek() != EOF) {
+				*error = string::f("A wavetable bank must contain exactly %d bytes", PLAITS_WAVETABLE_BANK_SIZE * (int) sizeof(int16_t));
+				return false;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(wavesMutex);
+		pendingWaves = bank;
+		wavesChanged = true;
+		wavesPath = path;
+		return true;
+	}
+
+	void applyWaves() {
+		if (!wavesChanged || !wavesMutex.try_lock())
+			return;
+		// The previous bank is released by the UI thread, not here
+		std::swap(waves, pendingWaves);
+		for (int i = 0; i < MAX_PLAITS_VOICES; i++)
+			voice[i].set_wavetable_waves(waves ? waves->data() : NULL);
+		wavesChanged = false;
+		wavesMutex.unlock();
+	}
+
+	void onReset() override {
+		patch.engine = 0;
+		lpgMode = false;
+	}
+
+	void onRandomize() override {
+		patch.engine = random::u32() % 16;
+	}
+
+	json_t *dataToJson() override {
+		json_t *rootJ = json_object();
+
+		json_object_set_new(rootJ, "lowCpu", json_boolean(lowCpu));
+		json_object_set_new(rootJ, "model", json_integer(patch.engine));
+		{
+			std::lock_guard<std::mutex> lock(wavesMutex);
+			if (!wavesPath.empty())
+				json_object_set_new(rootJ, "wavetableBank", json_string(wavesPath.c_str()));
+		}
+
+		return rootJ;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		json_t *lowCpuJ = json_object_get(rootJ, "lowCpu");
+		if (lowCpuJ)
+			lowCpu = json_boolean_value(lowCpuJ);
+		// Patches saved with the render mode setting: 0 native, 1 resampled,
+		// 2 low CPU. The native mode now renders resampled.
+		json_t *renderModeJ = json_object_get(rootJ, "renderMode");
+		if (renderModeJ)
+			lowCpu = (json_integer_value(renderModeJ) == 2);
+
+		json_t *modelJ = json_object_get(rootJ, "model");
+		if (modelJ)
+			patch.engine = clamp((int) json_integer_value(modelJ), 0, 15);
+
+		json_t *wavetableBankJ = json_object_get(rootJ, "wavetableBank");
+		std::string error;
+		if (!loadWaves(wavetableBankJ ? json_string_value(wavetableBankJ) : "", &error))
+			WARN("Plaits: %s", error.c_str());
+	}
+
+	void process(const ProcessArgs &args) override {
+		int channels = std::max(inputs[NOTE_INPUT].getChannels(), 1);
+
+		if (outputBuffer.empty()) {
+			const int blockSize = plaits::kBlockSize;
+
+			applyWaves();
+
+			// Model buttons
+			if (model1Trigger.process(params[MODEL1_PARAM].getValue())) {
+				if (patch.engine >= 8) {
+					patch.engine -= 8;
+				}
+				else {
+					patch.engine = (patch.engine + 1) % 8;
+				}
+			}
+			if (model2Trigger.process(params[MODEL2_PARAM].getValue())) {
+				if (patch.engine < 8) {
+					patch.engine += 8;
+				}
+				else {
+					patch.engine = (patch.engine + 1) % 8 + 8;
+				}
+			}
+
+			// Model lights
+			// Pulse light at 2 Hz
+			triPhase += 2.f * args.sampleTime * blockSize;
+			if (triPhase >= 1.f)
+				triPhase -= 1.f;
+			float tri = (triPhase < 0.5f) ? triPhase * 2.f : (1.f - triPhase) * 2.f;
+
+			// Get the active engines of all the voices
+			bool activeEngines[16] = {};
+			bool pulse = false;
+			for (int c = 0; c < channels; c++) {
+				int activeEngine = voice[c].active_engine();
+				if (activeEngine < 0)
+					continue;
+				activeEngines[activeEngine] = true;
+				// Pulse the light if at least one voice is using a different engine.
+				if (activeEngine != patch.engine)
+					pulse = true;
+			}
+
+			for (int i = 0; i < 16; i++) {
+				// Transpose the [light][color] table
+				int lightId = (i % 8) * 2 + (i / 8);
+				float brightness = activeEngines[i];
+				if (patch.engine == i && pulse)
+					brightness = tri;
+				lights[MODEL_LIGHT + lightId].setBrightness(brightness);
+			}
+
+			// The knobs are read once per block, for all the voices
+			float pitch = params[FREQ_PARAM].getValue();
+			if (lowCpu)
+				pitch += std::log2(48000.f * args.sampleTime);
+			patch.note = 60.f + pitch * 12.f;
+			patch.harmonics = params[HARMONICS_PARAM].getValue();
+			patch.timbre = params[TIMBRE_PARAM].getValue();
+			patch.morph = params[MORPH_PARAM].getValue();
+			patch.lpg_colour = params[LPG_COLOR_PARAM].getValue();
+			patch.decay = params[LPG_DECAY_PARAM].getValue();
+			patch.frequency_cv_amount = params[FREQ_CV_PARAM].getValue();
+			patch.timbre_cv_amount = params[TIMBRE_CV_PARAM].getValue();
+			patch.morph_cv_amount = params[MORPH_CV_PARAM].getValue();
+			// No attenuverter on the panel
+			patch.harmonics_cv_amount = 1.f;
+
+			plaits::Modulations modulations;
+			modulations.frequency_patched = inputs[FREQ_INPUT].isConnected();
+			modulations.timbre_patched = inputs[TIMBRE_INPUT].isConnected();
+			modulations.morph_patched = inputs[MORPH_INPUT].isConnected();
+			modulations.harmonics_patched = inputs[HARMONICS_INPUT].isConnected();
+			modulations.trigger_patched = inputs[TRIGGER_INPUT].isConnected();
+			modulations.level_patched = inputs[LEVEL_INPUT].isConnected();
+
+			// Render a block of each voice, then convert them all in one pass
+			dsp::Frame<MAX_PLAITS_VOICES * 2> outputFrames[blockSize];
+			for (int c = 0; c < channels; c++) {
+				modulations.engine = inputs[ENGINE_INPUT].getPolyVoltage(c) / 5.f;
+				modulations.note = inputs[NOTE_INPUT].getVoltage(c) * 12.f;
+				modulations.frequency = inputs[FREQ_INPUT].getPolyVoltage(c) * 6.f;
+				modulations.harmonics = inputs[HARMONICS_INPUT].getPolyVoltage(c) / 5.f;
+				modulations.timbre = inputs[TIMBRE_INPUT].getPolyVoltage(c) / 8.f;
+				modulations.morph = inputs[MORPH_INPUT].getPolyVoltage(c) / 8.f;
+				// Triggers at around 0.7 V
+				modulations.trigger = inputs[TRIGGER_INPUT].getPolyVoltage(c) / 3.f;
+				modulations.level = inputs[LEVEL_INPUT].getPolyVoltage(c) / 8.f;
+
+				float out[blockSize];
+				float aux[blockSize];
+				voice[c].Render(patch, modulations, out, aux, blockSize);
+
+				for (int i = 0; i < blockSize; i++) {
+					outputFrames[i].samples[c * 2 + 0] = out[i];
+					outputFrames[i].samples[c * 2 + 1] = aux[i];
+				}
+			}
+
+			if (lowCpu) {
+				int len = std::min((int) outputBuffer.capacity(), blockSize);
+				std::memcpy(outputBuffer.endData(), outputFrames, len * sizeof(outputFrames[0]));
+				outputBuffer.endIncr(len);
+			}
+			else {
+				outputSrc.setRates(48000, (int) args.sampleRate);
+				outputSrc.setChannels(channels * 2);
+				int inLen = blockSize;
+				int outLen = outputBuffer.capacity();
+				outputSrc.process(outputFrames, &inLen, outputBuffer.endData(), &outLen);
+				outputBuffer.endIncr(outLen);
+			}
+		}
+
+		outputs[OUT_OUTPUT].setChannels(channels);
+		outputs[AUX_OUTPUT].setChannels(channels);
+		if (!outputBuffer.empty()) {
+			dsp::Frame<MAX_PLAITS_VOICES * 2> outputFrame = outputBuffer.shift();
+			for (int c = 0; c < channels; c++) {
+				outputs[OUT_OUTPUT].setVoltage(outputFrame.samples[c * 2 + 0] * 5.f, c);
+				outputs[AUX_OUTPUT].setVoltage(outputFrame.samples[c * 2 + 1] * 5.f, c);
+			}
+		}
+	}
+};
+
+
+struct PlaitsWidget : ModuleWidget {
+	Widget *timbreKnob;
+	Widget *morphKnob;
+	Widget *lpgColorKnob;
+	Widget *lpgDecayKnob;
+
+	PlaitsWidget(Plaits *module) {
+		setModule(module);
+		setPanel(APP->window->loadSvg(asset::plugin(pluginInstance, "res/Plaits.svg")));
+
+		addChild(createWidget<ScrewSilver>(Vec(RACK_GRID_WIDTH, 0)));
+		addChild(createWidget<ScrewSilver>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, 0)));
+		addChild(createWidget<ScrewSilver>(Vec(RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
+		addChild(createWidget<ScrewSilver>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
+
+		addParam(createParam<TL1105>(mm2px(Vec(23.32685, 14.6539)), module, Plaits::MODEL1_PARAM));
+		addParam(createParam<TL1105>(mm2px(Vec(32.22764, 14.6539)), module, Plaits::MODEL2_PARAM));
+		addParam(createParam<Rogan3PSWhite>(mm2px(Vec(3.1577, 20.21088)), module, Plaits::FREQ_PARAM));
+		addParam(createParam<Rogan3PSWhite>(mm2px(Vec(39.3327, 20.21088)), module, Plaits::HARMONICS_PARAM));
+		timbreKnob = createParam<Rogan1PSWhite>(mm2px(Vec(4.04171, 49.6562)), module, Plaits::TIMBRE_PARAM);
+		morphKnob = createParam<Rogan1PSWhite>(mm2px(Vec(42.71716, 49.6562)), module, Plaits::MORPH_PARAM);
+		lpgColorKnob = createParam<Rogan1PSWhite>(mm2px(Vec(4.04171, 49.6562)), module, Plaits::LPG_COLOR_PARAM);
+		lpgDecayKnob = createParam<Rogan1PSWhite>(mm2px(Vec(42.71716, 49.6562)), module, Plaits::LPG_DECAY_PARAM);
+		addParam(timbreKnob);
+		addParam(morphKnob);
+		addParam(lpgColorKnob);
+		addParam(lpgDecayKnob);
+		addParam(createParam<Trimpot>(mm2px(Vec(7.88712, 77.60705)), module, Plaits::TIMBRE_CV_PARAM));
+		addParam(createParam<Trimpot>(mm2px(Vec(27.2245, 77.60705)), module, Plaits::FREQ_CV_PARAM));
+		addParam(createParam<Trimpot>(mm2px(Vec(46.56189, 77.60705)), module, Plaits::MORPH_CV_PARAM));
+
+		addInput(createInput<PJ301MPort>(mm2px(Vec(3.31381, 92.48067)), module, Plaits::ENGINE_INPUT));
+		addInput(createInput<PJ301MPort>(mm2px(Vec(14.75983, 92.48067)), module, Plaits::TIMBRE_INPUT));
+		addInput(createInput<PJ301MPort>(mm2px(Vec(26.20655, 92.48067)), module, Plaits::FREQ_INPUT));
+		addInput(createInput<PJ301MPort>(mm2px(Vec(37.65257, 92.48067)), module, Plaits::MORPH_INPUT));
+		addInput(createInput<PJ301MPort>(mm2px(Vec(49.0986, 92.48067)), module, Plaits::HARMONICS_INPUT));
+		addInput(createInput<PJ301MPort>(mm2px(Vec(3.31381, 107.08103)), module, Plaits::TRIGGER_INPUT));
+		addInput(createInput<PJ301MPort>(mm2px(Vec(14.75983, 107.08103)), module, Plaits::LEVEL_INPUT));
+		addInput(createInput<PJ301MPort>(mm2px(Vec(26.20655, 107.08103)), module, Plaits::NOTE_INPUT));
+
+		addOutput(createOutput<PJ301MPort>(mm2px(Vec(37.65257, 107.08103)), module, Plaits::OUT_OUTPUT));
+		addOutput(createOutput<PJ301MPort>(mm2px(Vec(49.0986, 107.08103)), module, Plaits::AUX_OUTPUT));
+
+		static const float lightY[8] = {23.31649, 28.71704, 34.1162, 39.51675, 44.91731, 50.31785, 55.71771, 61.11827};
+		for (int i = 0; i < 8; i++) {
+			addChild(createLight<MediumLight<GreenRedLight>>(mm2px(Vec(28.79498, lightY[i])), module, Plaits::MODEL_LIGHT + i * 2));
+		}
+	}
+
+	void step() override {
+		Plaits *module = dynamic_cast<Plaits*>(this->module);
+		bool lpgMode = module && module->lpgMode;
+		timbreKnob->visible = !lpgMode;
+		morphKnob->visible = !lpgMode;
+		lpgColorKnob->visible = lpgMode;
+		lpgDecayKnob->visible = lpgMode;
+		ModuleWidget::step();
+	}
+
+	void appendContextMenu(Menu *menu) override {
+		Plaits *module = dynamic_cast<Plaits*>(this->module);
+
+		struct PlaitsLowCpuItem : MenuItem {
+			Plaits *module;
+			void onAction(const event::Action &e) override {
+				module->lowCpu ^= true;
+			}
+		};
+
+		struct PlaitsLpgModeItem : MenuItem {
+			Plaits *module;
+			void onAction(const event::Action &e) override {
+				module->lpgMode ^= true;
+			}
+		};
+
+		struct PlaitsLoadWavesItem : MenuItem {
+			Plaits *module;
+			void onAction(const event::Action &e) override {
+				osdialog_filters *filters = osdialog_filters_parse("Plaits wavetable bank:bin");
+				char *path = osdialog_file(OSDIALOG_OPEN, NULL, NULL, filters);
+				osdialog_filters_free(filters);
+				if (!path)
+					return;
+				std::string error;
+				if (!module->loadWaves(path, &error))
+					osdialog_message(OSDIALOG_WARNING, OSDIALOG_OK, error.c_str());
+				free(path);
+			}
+		};
+
+		struct PlaitsClearWavesItem : MenuItem {
+			Plaits *module;
+			void onAction(const event::Action &e) override {
+				std::string error;
+				module->loadWaves("", &error);
+			}
+		};
+
+		struct PlaitsModelItem : MenuItem {
+			Plaits *module;
+			int model;
+			void onAction(const event::Action &e) override {
+				module->patch.engine = model;
+			}
+		};
+
+		menu->addChild(new MenuEntry);
+		PlaitsLowCpuItem *lowCpuItem = createMenuItem<PlaitsLowCpuItem>("Low CPU (disable resampling)", CHECKMARK(module->lowCpu));
+		lowCpuItem->module = module;
+		menu->addChild(lowCpuItem);
+
+		menu->addChild(new MenuEntry);
+		std::string wavesPath;
+		{
+			std::lock_guard<std::mutex> lock(module->wavesMutex);
+			wavesPath = module->wavesPath;
+		}
+		menu->addChild(createMenuLabel("Wavetable bank: " + (wavesPath.empty() ? std::string("built-in") : string::filename(wavesPath))));
+		PlaitsLoadWavesItem *loadWavesItem = createMenuItem<PlaitsLoadWavesItem>("Load wavetable bank (.bin)...");
+		loadWavesItem->module = module;
+		menu->addChild(loadWavesItem);
+		if (!wavesPath.empty()) {
+			PlaitsClearWavesItem *clearWavesItem = createMenuItem<PlaitsClearWavesItem>("Use the built-in wavetable bank");
+			clearWavesItem->module = module;
+			menu->addChild(clearWavesItem);
+		}
+
+		menu->addChild(new MenuEntry);
+		PlaitsLpgModeItem *lpgModeItem = createMenuItem<PlaitsLpgModeItem>("Edit LPG response/decay", CHECKMARK(module->lpgMode));
+		lpgModeItem->module = module;
+		menu->addChild(lpgModeItem);
+
+		menu->addChild(new MenuEntry);
+		menu->addChild(createMenuLabel("Models"));
+		for (int i = 0; i < 16; i++) {
+			PlaitsModelItem *modelItem = createMenuItem<PlaitsModelItem>(modelLabels[i], CHECKMARK(module->patch.engine == i));
+			modelItem->module = module;
+			modelItem->model = i;
+			menu->addChild(modelItem);
+		}
+	}
+};
+
+
+Model *modelPlaits = createModel<Plaits, PlaitsWidget>("PolyPlaits");
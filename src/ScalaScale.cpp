@@ -0,0 +1,412 @@
+#include "ScalaScale.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include "stmlib/utils/crc32.h"
+
+
+static std::string trim(const std::string &s) {
+	size_t begin = s.find_first_not_of(" \t\r\n");
+	if (begin == std::string::npos)
+		return "";
+	size_t end = s.find_last_not_of(" \t\r\n");
+	return s.substr(begin, end - begin + 1);
+}
+
+// Splits the text into lines, dropping the "!" comment lines.
+static std::vector<std::string> scalaLines(const std::string &text) {
+	std::vector<std::string> lines;
+	std::istringstream stream(text);
+	std::string line;
+	while (std::getline(stream, line)) {
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		if (!line.empty() && line[0] == '!')
+			continue;
+		lines.push_back(line);
+	}
+	return lines;
+}
+
+static bool parseInteger(const std::string &s, long *value) {
+	if (s.empty())
+		return false;
+	char *end = NULL;
+	*value = strtol(s.c_str(), &end, 10);
+	return *end == '\0';
+}
+
+static int gcd(int a, int b) {
+	while (b) {
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+// Complexity (reduced p*q) of the simplest ratio within a few cents of the
+// interval, or 0 if there is none.
+static double approximateRatioComplexity(double cents) {
+	const double tolerance = 16.0;
+	double ratio = std::pow(2.0, cents / 1200.0);
+	double best = 0.0;
+	for (int q = 1; q <= 32; q++) {
+		int p = (int) std::round(ratio * q);
+		if (p <= 0)
+			continue;
+		double error = std::fabs(1200.0 * std::log2((double) p / q) - cents);
+		if (error > tolerance)
+			continue;
+		int d = gcd(p, q);
+		double complexity = (double) (p / d) * (q / d);
+		if (best == 0.0 || complexity < best)
+			best = complexity;
+	}
+	return best;
+}
+
+bool parseScalaTuning(const std::string &text, ScalaTuning *tuning, std::string *error) {
+	std::vector<std::string> lines = scalaLines(text);
+	if (lines.size() < 2) {
+		*error = "Missing description or note count";
+		return false;
+	}
+	tuning->description = trim(lines[0]);
+	tuning->cents.clear();
+	tuning->ratioComplexity.clear();
+	tuning->weights.clear();
+
+	long numNotes;
+	std::istringstream countStream(lines[1]);
+	std::string countToken;
+	countStream >> countToken;
+	if (!parseInteger(countToken, &numNotes) || numNotes < 1) {
+		*error = "Invalid note count";
+		return false;
+	}
+	if ((long) lines.size() < 2 + numNotes) {
+		*error = "Fewer pitches than the note count";
+		return false;
+	}
+
+	for (long i = 0; i < numNotes; i++) {
+		std::istringstream lineStream(lines[2 + i]);
+		std::string pitch;
+		lineStream >> pitch;
+		if (pitch.empty()) {
+			*error = "Empty pitch line";
+			return false;
+		}
+
+		double cents;
+		double complexity = 0.0;
+		if (pitch.find('.') != std::string::npos) {
+			char *end = NULL;
+			cents = strtod(pitch.c_str(), &end);
+			if (*end != '\0') {
+				*error = "Invalid pitch: " + pitch;
+				return false;
+			}
+		}
+		else {
+			size_t slash = pitch.find('/');
+			long p, q = 1;
+			if (!parseInteger(pitch.substr(0, slash), &p)
+				|| (slash != std::string::npos && !parseInteger(pitch.substr(slash + 1), &q))
+				|| p <= 0 || q <= 0) {
+				*error = "Invalid pitch: " + pitch;
+				return false;
+			}
+			cents = 1200.0 * std::log2((double) p / q);
+			long d = gcd(p, q);
+			complexity = (double) (p / d) * (q / d);
+		}
+
+		std::string weightToken;
+		lineStream >> weightToken;
+		long weight;
+		if (!parseInteger(weightToken, &weight) || weight < 0 || weight > 255)
+			weight = -1;
+
+		tuning->cents.push_back(cents);
+		tuning->ratioComplexity.push_back(complexity);
+		tuning->weights.push_back(weight);
+	}
+
+	if (tuning->cents.back() <= 0.0) {
+		*error = "The period must be a positive interval";
+		return false;
+	}
+	return true;
+}
+
+bool parseScalaKeyboardMapping(const std::string &text, ScalaKeyboardMapping *kbm, std::string *error) {
+	std::vector<std::string> lines = scalaLines(text);
+	if (lines.size() < 7) {
+		*error = "Incomplete keyboard mapping header";
+		return false;
+	}
+
+	long header[7];
+	double frequency = 0.0;
+	for (int i = 0; i < 7; i++) {
+		std::istringstream lineStream(lines[i]);
+		std::string token;
+		lineStream >> token;
+		bool valid;
+		if (i == 5) {
+			char *end = NULL;
+			frequency = strtod(token.c_str(), &end);
+			valid = !token.empty() && *end == '\0' && frequency > 0.0;
+		}
+		else {
+			valid = parseInteger(token, &header[i]);
+		}
+		if (!valid) {
+			*error = "Invalid keyboard mapping header";
+			return false;
+		}
+	}
+
+	kbm->size = header[0];
+	kbm->firstNote = header[1];
+	kbm->lastNote = header[2];
+	kbm->middleNote = header[3];
+	kbm->referenceNote = header[4];
+	kbm->referenceFrequency = frequency;
+	kbm->octaveDegree = header[6];
+	kbm->mapping.clear();
+	if (kbm->size < 0 || kbm->octaveDegree < 0) {
+		*error = "Invalid keyboard mapping header";
+		return false;
+	}
+
+	for (int i = 0; i < kbm->size; i++) {
+		std::string token;
+		if (7 + i < (int) lines.size()) {
+			std::istringstream lineStream(lines[7 + i]);
+			lineStream >> token;
+		}
+		long degree;
+		if (token.empty() || token == "x" || token == "X")
+			degree = -1;
+		else if (!parseInteger(token, &degree) || degree < 0) {
+			*error = "Invalid mapping entry: " + token;
+			return false;
+		}
+		kbm->mapping.push_back(degree);
+	}
+	return true;
+}
+
+bool readScalaFile(const std::string &path, std::string *text, std::string *error) {
+	std::ifstream file(path);
+	if (!file) {
+		*error = "Could not open " + path;
+		return false;
+	}
+	std::ostringstream stream;
+	stream << file.rdbuf();
+	if (file.bad()) {
+		*error = "Could not read " + path;
+		return false;
+	}
+	*text = stream.str();
+	return true;
+}
+
+bool compileScalaScale(const ScalaTuning &tuning, const ScalaKeyboardMapping *kbm, marbles::Scale *scale, std::string *error) {
+	int numNotes = tuning.cents.size();
+	if (numNotes < 1) {
+		*error = "Empty tuning";
+		return false;
+	}
+
+	struct Note {
+		double cents;
+		double complexity;
+		int weight;
+		bool used;
+	};
+	// Degree 0 is the implicit 1/1.
+	std::vector<Note> notes(numNotes);
+	notes[0] = {0.0, 1.0, 255, true};
+	for (int i = 1; i < numNotes; i++) {
+		double complexity = tuning.ratioComplexity[i - 1];
+		if (complexity == 0.0)
+			complexity = approximateRatioComplexity(tuning.cents[i - 1]);
+		notes[i] = {tuning.cents[i - 1], complexity, tuning.weights[i - 1], true};
+	}
+	if (tuning.weights[numNotes - 1] >= 0)
+		notes[0].weight = tuning.weights[numNotes - 1];
+	double period = tuning.cents[numNotes - 1];
+
+	double offset = 0.0;
+	if (kbm) {
+		int octaveDegree = kbm->octaveDegree;
+		if (octaveDegree > 0 && octaveDegree < numNotes)
+			period = notes[octaveDegree].cents;
+
+		// Degrees which are not on any key are left out of the scale.
+		if (kbm->size > 0) {
+			for (int i = 0; i < numNotes; i++)
+				notes[i].used = false;
+			for (int degree : kbm->mapping) {
+				if (degree >= 0)
+					notes[degree % numNotes].used = true;
+			}
+		}
+
+		// Pitch of the reference key relative to the middle key.
+		int key = kbm->referenceNote - kbm->middleNote;
+		int degree = key;
+		int octaves = 0;
+		if (kbm->size > 0) {
+			octaves = (int) std::floor((double) key / kbm->size);
+			degree = kbm->mapping[key - octaves * kbm->size];
+			if (degree < 0) {
+				*error = "The reference note is unmapped";
+				return false;
+			}
+		}
+		else {
+			octaves = (int) std::floor((double) key / numNotes);
+			degree = key - octaves * numNotes;
+		}
+		octaves += degree / numNotes;
+		double referenceCents = notes[degree % numNotes].cents + octaves * period;
+
+		// Rack's 0V is C4, 9 semitones below A4 = 440 Hz.
+		double middleFrequency = kbm->referenceFrequency * std::pow(2.0, -referenceCents / 1200.0);
+		offset = 1200.0 * std::log2(middleFrequency / 440.0) + 900.0;
+	}
+
+	if (period <= 0.0) {
+		*error = "The period must be a positive interval";
+		return false;
+	}
+
+	std::vector<Note> used;
+	for (const Note &note : notes) {
+		if (note.used)
+			used.push_back(note);
+	}
+
+	// Missing weights are given by rank of harmonic simplicity.
+	std::vector<Note *> unweighted;
+	for (Note &note : used) {
+		if (note.weight < 0)
+			unweighted.push_back(&note);
+	}
+	std::stable_sort(unweighted.begin(), unweighted.end(), [](const Note *a, const Note *b) {
+		if ((a->complexity == 0.0) != (b->complexity == 0.0))
+			return b->complexity == 0.0;
+		return a->complexity < b->complexity;
+	});
+	static const int rankWeights[] = {192, 128, 96, 64, 32, 16, 8};
+	for (int i = 0; i < (int) unweighted.size(); i++)
+		unweighted[i]->weight = rankWeights[std::min(i, (int) (sizeof(rankWeights) / sizeof(rankWeights[0])) - 1)];
+
+	// The quantizer expects ascending voltages within one period.
+	for (Note &note : used) {
+		note.cents = std::fmod(note.cents + offset, period);
+		if (note.cents < 0.0)
+			note.cents += period;
+		if (note.cents >= period - 1e-3)
+			note.cents = 0.0;
+	}
+	std::stable_sort(used.begin(), used.end(), [](const Note &a, const Note &b) {
+		return a.cents < b.cents;
+	});
+
+	// Degrees which fold onto the same pitch, like a step just under the
+	// period and the 1/1, are merged into one degree with the heaviest weight.
+	std::vector<Note> merged;
+	for (const Note &note : used) {
+		if (!merged.empty() && note.cents - merged.back().cents < 1e-3)
+			merged.back().weight = std::max(merged.back().weight, note.weight);
+		else
+			merged.push_back(note);
+	}
+	used.swap(merged);
+
+	if ((int) used.size() > marbles::kMaxDegrees) {
+		std::stable_sort(used.begin(), used.end(), [](const Note &a, const Note &b) {
+			return a.weight > b.weight;
+		});
+		used.resize(marbles::kMaxDegrees);
+		std::sort(used.begin(), used.end(), [](const Note &a, const Note &b) {
+			return a.cents < b.cents;
+		});
+	}
+
+	scale->base_interval = period / 1200.0;
+	scale->num_degrees = used.size();
+	for (int i = 0; i < (int) used.size(); i++) {
+		scale->degree[i].voltage = used[i].cents / 1200.0;
+		scale->degree[i].weight = used[i].weight;
+	}
+	return true;
+}
+
+
+struct QuantizerTableCacheEntry {
+	marbles::Scale scale;
+	std::weak_ptr<const marbles::QuantizerTable> table;
+};
+
+static bool scalesEqual(const marbles::Scale &a, const marbles::Scale &b) {
+	if (a.base_interval != b.base_interval || a.num_degrees != b.num_degrees)
+		return false;
+	for (int i = 0; i < a.num_degrees; i++) {
+		if (a.degree[i].voltage != b.degree[i].voltage || a.degree[i].weight != b.degree[i].weight)
+			return false;
+	}
+	return true;
+}
+
+static uint32_t scaleHash(const marbles::Scale &scale) {
+	// Hash fields one by one, struct padding and unused degrees are garbage.
+	uint32_t hash = crc32(0, &scale.base_interval, sizeof(scale.base_interval));
+	hash = crc32(hash, &scale.num_degrees, sizeof(scale.num_degrees));
+	for (int i = 0; i < scale.num_degrees && i < marbles::kMaxDegrees; i++) {
+		hash = crc32(hash, &scale.degree[i].voltage, sizeof(scale.degree[i].voltage));
+		hash = crc32(hash, &scale.degree[i].weight, sizeof(scale.degree[i].weight));
+	}
+	return hash;
+}
+
+std::shared_ptr<const marbles::QuantizerTable> getQuantizerTable(const marbles::Scale &scale) {
+	static std::mutex cacheMutex;
+	static std::multimap<uint32_t, QuantizerTableCacheEntry> cache;
+
+	uint32_t hash = scaleHash(scale);
+	std::lock_guard<std::mutex> lock(cacheMutex);
+
+	auto range = cache.equal_range(hash);
+	for (auto it = range.first; it != range.second;) {
+		std::shared_ptr<const marbles::QuantizerTable> table = it->second.table.lock();
+		if (!table) {
+			// No instance uses this scale anymore.
+			it = cache.erase(it);
+			continue;
+		}
+		if (scalesEqual(it->second.scale, scale))
+			return table;
+		++it;
+	}
+
+	std::shared_ptr<marbles::QuantizerTable> table = std::make_shared<marbles::QuantizerTable>();
+	if (!table->Init(scale))
+		return NULL;
+	QuantizerTableCacheEntry entry;
+	entry.scale = scale;
+	entry.table = table;
+	cache.insert(std::make_pair(hash, entry));
+	return table;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "marbles/random/quantizer.h"
+
+// Scala tuning (.scl) and keyboard mapping (.kbm) import for Marbles.
+//
+// A weight (0-255) for the quantizer may follow the pitch of a .scl line, as
+// in "701.955 192". Scala ignores anything after the pitch value, so such
+// files stay valid for other software. Degrees without a weight get one from
+// the harmonic simplicity of their interval.
+
+struct ScalaTuning {
+	std::string description;
+	// Pitches of degrees 1..N, in cents. The last one is the period.
+	std::vector<double> cents;
+	// Reduced p*q for ratio pitches, 0 for pitches given in cents.
+	std::vector<double> ratioComplexity;
+	// -1 when the weight is not given in the file.
+	std::vector<int> weights;
+};
+
+struct ScalaKeyboardMapping {
+	int size = 0;
+	int firstNote = 0;
+	int lastNote = 127;
+	int middleNote = 60;
+	int referenceNote = 69;
+	double referenceFrequency = 440.0;
+	int octaveDegree = 0;
+	// Scale degree of each key, -1 for unmapped keys ("x").
+	std::vector<int> mapping;
+};
+
+// Reads the text of a .scl or .kbm file.
+bool readScalaFile(const std::string &path, std::string *text, std::string *error);
+bool parseScalaTuning(const std::string &text, ScalaTuning *tuning, std::string *error);
+bool parseScalaKeyboardMapping(const std::string &text, ScalaKeyboardMapping *kbm, std::string *error);
+
+// Builds a Marbles scale (1V/oct, 0V = C4) from a tuning and an optional
+// mapping. Only the 16 heaviest degrees are kept for larger tunings.
+bool compileScalaScale(const ScalaTuning &tuning, const ScalaKeyboardMapping *kbm, marbles::Scale *scale, std::string *error);
+
+// Returns the compiled quantizer table for a scale. Tables are cached by
+// content hash, so all the instances using the same scale share one table,
+// and it is compiled only once.
+std::shared_ptr<const marbles::QuantizerTable> getQuantizerTable(const marbles::Scale &scale);
@@ -6,4 +6,5 @@ void init(Plugin *p) {
 	pluginInstance = p;
 	p->addModel(modelBraids);
 	p->addModel(modelMarbles);
+	p->addModel(modelPlaits);
 }